@@ -0,0 +1,128 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace EK
+{
+
+/*
+Augmentation policies for EK::Map.
+
+Every node of an augmented map stores an aggregate of its whole subtree. A policy defines:
+	using value_type;                                   // type of the aggregate
+	static value_type make( const Key&, const T& );     // aggregate of a single node
+	static value_type combine( const value_type& left, const value_type& right ); // must be associative
+The map keeps the aggregates valid through rotations, insertions and erasures.
+Aggregates that depend on mapped values can't see a change made through a reference:
+use insert_or_assign() or call refresh() for the changed element.
+*/
+
+struct NoAugmentation
+{
+	using value_type = void; // nodes store no aggregate
+};
+
+struct OrderStatistics
+{
+	// Subtree sizes. They give rank(), select() and count_range() of the map in O(log n).
+	using value_type = std::size_t;
+
+	template<typename Key, typename T>
+	static value_type make( const Key&, const T& ) { return 1; }
+	static value_type combine( value_type left, value_type right ) { return left + right; }
+	static std::size_t size( value_type aggregate ) { return aggregate; }
+};
+
+template<typename T>
+struct SubtreeSum
+{
+	// Sums of mapped values. They give reduce( lo, hi ) of the map, a sum over a key range, in O(log n).
+	using value_type = T;
+
+	template<typename Key>
+	static value_type make( const Key&, const T& value ) { return value; }
+	static value_type combine( const value_type& left, const value_type& right ) { return left + right; }
+};
+
+template<typename T, typename Compare = std::less<T>>
+struct SubtreeMin
+{
+	// The least mapped value of a subtree.
+	using value_type = T;
+
+	template<typename Key>
+	static value_type make( const Key&, const T& value ) { return value; }
+	static value_type combine( const value_type& left, const value_type& right )
+	{
+		return Compare()( right, left ) ? right : left;
+	}
+};
+
+template<typename T, typename Compare = std::less<T>>
+struct SubtreeMax
+{
+	// The greatest mapped value of a subtree.
+	using value_type = T;
+
+	template<typename Key>
+	static value_type make( const Key&, const T& value ) { return value; }
+	static value_type combine( const value_type& left, const value_type& right )
+	{
+		return Compare()( left, right ) ? right : left;
+	}
+};
+
+template<typename Point>
+struct IntervalMaxEnd
+{
+	// Interval tree. Keys are half-open intervals [first, second) ordered by their starts,
+	// the aggregate is the greatest end in a subtree. It gives overlapping( interval ) of the map.
+	using value_type = Point;
+
+	template<typename T>
+	static value_type make( const std::pair<Point, Point>& interval, const T& ) { return interval.second; }
+	static value_type combine( const value_type& left, const value_type& right )
+	{
+		return ( left < right ) ? right : left;
+	}
+	static const Point& max_end( const value_type& aggregate ) { return aggregate; }
+};
+
+template<typename Augmentation>
+struct AugmentedNodeBase
+{
+	typename Augmentation::value_type aggregate{};
+};
+
+template<>
+struct AugmentedNodeBase<NoAugmentation>
+{
+};
+
+template<typename Augmentation, typename = void>
+struct HasSubtreeSize : std::false_type
+{
+	// true if the aggregate of Augmentation knows the number of nodes in the subtree
+};
+
+template<typename Augmentation>
+struct HasSubtreeSize<Augmentation, std::void_t<decltype(
+	Augmentation::size( std::declval<const typename Augmentation::value_type&>() ) )>> : std::true_type
+{
+};
+
+template<typename Augmentation, typename = void>
+struct HasMaxEnd : std::false_type
+{
+	// true if the aggregate of Augmentation knows the greatest interval end in the subtree
+};
+
+template<typename Augmentation>
+struct HasMaxEnd<Augmentation, std::void_t<decltype(
+	Augmentation::max_end( std::declval<const typename Augmentation::value_type&>() ) )>> : std::true_type
+{
+};
+
+} // namespace EK
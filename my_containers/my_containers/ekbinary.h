@@ -0,0 +1,448 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ekmappedfile.h"
+
+namespace EK
+{
+
+// Binary file of a map, in the byte order of the machine that wrote it:
+//   header    BinaryHeader, 64 bytes
+//   keys      'count' keys in ascending order, as they lie in memory
+//   offsets   count + 1 numbers of 8 bytes: value i lies in [offsets[i], offsets[i + 1]) of the blob
+//   blob      the values one after another, encoded by BinaryCodec
+// Sections start at multiples of 8. Keys must be trivially copyable, so lookups read them right from the file.
+
+template<typename T, typename = void>
+struct BinaryCodec
+{
+	// Encoding of values in binary files. It is defined for trivially copyable types and std::string,
+	// other types need a specialization with the same functions.
+};
+
+template<typename T>
+struct BinaryCodec<T, std::enable_if_t<std::is_trivially_copyable_v<T>>>
+{
+	static std::size_t size( const T& )
+	{
+		return sizeof( T );
+	}
+	static void write( std::ostream& out, const T& value )
+	{
+		out.write( reinterpret_cast<const char *>( &value ), sizeof( T ) );
+	}
+	static T read( const char * data, std::size_t )
+	{
+		T value;
+		std::memcpy( &value, data, sizeof( T ) );
+		return value;
+	}
+};
+
+template<>
+struct BinaryCodec<std::string>
+{
+	static std::size_t size( const std::string& value )
+	{
+		return value.size();
+	}
+	static void write( std::ostream& out, const std::string& value )
+	{
+		out.write( value.data(), static_cast<std::streamsize>( value.size() ) );
+	}
+	static std::string read( const char * data, std::size_t size )
+	{
+		return std::string( data, size );
+	}
+};
+
+struct BinaryHeader
+{
+	char magic[8] = { 'E', 'K', 'M', 'A', 'P', 'B', 'I', 'N' };
+	std::uint32_t version = 1;
+	std::uint32_t byte_order = 0x01020304;
+	std::uint32_t key_size = 0;
+	std::uint32_t reserved = 0;
+	std::uint64_t count = 0;
+	std::uint64_t keys_offset = 0;
+	std::uint64_t offsets_offset = 0;
+	std::uint64_t blob_offset = 0;
+	std::uint64_t reserved_2 = 0;
+
+	// Makes the header of a file with 'count' keys of 'key_size' bytes.
+	static BinaryHeader make( std::uint64_t count, std::uint32_t key_size );
+	// Throws std::runtime_error if the file can't be read with these keys.
+	void check( std::size_t file_size, std::uint32_t expected_key_size ) const;
+	static std::uint64_t align( std::uint64_t offset );
+};
+
+static_assert( sizeof( BinaryHeader ) == 64, "BinaryHeader has padding" );
+
+// Streaming writer: the map is walked in key order three times (keys, offsets and values)
+// and nothing but the output buffer is held in memory. Works with any map with ordered iteration.
+// Throws std::runtime_error if the output fails.
+template<typename MapType>
+void write_binary( std::ostream& out, const MapType& map );
+template<typename MapType>
+void write_binary( const std::string& path, const MapType& map );
+
+template<typename Key, typename T, typename Compare = std::less<Key>>
+class MappedMap
+{
+	// Read-only map served right from a memory-mapped file written by write_binary(). Opening takes O(1),
+	// lookups are binary searches over the keys in the file and values are decoded when they are read.
+	// The file must not change while it is open.
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using key_compare = Compare;
+	using size_type = std::size_t;
+	using value_type = std::pair<Key, T>;
+
+	class LazyValue
+	{
+		// Encoded value in the file, decoded by a conversion to T.
+		friend class MappedMap;
+	public:
+		operator T() const;
+		T get() const;
+	private:
+		const char * data_ = nullptr;
+		std::size_t size_ = 0;
+		LazyValue( const char * data, std::size_t size );
+	};
+
+	using Entry = std::pair<Key, LazyValue>;
+
+	class CIterator
+	{
+		// Goes in key order and gives entries with lazy values, so a map built from [begin(), end())
+		// decodes every value once, right into its node.
+		friend class MappedMap;
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = MappedMap::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = Entry;
+
+		CIterator() = default;
+		CIterator& operator++();
+		CIterator operator++( int );
+		bool operator==( CIterator other ) const;
+		bool operator!=( CIterator other ) const;
+		reference operator*() const;
+	private:
+		const MappedMap * map_ = nullptr;
+		std::size_t index_ = 0;
+		CIterator( const MappedMap * map, std::size_t index );
+	};
+
+	explicit MappedMap( const std::string& path, const Compare& compare = Compare() );
+
+	CIterator begin() const;
+	CIterator end() const;
+	CIterator find( const Key& key ) const;
+	std::size_t count( const Key& key ) const;
+	bool contains( const Key& key ) const;
+	T at( const Key& key ) const;
+	std::size_t size() const;
+	bool empty() const;
+	key_compare key_comp() const;
+
+private:
+	static_assert( std::is_trivially_copyable_v<Key>, "keys of binary maps must be trivially copyable" );
+
+	MappedFile file_;
+	const Key * keys_ = nullptr;
+	const std::uint64_t * offsets_ = nullptr;
+	const char * blob_ = nullptr;
+	std::size_t count_ = 0;
+	Compare compare_;
+
+	std::size_t find_index_( const Key& key ) const; // count_ if the key is absent
+	LazyValue value_at_( std::size_t index ) const;
+};
+
+// Loads a map from a file written by write_binary(): the file is mapped and the tree is built
+// from the sorted keys in O(n), without a search or rebalancing per entry.
+template<typename MapType>
+MapType load_binary( const std::string& path );
+
+inline BinaryHeader BinaryHeader::make( std::uint64_t count, std::uint32_t key_size )
+{
+	BinaryHeader header;
+	header.key_size = key_size;
+	header.count = count;
+	header.keys_offset = sizeof( BinaryHeader );
+	header.offsets_offset = align( header.keys_offset + count * key_size );
+	header.blob_offset = header.offsets_offset + ( count + 1 ) * sizeof( std::uint64_t );
+	return header;
+}
+
+inline void BinaryHeader::check( std::size_t file_size, std::uint32_t expected_key_size ) const
+{
+	BinaryHeader expected;
+	if ( file_size < sizeof( BinaryHeader ) || std::memcmp( magic, expected.magic, sizeof( magic ) ) != 0 ||
+		 version != expected.version )
+	{
+		throw std::runtime_error( "The file is not a binary map." );
+	}
+	if ( byte_order != expected.byte_order || key_size != expected_key_size )
+	{
+		throw std::runtime_error( "The binary map was written with another byte order or key type." );
+	}
+	auto layout = make( count, key_size );
+	if ( count > file_size || keys_offset != layout.keys_offset || offsets_offset != layout.offsets_offset ||
+		 blob_offset != layout.blob_offset || blob_offset > file_size )
+	{
+		throw std::runtime_error( "The binary map is damaged." );
+	}
+}
+
+inline std::uint64_t BinaryHeader::align( std::uint64_t offset )
+{
+	return ( offset + 7 ) & ~std::uint64_t( 7 );
+}
+
+template<typename MapType>
+void write_binary( std::ostream& out, const MapType& map )
+{
+	using Key = typename MapType::key_type;
+	using Codec = BinaryCodec<typename MapType::mapped_type>;
+	static_assert( std::is_trivially_copyable_v<Key>, "keys of binary maps must be trivially copyable" );
+
+	auto header = BinaryHeader::make( map.size(), sizeof( Key ) );
+	out.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+
+	// keys and offsets are small, they go to the stream in chunks instead of one call per element
+	std::vector<char> chunk;
+	chunk.reserve( 1 << 16 );
+	auto put = [&]( const void * data, std::size_t size )
+	{
+		if ( chunk.size() + size > chunk.capacity() )
+		{
+			out.write( chunk.data(), static_cast<std::streamsize>( chunk.size() ) );
+			chunk.clear();
+		}
+		auto bytes = static_cast<const char *>( data );
+		chunk.insert( chunk.end(), bytes, bytes + size );
+	};
+
+	for ( auto iter = map.begin(); iter != map.end(); ++iter )
+	{
+		put( &iter->first, sizeof( Key ) );
+	}
+	const char padding[8] = {};
+	put( padding, static_cast<std::size_t>( header.offsets_offset - header.keys_offset - header.count * sizeof( Key ) ) );
+
+	std::uint64_t offset = 0;
+	put( &offset, sizeof( offset ) );
+	for ( auto iter = map.begin(); iter != map.end(); ++iter )
+	{
+		offset += Codec::size( iter->second );
+		put( &offset, sizeof( offset ) );
+	}
+	out.write( chunk.data(), static_cast<std::streamsize>( chunk.size() ) );
+
+	for ( auto iter = map.begin(); iter != map.end(); ++iter )
+	{
+		Codec::write( out, iter->second );
+	}
+	if ( !out )
+	{
+		throw std::runtime_error( "Cannot write the binary map." );
+	}
+}
+
+template<typename MapType>
+void write_binary( const std::string& path, const MapType& map )
+{
+	std::ofstream out( path, std::ios::binary | std::ios::trunc );
+	if ( !out )
+	{
+		throw std::runtime_error( "Cannot open " + path + "." );
+	}
+	write_binary( out, map );
+	out.close();
+	if ( !out )
+	{
+		throw std::runtime_error( "Cannot write " + path + "." );
+	}
+}
+
+template<typename Key, typename T, typename Compare>
+MappedMap<Key, T, Compare>::LazyValue::LazyValue( const char * data, std::size_t size ) : data_( data ), size_( size )
+{
+}
+
+template<typename Key, typename T, typename Compare>
+MappedMap<Key, T, Compare>::LazyValue::operator T() const
+{
+	return get();
+}
+
+template<typename Key, typename T, typename Compare>
+T MappedMap<Key, T, Compare>::LazyValue::get() const
+{
+	return BinaryCodec<T>::read( data_, size_ );
+}
+
+template<typename Key, typename T, typename Compare>
+MappedMap<Key, T, Compare>::CIterator::CIterator( const MappedMap * map, std::size_t index ) : map_( map ), index_( index )
+{
+}
+
+template<typename Key, typename T, typename Compare>
+auto MappedMap<Key, T, Compare>::CIterator::operator++() -> CIterator&
+{
+	++index_;
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare>
+auto MappedMap<Key, T, Compare>::CIterator::operator++( int ) -> CIterator
+{
+	auto result = *this;
+	++( *this );
+	return result;
+}
+
+template<typename Key, typename T, typename Compare>
+bool MappedMap<Key, T, Compare>::CIterator::operator==( CIterator other ) const
+{
+	return index_ == other.index_;
+}
+
+template<typename Key, typename T, typename Compare>
+bool MappedMap<Key, T, Compare>::CIterator::operator!=( CIterator other ) const
+{
+	return index_ != other.index_;
+}
+
+template<typename Key, typename T, typename Compare>
+auto MappedMap<Key, T, Compare>::CIterator::operator*() const -> reference
+{
+	if ( map_ == nullptr || index_ >= map_->count_ )
+	{
+		throw std::out_of_range( "Iterator is out of range." );
+	}
+	return Entry( map_->keys_[index_], map_->value_at_( index_ ) );
+}
+
+template<typename Key, typename T, typename Compare>
+MappedMap<Key, T, Compare>::MappedMap( const std::string& path, const Compare& compare )
+	: file_( path ), compare_( compare )
+{
+	BinaryHeader header;
+	if ( file_.size() >= sizeof( header ) )
+	{
+		std::memcpy( &header, file_.data(), sizeof( header ) );
+	}
+	header.check( file_.size(), sizeof( Key ) );
+
+	count_ = static_cast<std::size_t>( header.count );
+	keys_ = reinterpret_cast<const Key *>( file_.data() + header.keys_offset );
+	offsets_ = reinterpret_cast<const std::uint64_t *>( file_.data() + header.offsets_offset );
+	blob_ = file_.data() + header.blob_offset;
+	if ( header.blob_offset + offsets_[count_] > file_.size() )
+	{
+		throw std::runtime_error( "The binary map is damaged." );
+	}
+}
+
+template<typename Key, typename T, typename Compare>
+auto MappedMap<Key, T, Compare>::begin() const -> CIterator
+{
+	return CIterator( this, 0 );
+}
+
+template<typename Key, typename T, typename Compare>
+auto MappedMap<Key, T, Compare>::end() const -> CIterator
+{
+	return CIterator( this, count_ );
+}
+
+template<typename Key, typename T, typename Compare>
+auto MappedMap<Key, T, Compare>::find( const Key& key ) const -> CIterator
+{
+	return CIterator( this, find_index_( key ) );
+}
+
+template<typename Key, typename T, typename Compare>
+std::size_t MappedMap<Key, T, Compare>::count( const Key& key ) const
+{
+	return contains( key ) ? 1 : 0;
+}
+
+template<typename Key, typename T, typename Compare>
+bool MappedMap<Key, T, Compare>::contains( const Key& key ) const
+{
+	return find_index_( key ) != count_;
+}
+
+template<typename Key, typename T, typename Compare>
+T MappedMap<Key, T, Compare>::at( const Key& key ) const
+{
+	auto index = find_index_( key );
+	if ( index == count_ )
+	{
+		throw std::out_of_range( "Key is absent." );
+	}
+	return value_at_( index ).get();
+}
+
+template<typename Key, typename T, typename Compare>
+std::size_t MappedMap<Key, T, Compare>::size() const
+{
+	return count_;
+}
+
+template<typename Key, typename T, typename Compare>
+bool MappedMap<Key, T, Compare>::empty() const
+{
+	return count_ == 0;
+}
+
+template<typename Key, typename T, typename Compare>
+Compare MappedMap<Key, T, Compare>::key_comp() const
+{
+	return compare_;
+}
+
+template<typename Key, typename T, typename Compare>
+std::size_t MappedMap<Key, T, Compare>::find_index_( const Key& key ) const
+{
+	auto iter = std::lower_bound( keys_, keys_ + count_, key, compare_ );
+	if ( iter == keys_ + count_ || compare_( key, *iter ) )
+	{
+		return count_;
+	}
+	return static_cast<std::size_t>( iter - keys_ );
+}
+
+template<typename Key, typename T, typename Compare>
+auto MappedMap<Key, T, Compare>::value_at_( std::size_t index ) const -> LazyValue
+{
+	return LazyValue( blob_ + offsets_[index], static_cast<std::size_t>( offsets_[index + 1] - offsets_[index] ) );
+}
+
+template<typename MapType>
+MapType load_binary( const std::string& path )
+{
+	MappedMap<typename MapType::key_type, typename MapType::mapped_type, typename MapType::key_compare> mapped( path );
+	return MapType( mapped.begin(), mapped.end() );
+}
+
+} // namespace EK
@@ -0,0 +1,225 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "ekmap.h"
+
+namespace EK
+{
+
+class ReadIndicator
+{
+	// Counts readers inside a read section. Readers of different threads mostly use different
+	// cache lines, so they don't contend with each other.
+public:
+	void arrive();
+	void depart();
+	bool is_empty() const;
+
+private:
+	struct alignas( 64 ) Slot
+	{
+		std::atomic<std::size_t> readers{ 0 };
+	};
+
+	static constexpr std::size_t slot_count_ = 64;
+
+	std::array<Slot, slot_count_> slots_;
+
+	static std::size_t s_slot_index_();
+};
+
+inline void ReadIndicator::arrive()
+{
+	slots_[s_slot_index_()].readers.fetch_add( 1 );
+}
+
+inline void ReadIndicator::depart()
+{
+	slots_[s_slot_index_()].readers.fetch_sub( 1 );
+}
+
+inline bool ReadIndicator::is_empty() const
+{
+	for ( auto& slot : slots_ )
+	{
+		if ( slot.readers.load() != 0 )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+inline std::size_t ReadIndicator::s_slot_index_()
+{
+	thread_local const std::size_t index = std::hash<std::thread::id>()( std::this_thread::get_id() ) % slot_count_;
+	return index;
+}
+
+template<typename Key = int, typename T = std::string, typename Compare = std::less<Key>,
+		 typename Allocator = std::allocator<std::pair<const Key, T>>>
+class ConcurrentMap
+{
+	// Map shared by many threads: readers never take a lock and are never blocked by writers,
+	// writers are serialized by a mutex.
+	// It is the Left-Right technique: there are two copies of the map. Readers use the one
+	// that 'left_right_' points to, a writer changes the other copy, switches readers to it,
+	// waits until the readers of the old copy are gone (like an RCU grace period) and repeats
+	// the change there. Every change is applied twice, so it must give the same result both times.
+public:
+	using map_type = Map<Key, T, Compare, Allocator>;
+
+	ConcurrentMap() = default;
+	explicit ConcurrentMap( const map_type& map );
+	ConcurrentMap( const ConcurrentMap& ) = delete;
+	ConcurrentMap& operator=( const ConcurrentMap& ) = delete;
+
+	// Runs f( const map_type& ) inside a read section and returns its result. References to the map
+	// must not escape f. Iteration over the map is done this way.
+	template<typename F>
+	auto read( F&& f ) const;
+	// Runs f( map_type& ) on both copies under the writer lock.
+	template<typename F>
+	void write( F&& f );
+
+	// Readers copy values out, as the element may be erased right after the read section.
+	std::optional<T> find( const Key& key ) const;
+	T at( const Key& key ) const;
+	bool contains( const Key& key ) const;
+	std::size_t size() const;
+	map_type snapshot() const;
+
+	void insert( const Key& key, const T& value );
+	bool erase( const Key& key );
+	void clear();
+
+private:
+	std::array<map_type, 2> maps_;
+	mutable std::array<ReadIndicator, 2> read_indicators_;
+	std::atomic<unsigned> left_right_{ 0 }; // the copy for readers
+	std::atomic<unsigned> version_index_{ 0 }; // the read indicator for new readers
+	std::mutex writer_mutex_;
+
+	void toggle_version_and_wait_();
+};
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+ConcurrentMap<Key, T, Compare, Allocator>::ConcurrentMap( const map_type& map ) : maps_{ map, map }
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+template<typename F>
+auto ConcurrentMap<Key, T, Compare, Allocator>::read( F&& f ) const
+{
+	struct Departure
+	{
+		// leaves the read section on exceptions too
+		ReadIndicator& indicator;
+		~Departure() { indicator.depart(); }
+	};
+
+	auto& indicator = read_indicators_[version_index_.load()];
+	indicator.arrive();
+	Departure departure{ indicator };
+	return std::forward<F>( f )( static_cast<const map_type&>( maps_[left_right_.load()] ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+template<typename F>
+void ConcurrentMap<Key, T, Compare, Allocator>::write( F&& f )
+{
+	std::lock_guard<std::mutex> lock( writer_mutex_ );
+	auto current = left_right_.load( std::memory_order_relaxed );
+	f( maps_[1 - current] );
+	left_right_.store( 1 - current );
+	toggle_version_and_wait_();
+	f( maps_[current] );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::optional<T> ConcurrentMap<Key, T, Compare, Allocator>::find( const Key& key ) const
+{
+	return read( [&key]( const map_type& map ) -> std::optional<T> {
+		auto iter = map.find( key );
+		if ( iter == map.end() )
+		{
+			return std::nullopt;
+		}
+		return iter->second;
+	} );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+T ConcurrentMap<Key, T, Compare, Allocator>::at( const Key& key ) const
+{
+	return read( [&key]( const map_type& map ) -> T { return map.at( key ); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool ConcurrentMap<Key, T, Compare, Allocator>::contains( const Key& key ) const
+{
+	return read( [&key]( const map_type& map ) { return map.contains( key ); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::size_t ConcurrentMap<Key, T, Compare, Allocator>::size() const
+{
+	return read( []( const map_type& map ) { return map.size(); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto ConcurrentMap<Key, T, Compare, Allocator>::snapshot() const -> map_type
+{
+	return read( []( const map_type& map ) { return map; } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ConcurrentMap<Key, T, Compare, Allocator>::insert( const Key& key, const T& value )
+{
+	write( [&key, &value]( map_type& map ) { map.insert( key, value ); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool ConcurrentMap<Key, T, Compare, Allocator>::erase( const Key& key )
+{
+	bool erased = false;
+	write( [&key, &erased]( map_type& map ) {
+		erased = map.contains( key );
+		map.erase( key );
+	} );
+	return erased;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ConcurrentMap<Key, T, Compare, Allocator>::clear()
+{
+	write( []( map_type& map ) { map.clear(); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ConcurrentMap<Key, T, Compare, Allocator>::toggle_version_and_wait_()
+{
+	// Readers that came before the switch of left_right_ may still use the old copy.
+	// New readers arrive at the other indicator, so both indicators get empty in a finite time.
+	auto previous = version_index_.load();
+	auto next = 1 - previous;
+	while ( !read_indicators_[next].is_empty() )
+	{
+		std::this_thread::yield();
+	}
+	version_index_.store( next );
+	while ( !read_indicators_[previous].is_empty() )
+	{
+		std::this_thread::yield();
+	}
+}
+
+} // namespace EK
@@ -0,0 +1,302 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ekprefetch.h"
+
+namespace EK
+{
+
+template<typename Key = int, typename T = std::string, typename Compare = std::less<Key>>
+class FrozenMap
+{
+	// Read-only map in one contiguous array, made by Map::freeze().
+	// Elements are stored in Eytzinger order (the breadth-first order of a complete binary search tree,
+	// children of position k are 2k and 2k+1), so a lookup walks the array from the start and the next
+	// levels of a descent can be prefetched. Keys have an array of their own: a lookup reads only keys
+	// until it has found the element.
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using key_compare = Compare;
+	using size_type = std::size_t;
+	using value_type = std::pair<const Key, T>;
+
+	class CIterator
+	{
+		// Goes in key order, which jumps over the array.
+		friend class FrozenMap;
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = FrozenMap::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type *;
+		using reference = const value_type&;
+
+		CIterator& operator++();
+		CIterator operator++( int );
+		bool operator==( CIterator other ) const;
+		bool operator!=( CIterator other ) const;
+		reference operator*() const;
+		pointer operator->() const;
+	private:
+		const FrozenMap * map_ = nullptr;
+		std::size_t position_ = 0; // 0 is the end
+		CIterator( const FrozenMap * map, std::size_t position );
+	};
+
+	FrozenMap() = default;
+	// [first, last) must be sorted by 'compare' without duplicates, as iteration over EK::Map is.
+	template<typename ForwardIt>
+	FrozenMap( ForwardIt first, ForwardIt last, const Compare& compare = Compare() );
+
+	CIterator begin() const;
+	CIterator end() const;
+	CIterator find( const Key& key ) const;
+	std::size_t count( const Key& key ) const;
+	bool contains( const Key& key ) const;
+	const T& at( const Key& key ) const;
+	std::size_t size() const;
+	bool empty() const;
+	key_compare key_comp() const;
+
+private:
+	// Both arrays have an unused element at index 0, so positions start from 1.
+	std::vector<Key> keys_;
+	std::vector<value_type> values_;
+	Compare compare_;
+
+	std::size_t find_position_( const Key& key ) const;
+	std::size_t first_position_() const;
+	std::size_t next_position_( std::size_t position ) const;
+	void fill_order_( std::size_t position, std::size_t& rank, std::vector<std::size_t>& ranks ) const;
+};
+
+template<typename Key, typename T, typename Compare>
+FrozenMap<Key, T, Compare>::CIterator::CIterator( const FrozenMap * map, std::size_t position )
+	: map_( map ), position_( position )
+{
+}
+
+template<typename Key, typename T, typename Compare>
+auto FrozenMap<Key, T, Compare>::CIterator::operator++() -> CIterator&
+{
+	position_ = map_->next_position_( position_ );
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare>
+auto FrozenMap<Key, T, Compare>::CIterator::operator++( int ) -> CIterator
+{
+	auto result = *this;
+	++( *this );
+	return result;
+}
+
+template<typename Key, typename T, typename Compare>
+bool FrozenMap<Key, T, Compare>::CIterator::operator==( CIterator other ) const
+{
+	return position_ == other.position_;
+}
+
+template<typename Key, typename T, typename Compare>
+bool FrozenMap<Key, T, Compare>::CIterator::operator!=( CIterator other ) const
+{
+	return position_ != other.position_;
+}
+
+template<typename Key, typename T, typename Compare>
+auto FrozenMap<Key, T, Compare>::CIterator::operator*() const -> reference
+{
+	if ( position_ == 0 )
+	{
+		throw std::out_of_range( "Iterator is out of range." );
+	}
+	return map_->values_[position_];
+}
+
+template<typename Key, typename T, typename Compare>
+auto FrozenMap<Key, T, Compare>::CIterator::operator->() const -> pointer
+{
+	return &**this;
+}
+
+template<typename Key, typename T, typename Compare>
+template<typename ForwardIt>
+FrozenMap<Key, T, Compare>::FrozenMap( ForwardIt first, ForwardIt last, const Compare& compare ) : compare_( compare )
+{
+	// O(n): ranks of Eytzinger positions come from an in-order walk over the implicit tree,
+	// then the elements are copied position by position.
+	std::vector<const std::remove_reference_t<decltype( *first )> *> sorted;
+	for ( ; first != last; ++first )
+	{
+		sorted.push_back( &*first );
+	}
+	auto n = sorted.size();
+	if ( n == 0 )
+	{
+		return;
+	}
+
+	std::vector<std::size_t> ranks( n + 1 );
+	std::size_t rank = 0;
+	fill_order_( 1, rank, ranks );
+
+	keys_.reserve( n + 1 );
+	values_.reserve( n + 1 );
+	keys_.push_back( sorted[0]->first ); // the unused element
+	values_.emplace_back( sorted[0]->first, sorted[0]->second );
+	for ( std::size_t position = 1; position <= n; ++position )
+	{
+		auto& pair = *sorted[ranks[position]];
+		keys_.push_back( pair.first );
+		values_.emplace_back( pair.first, pair.second );
+	}
+}
+
+template<typename Key, typename T, typename Compare>
+auto FrozenMap<Key, T, Compare>::begin() const -> CIterator
+{
+	return CIterator( this, first_position_() );
+}
+
+template<typename Key, typename T, typename Compare>
+auto FrozenMap<Key, T, Compare>::end() const -> CIterator
+{
+	return CIterator( this, 0 );
+}
+
+template<typename Key, typename T, typename Compare>
+auto FrozenMap<Key, T, Compare>::find( const Key& key ) const -> CIterator
+{
+	return CIterator( this, find_position_( key ) );
+}
+
+template<typename Key, typename T, typename Compare>
+std::size_t FrozenMap<Key, T, Compare>::count( const Key& key ) const
+{
+	return ( find_position_( key ) != 0 ) ? 1 : 0;
+}
+
+template<typename Key, typename T, typename Compare>
+bool FrozenMap<Key, T, Compare>::contains( const Key& key ) const
+{
+	return find_position_( key ) != 0;
+}
+
+template<typename Key, typename T, typename Compare>
+const T& FrozenMap<Key, T, Compare>::at( const Key& key ) const
+{
+	auto position = find_position_( key );
+	if ( position == 0 )
+	{
+		throw std::out_of_range( "Key is absent." );
+	}
+	return values_[position].second;
+}
+
+template<typename Key, typename T, typename Compare>
+std::size_t FrozenMap<Key, T, Compare>::size() const
+{
+	return keys_.empty() ? 0 : keys_.size() - 1;
+}
+
+template<typename Key, typename T, typename Compare>
+bool FrozenMap<Key, T, Compare>::empty() const
+{
+	return keys_.empty();
+}
+
+template<typename Key, typename T, typename Compare>
+Compare FrozenMap<Key, T, Compare>::key_comp() const
+{
+	return compare_;
+}
+
+template<typename Key, typename T, typename Compare>
+std::size_t FrozenMap<Key, T, Compare>::find_position_( const Key& key ) const
+{
+	// Branchless descent to the first key that is not less than 'key'. 16 positions down from k
+	// (four levels) start at 16k, a fetch of them overlaps with the comparisons of the next levels.
+	auto n = size();
+	auto keys = keys_.data();
+	std::size_t position = 1;
+	while ( position <= n )
+	{
+		if ( 16 * position <= n )
+		{
+			prefetch( keys + 16 * position );
+		}
+		position = 2 * position + ( compare_( keys[position], key ) ? 1 : 0 );
+	}
+	// The path went right from the found position and then only left:
+	// remove the trailing right turns and the last left one.
+	while ( position & 1 )
+	{
+		position >>= 1;
+	}
+	position >>= 1;
+	if ( position == 0 || compare_( key, keys[position] ) )
+	{
+		return 0;
+	}
+	return position;
+}
+
+template<typename Key, typename T, typename Compare>
+std::size_t FrozenMap<Key, T, Compare>::first_position_() const
+{
+	auto n = size();
+	if ( n == 0 )
+	{
+		return 0;
+	}
+	std::size_t position = 1;
+	while ( 2 * position <= n )
+	{
+		position *= 2;
+	}
+	return position;
+}
+
+template<typename Key, typename T, typename Compare>
+std::size_t FrozenMap<Key, T, Compare>::next_position_( std::size_t position ) const
+{
+	// in-order successor in the implicit tree
+	auto n = size();
+	if ( 2 * position + 1 <= n )
+	{
+		position = 2 * position + 1;
+		while ( 2 * position <= n )
+		{
+			position *= 2;
+		}
+		return position;
+	}
+	while ( position & 1 )
+	{
+		position >>= 1;
+	}
+	return position >> 1;
+}
+
+template<typename Key, typename T, typename Compare>
+void FrozenMap<Key, T, Compare>::fill_order_( std::size_t position, std::size_t& rank,
+	std::vector<std::size_t>& ranks ) const
+{
+	// the recursion depth is log2(n)
+	if ( position >= ranks.size() )
+	{
+		return;
+	}
+	fill_order_( 2 * position, rank, ranks );
+	ranks[position] = rank++;
+	fill_order_( 2 * position + 1, rank, ranks );
+}
+
+} // namespace EK
@@ -1,28 +1,184 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <memory>
+#include "ekaugment.h"
+#include "ekfrozenmap.h"
+#include "ekpool.h"
+#include "ekprefetch.h"
+#include "ekstatistics.h"
+#include "ekthreadpool.h"
 
 namespace EK
 {
 
+template<typename Value, typename = void>
+struct IsStreamable : std::false_type
+{
+	// true if Value can be written to std::ostream, debug output needs it
+};
+
+template<typename Value>
+struct IsStreamable<Value, std::void_t<decltype( std::declval<std::ostream&>() << std::declval<const Value&>() )>>
+	: std::true_type
+{
+};
+
+template<typename It>
+class IteratorRange
+#if defined( __cpp_lib_ranges )
+	: public std::ranges::view_base
+#endif
+{
+	// Elements between two iterators for range-based for and, since C++20, for std::ranges algorithms
+	// and views. Nothing is copied: the elements are visited as the iteration goes.
+public:
+	IteratorRange() = default;
+	IteratorRange( It first, It last );
+
+	It begin() const;
+	It end() const;
+	bool empty() const;
+
+private:
+	It first_{};
+	It last_{};
+};
+
+template<typename It>
+IteratorRange<It>::IteratorRange( It first, It last ) : first_( first ), last_( last )
+{
+}
+
+template<typename It>
+It IteratorRange<It>::begin() const
+{
+	return first_;
+}
+
+template<typename It>
+It IteratorRange<It>::end() const
+{
+	return last_;
+}
+
+template<typename It>
+bool IteratorRange<It>::empty() const
+{
+	return first_ == last_;
+}
+
+template<typename Node, bool Threaded, typename Base>
+struct ThreadedNodeBase : Base
+{
+	// Links of a threaded map: the nodes also make a doubly linked list in key order.
+	Node * prev = nullptr;
+	Node * next = nullptr;
+};
+
+template<typename Node, typename Base>
+struct ThreadedNodeBase<Node, false, Base> : Base
+{
+};
+
+// Kinds of broken invariants found by Map::validate().
+enum class ViolationKind
+{
+	red_root, // property 2
+	red_red, // property 4: a red node has a red parent
+	black_height, // property 5: a path to a leaf has another number of black nodes than the first one
+	order, // the key is not between the keys of its neighbours in key order
+	parent_link, // the parent pointer doesn't point to the node that has this one as a child
+	size, // the number of nodes differs from size()
+	aggregate, // the aggregate is not up to date
+	threads, // the prev/next links of a threaded map don't follow the key order
+	cached_maximum // the cached maximum is not the last node
+};
+
+// With Threaded = true the nodes are linked in key order besides the tree, so iterators step in O(1)
+// in the worst case instead of O(1) amortized: no climbs of O(log n) over parent links, no data dependent
+// branches. It costs two pointers per node and a few stores per insertion and erasure. join() and the set
+// operations also find the ends of the joined trees, which adds O(log n) to every join of trees inside.
+template<typename Key = int, typename T = std::string, typename Compare = std::less<Key>,
+		 typename Allocator = std::allocator<std::pair<const Key, T>>, typename Augmentation = NoAugmentation,
+		 bool Threaded = false>
 class Map
 {
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using key_compare = Compare;
+	using allocator_type = Allocator;
+	using size_type = std::size_t;
+	using value_type = std::pair<const Key, T>;
+	using reference = value_type&;
+	using const_reference = const value_type&;
+
 private:
-	struct Node;
+	struct Node : ThreadedNodeBase<Node, Threaded, AugmentedNodeBase<Augmentation>>
+	{
+		// Nodes are allocated by pool_ of the owning map (or of a map they were extracted from).
+		// What a lookup reads comes first: the child links, then the key. The color is kept in the lowest bit
+		// of the parent link (nodes are aligned at least to 2), so a node has no padding for a bool:
+		// 32 bytes for 8-byte keys and values instead of 40.
+		Node * left = nullptr;
+		Node * right = nullptr;
+		std::uintptr_t parent_and_color = 0;
+		value_type data; // iterators give references right into it
+
+		template<typename... Args>
+		Node( Node * parent, Node * left, Node * right, bool is_black, Args&&... args )
+			: left( left ), right( right ),
+			parent_and_color( reinterpret_cast<std::uintptr_t>( parent ) | ( is_black ? black_bit : 0 ) ),
+			data( std::forward<Args>( args )... ) {}
+
+		static constexpr std::uintptr_t black_bit = 1;
+
+		Node * parent() const { return reinterpret_cast<Node *>( parent_and_color & ~black_bit ); }
+		void set_parent( Node * parent )
+		{
+			parent_and_color = reinterpret_cast<std::uintptr_t>( parent ) | ( parent_and_color & black_bit );
+		}
+		bool is_black() const { return ( parent_and_color & black_bit ) != 0; }
+		void set_black( bool is_black ) { parent_and_color = ( parent_and_color & ~black_bit ) | ( is_black ? black_bit : 0 ); }
+		bool is_red() const { return !is_black(); }
+		const Key& key() const { return data.first; }
+		T& value() { return data.second; }
+		const T& value() const { return data.second; }
+	};
+
+	using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+	using NodePool = Pool<Node, NodeAllocator>;
+	using DetachedNode = typename NodePool::Detached;
 
 	class InternIter
 	{
 		// Internal interator provides access to nodes directly.
 		// It's required for a few private methods. As well it is a basis for external iterators.
 	public:
+		InternIter() = default;
 		explicit InternIter( Node * );
 		InternIter& operator++();
 		InternIter& operator--();
 		bool operator==( InternIter ) const;
 		bool operator!=( InternIter ) const;
-		Map::Node& operator*();
-		Map::Node * operator->();
+		Map::Node& operator*() const;
+		Map::Node * operator->() const;
+		Map::Node * get() const;
 	private:
 		Node * node_ = nullptr;
 	};
@@ -30,13 +186,15 @@ private:
 	class CInternIter
 	{
 	public:
+		CInternIter() = default;
 		explicit CInternIter( Node * );
 		CInternIter& operator++();
 		CInternIter& operator--();
 		bool operator==( CInternIter ) const;
 		bool operator!=( CInternIter ) const;
-		Map::Node& operator*();
-		Map::Node * operator->();
+		Map::Node& operator*() const;
+		Map::Node * operator->() const;
+		Map::Node * get() const;
 	private:
 		Node * node_ = nullptr;
 	};
@@ -45,13 +203,23 @@ public:
 	class Iterator
 	{
 		friend class Map;
+		friend class CIterator;
 	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = Map::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = value_type *;
+		using reference = value_type&;
+
+		Iterator() = default;
 		Iterator& operator++();
 		Iterator& operator--();
+		Iterator operator++( int );
+		Iterator operator--( int );
 		bool operator==( Iterator other ) const;
 		bool operator!=( Iterator other ) const;
-		std::pair<int, std::string&> operator*();
-		std::unique_ptr<std::pair<int, std::string&>> operator->();
+		reference operator*() const;
+		pointer operator->() const;
 	private:
 		InternIter iter_;
 		explicit Iterator( InternIter intern_iter );
@@ -61,17 +229,68 @@ public:
 	{
 		friend class Map;
 	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = Map::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type *;
+		using reference = const value_type&;
+
+		CIterator() = default;
+		CIterator( Iterator iter );
 		CIterator& operator++();
 		CIterator& operator--();
+		CIterator operator++( int );
+		CIterator operator--( int );
 		bool operator==( CIterator other ) const;
 		bool operator!=( CIterator other ) const;
-		std::pair<int, const std::string&> operator*();
-		std::unique_ptr<std::pair<int, const std::string&>> operator->();
+		reference operator*() const;
+		pointer operator->() const;
 	private:
 		CInternIter iter_;
 		explicit CIterator( CInternIter iter );
 	};
 
+	class NodeHandle
+	{
+		// An element taken out of a map by extract(). It owns the node until the node is inserted into a map.
+		friend class Map;
+	public:
+		NodeHandle() = default;
+		bool empty() const;
+		explicit operator bool() const;
+		const Key& key() const;
+		T& mapped() const;
+	private:
+		DetachedNode node_;
+		explicit NodeHandle( DetachedNode&& node );
+	};
+
+	struct InsertReturn
+	{
+		Iterator position;
+		bool inserted = false;
+		NodeHandle node; // the given node if it was not inserted
+	};
+
+	struct Violation
+	{
+		ViolationKind kind;
+		CIterator position; // the node, end() for the whole tree
+	};
+
+	struct ValidationReport
+	{
+		std::size_t nodes_checked = 0;
+		unsigned black_height = 0; // black nodes on the first checked path from the root to a leaf
+		unsigned max_depth = 0; // levels of the checked part of the tree
+		std::vector<Violation> violations;
+
+		bool valid() const;
+	};
+
+	using node_type = NodeHandle;
+	using insert_return_type = InsertReturn;
+
 	Iterator begin();
 	Iterator end();
 	Iterator rbegin();
@@ -82,37 +301,248 @@ public:
 	CIterator rend() const;
 
 	Map();
-	Map( const std::vector<std::pair<int, std::string>>& );
-	Map( const std::initializer_list<std::pair<int, std::string>>& );
-	Map( Map& rhs );
+	explicit Map( const Compare& compare, const Allocator& alloc = Allocator() );
+	Map( const std::vector<std::pair<Key, T>>& );
+	Map( const std::initializer_list<std::pair<Key, T>>& );
+	template<typename InputIt>
+	Map( InputIt first, InputIt last, const Compare& compare = Compare(), const Allocator& alloc = Allocator() );
+	// Copies take O(n) without recursion and the nodes of a copy are allocated in one block.
+	// An assignment reuses the nodes of this map first. With a thread pool, subtrees of a big map
+	// are copied in parallel, each to a node pool of its own, and the pools are joined at the end.
+	Map( const Map& rhs );
+	Map( const Map& rhs, ThreadPool * pool );
 	Map& operator=( const Map& rhs );
+	void assign( const Map& rhs, ThreadPool * pool = nullptr );
 	Map( Map&& rhs ) noexcept; 
-	Map& operator=( Map&& rhs ) noexcept;
+	// As in std::map, the allocator goes with the nodes only if it propagates on move assignment;
+	// otherwise unequal allocators make the elements move one by one into nodes of our allocator.
+	Map& operator=( Map&& rhs ) noexcept( std::allocator_traits<NodeAllocator>::propagate_on_container_move_assignment::value
+		|| std::allocator_traits<NodeAllocator>::is_always_equal::value );
 	~Map();
 
-	std::size_t count( int key ) const;
-	std::string at( int key ) const;
+	void clear();
+
+	// Replaces the content with key-value pairs from [first, last).
+	// Sorted input without duplicates is built into a balanced tree in O(n); any other input is sorted first
+	// (on duplicate keys the last pair wins, as with repeated insert).
+	// With a thread pool, big input is sorted by a parallel merge sort and the subtrees of the tree are built
+	// by parallel tasks, each to a node pool of its own.
+	template<typename InputIt>
+	void assign_sorted( InputIt first, InputIt last, ThreadPool * pool = nullptr );
+
+	// Lookups with a transparent comparator (one that defines is_transparent, like std::less<>)
+	// accept any type comparable with Key, so no temporary key is constructed.
+	std::size_t count( const Key& key ) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	std::size_t count( const K& key ) const;
+	bool contains( const Key& key ) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	bool contains( const K& key ) const;
+	T& at( const Key& key );
+	const T& at( const Key& key ) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	T& at( const K& key );
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	const T& at( const K& key ) const;
+	T& operator[]( const Key& key );
+	T& operator[]( Key&& key );
 	std::size_t size() const;
 
-	void insert( int key, const std::string& value );
-	void insert( int key, std::string&& value );
-	void insert( const std::pair<int, std::string>& key_value_pair );
-	void insert( std::pair<int, std::string>&& key_value_pair );
-	void erase( int key );
+	// insert() overwrites the value of an existing key, like insert_or_assign().
+	void insert( const Key& key, const T& value );
+	void insert( const Key& key, T&& value );
+	void insert( const std::pair<Key, T>& key_value_pair );
+	void insert( std::pair<Key, T>&& key_value_pair );
+	// Hinted insertion: the search starts from 'hint' (see lower_bound_from()), which is best
+	// the element that will follow the new one, as for std::map, or one close to it.
+	// Appending with end() or with the result of the previous append takes O(1) comparisons.
+	Iterator insert( CIterator hint, const Key& key, const T& value );
+	Iterator insert( CIterator hint, const Key& key, T&& value );
+	template<typename M>
+	std::pair<Iterator, bool> insert_or_assign( const Key& key, M&& obj );
+	template<typename M>
+	std::pair<Iterator, bool> insert_or_assign( Key&& key, M&& obj );
+	template<typename... Args>
+	std::pair<Iterator, bool> try_emplace( const Key& key, Args&&... args );
+	template<typename... Args>
+	std::pair<Iterator, bool> try_emplace( Key&& key, Args&&... args );
+	template<typename... Args>
+	std::pair<Iterator, bool> emplace( Args&&... args );
+	template<typename... Args>
+	Iterator emplace_hint( CIterator hint, Args&&... args );
+	void erase( const Key& key );
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	void erase( const K& key );
+	// Erases [first, last) in O(k + log n), without a search for every key. Returns 'last'.
+	Iterator erase( CIterator first, CIterator last );
+
+	// Elements move between maps without copies and allocations: extract() takes the node out of the tree,
+	// insert() links it into another map. Nodes keep their addresses, so references to elements stay valid.
+	// Unlike the other insert() overloads, a node with a key that is already present is not inserted
+	// and comes back in InsertReturn::node. merge() moves the elements of 'other' with keys that are absent
+	// here, the rest stays in 'other'. The memory of moved nodes is shared by the pools of both maps (see Pool).
+	NodeHandle extract( CIterator pos );
+	NodeHandle extract( const Key& key );
+	InsertReturn insert( NodeHandle&& node );
+	void merge( Map& other );
+
+	// Batches of updates. In a big map the keys are first looked up by lanes as in find_batch(), so the cache
+	// misses of the descents overlap, then the updates are made one by one over paths already in the cache.
+	// insert_batch() takes pairs and overwrites values like insert(), erase_batch() takes keys
+	// and returns the number of erased elements. Any order of keys works, duplicates included.
+	template<typename ForwardIt>
+	void insert_batch( ForwardIt first, ForwardIt last );
+	template<typename ForwardIt>
+	std::size_t erase_batch( ForwardIt first, ForwardIt last );
+
+	Iterator find( const Key& key );
+	CIterator find( const Key& key ) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	Iterator find( const K& key );
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	CIterator find( const K& key ) const;
 
-	Iterator find( int key );
-	CIterator find( int key ) const;
+	// Ordered queries in O(log n). range() is a view of the elements with keys in [lo, hi), which is
+	// found in O(log n) and then walked element by element; it is empty if hi < lo.
+	Iterator lower_bound( const Key& key );
+	CIterator lower_bound( const Key& key ) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	Iterator lower_bound( const K& key );
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	CIterator lower_bound( const K& key ) const;
+	Iterator upper_bound( const Key& key );
+	CIterator upper_bound( const Key& key ) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	Iterator upper_bound( const K& key );
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	CIterator upper_bound( const K& key ) const;
+	std::pair<Iterator, Iterator> equal_range( const Key& key );
+	std::pair<CIterator, CIterator> equal_range( const Key& key ) const;
+	IteratorRange<Iterator> range( const Key& lo, const Key& hi );
+	IteratorRange<CIterator> range( const Key& lo, const Key& hi ) const;
+
+	// Finger search: the first element with a key not less than 'key', searched from 'from' instead of
+	// the root. It climbs from 'from' only to the lowest subtree that covers the place of the key,
+	// so it takes O(log d) steps for a key d elements away. end() stands for the last element.
+	Iterator lower_bound_from( CIterator from, const Key& key );
+	CIterator lower_bound_from( CIterator from, const Key& key ) const;
+
+	// Lookups of many keys at once: the descents of up to s_batch_lanes_ keys go down the tree in turns,
+	// one level at a time, and prefetch their next nodes, so the cache misses of different keys overlap.
+	// [first, last) are iterators to keys; find_batch() writes find() results for them to 'out'
+	// in the same order and returns the end of the output, count_batch() returns the number of present keys.
+	template<typename KeyIt, typename OutIt>
+	OutIt find_batch( KeyIt first, KeyIt last, OutIt out );
+	template<typename KeyIt, typename OutIt>
+	OutIt find_batch( KeyIt first, KeyIt last, OutIt out ) const;
+	template<typename KeyIt>
+	std::size_t count_batch( KeyIt first, KeyIt last ) const;
+
+	// join() appends 'right', all of whose keys must be greater than the keys of this map
+	// (std::invalid_argument otherwise), in O(log n). split() moves the elements with keys >= key
+	// to the returned map, which shares the slabs of our node pool: the nodes are neither copied nor
+	// reallocated, so references to them stay valid. The tree is cut in O(log n), but size() has to
+	// stay O(1), so the k moved elements are counted: from subtree sizes in O(log n) with OrderStatistics,
+	// else by walking the smaller part, which makes split() O(log n + min(k, n - k)).
+	// Both maps keep all slabs of the pool: the memory is returned when both maps are destroyed or
+	// cleared, and neither of them reorders its free slots by recycling (see Pool::share()) until then.
+	void join( Map&& right );
+	Map split( const Key& key );
+
+	// Set operations in O(m log(n/m + 1)) for sizes m <= n, made of splits and joins of trees.
+	// With a thread pool the recursive halves of big maps are processed in parallel.
+	// set_union() takes the value of 'other' for equal keys, the others keep the values of this map.
+	void set_union( Map&& other, ThreadPool * pool = nullptr );
+	void set_union( const Map& other, ThreadPool * pool = nullptr );
+	void set_intersection( const Map& other, ThreadPool * pool = nullptr );
+	void set_difference( const Map& other, ThreadPool * pool = nullptr );
+
+	// Calls f( const value_type& ) for every element. With a thread pool the tree of a big map is cut into
+	// subtrees visited by parallel tasks, so the calls come in no particular order and f must be safe to call
+	// from many threads at once. An exception of f is rethrown after the other tasks are done.
+	template<typename F>
+	void parallel_for_each( F f, ThreadPool * pool ) const;
+
+	// Read-only copy in a contiguous array with faster lookups, made in O(n).
+	// Later changes of this map don't affect it.
+	FrozenMap<Key, T, Compare> freeze() const;
+
+	key_compare key_comp() const;
+	allocator_type get_allocator() const;
+
+	// Order statistics, available with OrderStatistics augmentation. All of them take O(log n).
+	std::size_t rank( const Key& key ) const; // number of keys less than key
+	Iterator select( std::size_t k ); // k-th smallest key (from 0) or end()
+	CIterator select( std::size_t k ) const;
+	std::size_t count_range( const Key& lo, const Key& hi ) const; // number of keys in [lo, hi)
+
+	// Queries of other augmentations (see ekaugment.h).
+	// reduce() combines aggregates of the elements with keys in [lo, hi) in O(log n), nullopt for an empty range.
+	template<typename A = Augmentation>
+	std::optional<typename A::value_type> reduce( const Key& lo, const Key& hi ) const;
+	// Elements of an interval map whose intervals overlap 'interval', in key order.
+	// Subtrees that can't hold such intervals are skipped, so only the paths to the found ones are visited.
+	std::vector<Iterator> overlapping( const Key& interval );
+	std::vector<CIterator> overlapping( const Key& interval ) const;
+	// Recomputes aggregates after the mapped value of 'pos' was changed through a reference.
+	void refresh( CIterator pos );
 
 	std::string get_debug_output() const;
+	// Text of validate() violations, empty for a valid tree.
 	std::string check_red_black_tree_properties() const;
 	unsigned get_black_height() const;
 
+	// Checks all invariants in one O(n) pass: colors, black heights of all paths, key order, parent links,
+	// size, aggregates, threads and the cached maximum. Child links are followed with an explicit stack,
+	// so a broken tree is reported, not walked forever.
+	ValidationReport validate() const;
+	// Incremental validation for long running processes. After track_changes( period ) every period-th
+	// insertion or erasure remembers its key (0 stops the tracking). validate_changes() checks the path
+	// from the root to every remembered key and the subtree of a few levels around its place, against
+	// the black height of the leftmost path, then forgets the keys. Bulk operations (join, split, set
+	// operations, assignments) and more than s_max_tracked_changes_ keys make it a full validate().
+	// A copy or a moved map doesn't track changes.
+	void track_changes( std::size_t period );
+	ValidationReport validate_changes();
+	// Counters and latency histograms collected with EK_MAP_STATISTICS (see ekstatistics.h) and the shape
+	// of the tree. Finding the height takes O(n).
+	MapStatistics statistics() const;
+
 private:
-	template<typename ValueType>
-	void t_insert_( int key, ValueType&& value);
+	struct Split
+	{
+		// Result of cutting a tree by a key: trees of lesser and greater keys and the node with the key.
+		Node * left = nullptr;
+		Node * found = nullptr;
+		Node * right = nullptr;
+	};
+
+	struct Position
+	{
+		// Result of a descent: the node with the key or, if it is not found, the parent for a new node.
+		Node * node = nullptr;
+		bool found = false;
+		bool left = false; // a new node becomes the left child of 'node'
+	};
 
 	Node * root_ = nullptr;
+	Node * rightmost_ = nullptr; // the maximum, for appends and rbegin() in O(1)
 	std::size_t counter_ = 0;
+	Compare compare_;
+	NodePool pool_;
+
+	struct ChangeLog
+	{
+		// keys of sampled insertions and erasures for validate_changes()
+		std::size_t period = 0; // 0 - changes are not tracked
+		std::size_t countdown = 0;
+		bool whole_tree = false; // the next check is a full one
+		std::vector<Key> keys;
+	};
+	ChangeLog changes_;
+#ifdef EK_MAP_STATISTICS
+	mutable MapCounters counters_;
+#endif
 
 	InternIter ibegin_();
 	InternIter iend_();
@@ -123,24 +553,108 @@ private:
 	CInternIter irbegin_() const;
 	CInternIter irend_() const;
 
-	Node * find_( int key ) const;
+	template<typename K>
+	Node * t_find_( const K& key ) const;
+	template<typename K>
+	Position t_find_position_( const K& key ) const;
+	template<typename K>
+	Position t_find_position_from_( Node * finger, const K& key ) const;
+	template<typename K>
+	Node * t_lower_bound_( const K& key ) const;
+	template<typename K>
+	Node * t_upper_bound_( const K& key ) const;
+	template<typename K>
+	Position t_find_position_in_( Node * subtree, const K& key ) const;
+	static Node * s_lower_bound_at_( const Position& position );
+	Node * finger_( CIterator iter ) const;
+	template<typename ForwardIt, typename KeyOf>
+	ForwardIt t_find_chunk_( ForwardIt first, ForwardIt last, KeyOf key_of, Node ** found ) const;
+	template<typename It, typename KeyOf, typename F>
+	void t_find_batch_( It first, It last, KeyOf key_of, F&& f ) const;
 	Node * get_minimum_() const;
 	Node * get_maximum_() const;
 
+	static constexpr bool s_is_augmented_ = !std::is_same_v<Augmentation, NoAugmentation>;
+
+	void update_aggregate_( Node * node );
+	void update_path_( Node * node );
+	std::size_t subtree_size_( const Node * node ) const;
+	Node * select_( std::size_t k ) const;
+	template<typename F>
+	void for_each_overlapping_( Node * node, const Key& interval, F&& f ) const;
+	static typename Augmentation::value_type s_make_aggregate_( const Node * node );
+
 	void left_rotate_( Node * node );
+	void left_rotate_( Node * node, Node *& root );
 	void right_rotate_( Node * node );
+	void right_rotate_( Node * node, Node *& root );
 	void swap_( Node * a, Node * b );
-	void insert_fixup_( Node * n );
+	void insert_fixup_( Node * node );
+	void insert_fixup_( Node * node, Node *& root );
 	void remove_node_without_childs_( Node * node );
 	void erase_one_child_node_( Node * node );
 	void erase_fixup_( Node * node );
-	std::string check_red_black_tree_property_4_() const;
-	std::string check_red_black_tree_property_5_() const;
+	bool validate_subtree_( const Node * subtree, const Node * parent, unsigned depth, unsigned black_depth,
+		const Node * lo, const Node * hi, std::optional<unsigned>& leaf_black_depth, ValidationReport& report ) const;
+	void add_violation_( ValidationReport& report, ViolationKind kind, const Node * node ) const;
+	void note_change_( const Key& key );
+	void note_bulk_change_();
 
-	template<typename ValueType>
-	Node * t_insert_node_( int key, ValueType&& value );
+	template<typename... Args>
+	Node * t_emplace_at_( const Position& position, Args&&... args );
+	void link_node_( const Position& position, Node * node );
+	template<typename KeyArg, typename M>
+	std::pair<Iterator, bool> t_insert_or_assign_( KeyArg&& key, M&& obj );
+	template<typename KeyArg, typename M>
+	std::pair<Iterator, bool> t_insert_or_assign_at_( const Position& position, KeyArg&& key, M&& obj );
+	template<typename KeyArg, typename... Args>
+	std::pair<Iterator, bool> t_try_emplace_( KeyArg&& key, Args&&... args );
+	void erase_node_( Node * node );
+	void unlink_node_( Node * node );
 
-	static Node * s_copy_tree_( Node * n );
+	Node * copy_tree_( const Node * source, NodePool& pool );
+	Node * copy_tree_( const Node * source, NodePool& pool, ThreadPool * threads, unsigned task_budget );
+	void destroy_tree_( Node * n );
+	static void s_destroy_tree_( Node * n, NodePool& pool );
+
+	// Trees below are detached subtrees (the root has no parent, its color may be red).
+	// These functions don't touch root_ and counter_, so independent trees may be processed in parallel.
+	Split split_( Node * tree, const Key& key );
+	Node * join_( Node * left, Node * middle, Node * right );
+	Node * join_( Node * left, Node * right );
+	Node * union_( Node * a, Node * b, std::vector<Node *>& discarded, ThreadPool * pool, unsigned task_budget );
+	Node * intersection_( Node * a, const Node * b, std::vector<Node *>& discarded, ThreadPool * pool,
+		unsigned task_budget );
+	Node * difference_( Node * a, const Node * b, std::vector<Node *>& discarded, ThreadPool * pool,
+		unsigned task_budget );
+	Node * adopt_tree_( Map& other );
+	void set_root_( Node * root );
+	void destroy_discarded_( const std::vector<Node *>& discarded );
+	unsigned task_budget_( ThreadPool * pool, std::size_t size ) const;
+	template<typename Left, typename Right>
+	static void s_run_both_( ThreadPool * pool, unsigned task_budget, Left&& left, Right&& right );
+	static unsigned s_black_height_( const Node * node );
+
+	template<typename ForwardIt>
+	bool t_is_strictly_sorted_( ForwardIt first, ForwardIt last ) const;
+	void sort_unique_( std::vector<std::pair<Key, T>>& pairs, ThreadPool * pool ) const;
+	template<typename RandomIt>
+	void t_merge_sort_( RandomIt first, RandomIt last, RandomIt buffer, bool into_buffer, ThreadPool * pool,
+		unsigned task_budget ) const;
+	template<typename RandomIt>
+	void t_merge_( RandomIt first1, RandomIt last1, RandomIt first2, RandomIt last2, RandomIt out, ThreadPool * pool,
+		unsigned task_budget ) const;
+	template<typename Iter>
+	void t_build_( Iter first, std::size_t n, ThreadPool * threads = nullptr );
+	template<typename Iter>
+	Node * t_build_subtree_( Iter& iter, std::size_t n, unsigned depth, unsigned red_depth, NodePool& pool );
+	template<typename RandomIt>
+	Node * t_build_subtree_( RandomIt first, std::size_t n, unsigned depth, unsigned red_depth, NodePool& pool,
+		ThreadPool * threads, unsigned task_budget );
+	template<typename F>
+	static void t_for_each_subtree_( const Node * root, F& f, ThreadPool * pool, unsigned task_budget );
+
+	static unsigned s_height_( const Node * root );
 	static Node * s_get_grandparent_( Node * node );
 	static Node * s_get_sibling_( Node * node );
 	static Node * s_get_uncle_( Node * node );
@@ -152,8 +666,3671 @@ private:
 	static const Node * s_find_successor_( const Node * node );
 	static Node * s_find_predecessor_( Node * node );
 	static const Node * s_find_predecessor_( const Node * node );
+	static void s_link_threads_( Node * prev, Node * node, Node * next );
+	static void s_thread_( Node * root );
 	static std::string s_format_line_( const Node * );
+
+	template<typename Value>
+	static std::string s_to_string_( const Value& value );
+
+	static constexpr std::size_t s_parallel_threshold_ = 1 << 15; // smaller set operations run in one thread
+	// projections of iterators to keys for t_find_batch_()
+	static constexpr auto s_deref_ = []( const auto& iter ) -> decltype( auto ) { return *iter; };
+	// (a pair given by value is a temporary, so its key is copied out of it)
+	static constexpr auto s_pair_key_ = []( const auto& iter ) -> decltype( auto ) {
+		if constexpr ( std::is_lvalue_reference_v<decltype( *iter )> )
+		{
+			return ( ( *iter ).first );
+		}
+		else
+		{
+			return Key( ( *iter ).first );
+		}
+	};
+
+	static constexpr std::size_t s_batch_lanes_ = 16; // descents in flight in find_batch()
+	static constexpr std::size_t s_batch_threshold_ = 1 << 16; // smaller maps are searched key by key
+	static constexpr std::size_t s_erase_split_threshold_ = 64; // longer ranges are erased by split and join
+	static constexpr std::size_t s_max_tracked_changes_ = 1 << 12;
+	static constexpr std::size_t s_validation_levels_ = 4; // height of the subtree checked around a changed key
 };
 
-} // namespace EK
+// The original non-template map.
+using IntStringMap = Map<int, std::string>;
+
+template<typename Key, typename T, typename Augmentation, typename Compare = std::less<Key>>
+using AugmentedMap = Map<Key, T, Compare, std::allocator<std::pair<const Key, T>>, Augmentation>;
+
+template<typename Key, typename T, typename Compare = std::less<Key>>
+using OrderStatisticMap = Map<Key, T, Compare, std::allocator<std::pair<const Key, T>>, OrderStatistics>;
+
+template<typename Key, typename T, typename Compare = std::less<Key>>
+using ThreadedMap = Map<Key, T, Compare, std::allocator<std::pair<const Key, T>>, NoAugmentation, true>;
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::InternIter::InternIter( Node * node ) : node_( node )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::InternIter::operator++() -> InternIter&
+{
+	if ( node_ != nullptr )
+	{
+		if constexpr ( Threaded )
+		{
+			node_ = node_->next;
+		}
+		else
+		{
+			node_ = s_find_successor_( node_ );
+		}
+	}
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::InternIter::operator--() -> InternIter&
+{
+	if ( node_ != nullptr )
+	{
+		if constexpr ( Threaded )
+		{
+			node_ = node_->prev;
+		}
+		else
+		{
+			node_ = s_find_predecessor_( node_ );
+		}
+	}
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::InternIter::operator==( InternIter other ) const
+{
+	return node_ == other.node_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::InternIter::operator!=( InternIter other ) const
+{
+	return !( *this == other );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::InternIter::operator*() const -> Node&
+{
+	if ( node_ == nullptr )
+	{
+		throw std::length_error( "Iterator is out of range." );
+	}
+	return *node_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::InternIter::operator->() const -> Node *
+{
+	if ( node_ == nullptr )
+	{
+		throw std::length_error( "Iterator is out of range." );
+	}
+	return node_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::InternIter::get() const -> Node *
+{
+	return node_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CInternIter::CInternIter( Node * node ) : node_( node )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CInternIter::operator++() -> CInternIter&
+{
+	if ( node_ != nullptr )
+	{
+		if constexpr ( Threaded )
+		{
+			node_ = node_->next;
+		}
+		else
+		{
+			node_ = s_find_successor_( node_ );
+		}
+	}
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CInternIter::operator--() -> CInternIter&
+{
+	if ( node_ != nullptr )
+	{
+		if constexpr ( Threaded )
+		{
+			node_ = node_->prev;
+		}
+		else
+		{
+			node_ = s_find_predecessor_( node_ );
+		}
+	}
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CInternIter::operator==( CInternIter other ) const
+{
+	return node_ == other.node_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CInternIter::operator!=( CInternIter other ) const
+{
+	return !( *this == other );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CInternIter::operator*() const -> Node&
+{
+	if ( node_ == nullptr )
+	{
+		throw std::length_error( "Iterator is out of range." );
+	}
+	return *node_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CInternIter::operator->() const -> Node *
+{
+	if ( node_ == nullptr )
+	{
+		throw std::length_error( "Iterator is out of range." );
+	}
+	return node_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CInternIter::get() const -> Node *
+{
+	return node_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::operator++() -> Iterator&
+{
+	++iter_;
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::operator--() -> Iterator&
+{ 
+	--iter_;
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::operator==( Iterator other ) const
+{
+	return iter_ == other.iter_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::operator!=( Iterator other ) const
+{
+	return !( *this == other );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::Iterator( InternIter intern_iter ) : iter_( intern_iter )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::operator++( int ) -> Iterator
+{
+	auto result = *this;
+	++iter_;
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::operator--( int ) -> Iterator
+{
+	auto result = *this;
+	--iter_;
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::operator*() const -> reference
+{
+	return iter_->data;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Iterator::operator->() const -> pointer
+{
+	return &iter_->data;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::operator++() -> CIterator&
+{
+	++iter_; return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::operator--() -> CIterator&
+{
+	--iter_; return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::operator==( CIterator other ) const
+{ 
+	return iter_ == other.iter_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::operator!=( CIterator other ) const
+{
+	return !( *this == other );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::CIterator( CInternIter iter ) : iter_( iter )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::CIterator( Iterator iter ) : iter_( iter.iter_.get() )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::operator++( int ) -> CIterator
+{
+	auto result = *this;
+	++iter_;
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::operator--( int ) -> CIterator
+{
+	auto result = *this;
+	--iter_;
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::operator*() const -> reference
+{
+	return iter_->data;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::CIterator::operator->() const -> pointer
+{
+	return &iter_->data;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Map()
+{
+	root_ = nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Map( const Compare& compare, const Allocator& alloc )
+	: compare_( compare ), pool_( NodeAllocator( alloc ) )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Map( const std::vector<std::pair<Key, T>>& v )
+{
+	assign_sorted( v.begin(), v.end() );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Map( const std::initializer_list<std::pair<Key, T>>& list )
+{
+	assign_sorted( list.begin(), list.end() );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename InputIt>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Map( InputIt first, InputIt last, const Compare& compare, const Allocator& alloc )
+	: compare_( compare ), pool_( NodeAllocator( alloc ) )
+{
+	assign_sorted( first, last );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Map( const Map& rhs )
+	: compare_( rhs.compare_ ),
+	pool_( std::allocator_traits<NodeAllocator>::select_on_container_copy_construction( rhs.pool_.get_allocator() ) )
+{
+	assign( rhs );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Map( const Map& rhs, ThreadPool * pool )
+	: compare_( rhs.compare_ ),
+	pool_( std::allocator_traits<NodeAllocator>::select_on_container_copy_construction( rhs.pool_.get_allocator() ) )
+{
+	assign( rhs, pool );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::operator=( const Map& rhs )
+{
+	assign( rhs );
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::assign( const Map& rhs, ThreadPool * pool )
+{
+	if ( this == &rhs )
+	{
+		return;
+	}
+	// the old nodes go to the free list of pool_ and are taken by the copy before any new memory
+	destroy_tree_( root_ );
+	pool_.recycle();
+	root_ = nullptr;
+	rightmost_ = nullptr;
+	counter_ = 0;
+	compare_ = rhs.compare_;
+
+	auto task_budget = task_budget_( pool, rhs.counter_ );
+	if ( task_budget > 1 )
+	{
+		root_ = copy_tree_( rhs.root_, pool_, pool, task_budget );
+	}
+	else
+	{
+		pool_.reserve( rhs.counter_ );
+		root_ = copy_tree_( rhs.root_, pool_ );
+	}
+	s_thread_( root_ );
+	rightmost_ = s_get_maximum_( root_ );
+	counter_ = rhs.counter_;
+	note_bulk_change_();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::Map( Map&& rhs ) noexcept
+	: compare_( std::move( rhs.compare_ ) ), pool_( std::move( rhs.pool_ ) )
+{
+	root_ = rhs.root_;
+	rightmost_ = rhs.rightmost_;
+	counter_ = rhs.counter_;
+
+	rhs.root_ = nullptr;
+	rhs.rightmost_ = nullptr;
+	rhs.counter_ = 0;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::operator=( Map&& rhs )
+	noexcept( std::allocator_traits<NodeAllocator>::propagate_on_container_move_assignment::value
+		|| std::allocator_traits<NodeAllocator>::is_always_equal::value )
+{
+	using Traits = std::allocator_traits<NodeAllocator>;
+	if constexpr ( !Traits::propagate_on_container_move_assignment::value && !Traits::is_always_equal::value )
+	{
+		if ( this != &rhs && pool_.get_allocator() != rhs.pool_.get_allocator() )
+		{
+			// our allocator stays, and the nodes of 'rhs' are not ours to take
+			clear();
+			compare_ = rhs.compare_;
+			t_build_( std::make_move_iterator( rhs.begin() ), rhs.counter_ );
+			rhs.clear();
+			return *this;
+		}
+	}
+	if ( this != &rhs )
+	{
+		clear();
+		compare_ = std::move( rhs.compare_ );
+		pool_ = std::move( rhs.pool_ );
+		root_ = rhs.root_;
+		rightmost_ = rhs.rightmost_;
+		counter_ = rhs.counter_;
+		rhs.root_ = nullptr;
+		rhs.rightmost_ = nullptr;
+		rhs.counter_ = 0;
+		note_bulk_change_();
+	}
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::~Map()
+{
+	clear();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::clear()
+{
+	destroy_tree_( root_ );
+	pool_.release();
+	root_ = nullptr;
+	rightmost_ = nullptr;
+	counter_ = 0;
+	changes_.keys.clear();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename InputIt>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::assign_sorted( InputIt first, InputIt last, ThreadPool * pool )
+{
+	clear();
+
+	using Category = typename std::iterator_traits<InputIt>::iterator_category;
+	if constexpr ( std::is_base_of_v<std::forward_iterator_tag, Category> )
+	{
+		if ( t_is_strictly_sorted_( first, last ) )
+		{
+			t_build_( first, static_cast<std::size_t>( std::distance( first, last ) ), pool );
+			return;
+		}
+	}
+
+	std::vector<std::pair<Key, T>> pairs;
+	for ( ; first != last; ++first )
+	{
+		auto&& pair = *first;
+		pairs.emplace_back( pair.first, pair.second );
+	}
+	sort_unique_( pairs, pool );
+	t_build_( std::make_move_iterator( pairs.begin() ), pairs.size(), pool );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::ibegin_() -> InternIter { return InternIter( get_minimum_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::iend_() -> InternIter { return InternIter( nullptr ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::irbegin_() -> InternIter { return InternIter( get_maximum_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::irend_() -> InternIter { return InternIter( nullptr ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::ibegin_() const -> CInternIter { return CInternIter( get_minimum_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::iend_() const -> CInternIter { return CInternIter( nullptr ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::irbegin_() const -> CInternIter { return CInternIter( get_maximum_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::irend_() const -> CInternIter { return CInternIter( nullptr ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::NodeHandle::NodeHandle( DetachedNode&& node ) : node_( std::move( node ) )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::ValidationReport::valid() const
+{
+	return violations.empty();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::NodeHandle::empty() const
+{
+	return node_.get() == nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Map<Key, T, Compare, Allocator, Augmentation, Threaded>::NodeHandle::operator bool() const
+{
+	return !empty();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+const Key& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::NodeHandle::key() const
+{
+	if ( empty() )
+	{
+		throw std::out_of_range( "Node handle is empty." );
+	}
+	return node_.get()->key();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+T& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::NodeHandle::mapped() const
+{
+	if ( empty() )
+	{
+		throw std::out_of_range( "Node handle is empty." );
+	}
+	return node_.get()->value();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::begin() -> Iterator { return Iterator( ibegin_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::end() -> Iterator { return Iterator( iend_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::rbegin() -> Iterator { return Iterator( irbegin_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::rend() -> Iterator { return Iterator( irend_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::begin() const -> CIterator { return CIterator( ibegin_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::end() const -> CIterator { return CIterator( iend_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::rbegin() const -> CIterator { return CIterator( irbegin_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::rend() const -> CIterator { return CIterator( irend_() ); }
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+std::size_t Map<Key, T, Compare, Allocator, Augmentation, Threaded>::count( const Key& key ) const
+{
+	return static_cast<bool>( t_find_( key ) != nullptr );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+std::size_t Map<Key, T, Compare, Allocator, Augmentation, Threaded>::count( const K& key ) const
+{
+	return static_cast<bool>( t_find_( key ) != nullptr );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::contains( const Key& key ) const
+{
+	return t_find_( key ) != nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::contains( const K& key ) const
+{
+	return t_find_( key ) != nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+T& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::at( const Key& key )
+{
+	return const_cast<T&>( static_cast<const Map&>( *this ).at( key ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+const T& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::at( const Key& key ) const
+{
+	auto node = t_find_( key );
+	if ( node == nullptr )
+	{
+		throw std::out_of_range( "Key is not found." );
+	}
+	else
+	{
+		return node->value();
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+T& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::at( const K& key )
+{
+	return const_cast<T&>( static_cast<const Map&>( *this ).at( key ) );
+}
 
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+const T& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::at( const K& key ) const
+{
+	auto node = t_find_( key );
+	if ( node == nullptr )
+	{
+		throw std::out_of_range( "Key is not found." );
+	}
+	else
+	{
+		return node->value();
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+T& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::operator[]( const Key& key )
+{
+	return t_try_emplace_( key ).first->second;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+T& Map<Key, T, Compare, Allocator, Augmentation, Threaded>::operator[]( Key&& key )
+{
+	return t_try_emplace_( std::move( key ) ).first->second;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+std::size_t Map<Key, T, Compare, Allocator, Augmentation, Threaded>::size() const
+{
+	return counter_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+Compare Map<Key, T, Compare, Allocator, Augmentation, Threaded>::key_comp() const
+{
+	return compare_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::get_allocator() const -> allocator_type
+{
+	return allocator_type( pool_.get_allocator() );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+FrozenMap<Key, T, Compare> Map<Key, T, Compare, Allocator, Augmentation, Threaded>::freeze() const
+{
+	return FrozenMap<Key, T, Compare>( begin(), end(), compare_ );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename F>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::parallel_for_each( F f, ThreadPool * pool ) const
+{
+	t_for_each_subtree_( root_, f, pool, task_budget_( pool, counter_ ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::join( Map&& right )
+{
+	if ( &right == this || right.root_ == nullptr )
+	{
+		return;
+	}
+	if ( root_ != nullptr && !compare_( get_maximum_()->key(), right.get_minimum_()->key() ) )
+	{
+		throw std::invalid_argument( "EK::Map::join: keys of the right map must be greater" );
+	}
+	auto right_root = adopt_tree_( right );
+	set_root_( join_( root_, right_root ) );
+	counter_ = pool_.size();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::split( const Key& key ) -> Map
+{
+	auto parts = split_( root_, key );
+	set_root_( parts.left );
+	auto right = ( parts.found != nullptr ) ? join_( nullptr, parts.found, parts.right ) : parts.right;
+
+	std::size_t right_size = 0;
+	if constexpr ( HasSubtreeSize<Augmentation>::value )
+	{
+		right_size = subtree_size_( right );
+	}
+	else
+	{
+		// the smaller part is counted: both are walked in step until one of them ends
+		std::size_t steps = 0;
+		auto left_node = s_get_minimum_( root_ );
+		auto right_node = s_get_minimum_( right );
+		for ( ; left_node != nullptr && right_node != nullptr; ++steps )
+		{
+			left_node = s_find_successor_( left_node );
+			right_node = s_find_successor_( right_node );
+		}
+		right_size = ( right_node == nullptr ) ? steps : counter_ - steps;
+	}
+
+	Map result( compare_, get_allocator() );
+	if ( right != nullptr )
+	{
+		result.pool_.share( pool_, right_size );
+		result.set_root_( right );
+	}
+	result.counter_ = right_size;
+	counter_ -= right_size;
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::set_union( Map&& other, ThreadPool * pool )
+{
+	if ( &other == this )
+	{
+		return;
+	}
+	auto task_budget = task_budget_( pool, counter_ + other.counter_ );
+	auto other_root = adopt_tree_( other );
+	std::vector<Node *> discarded;
+	set_root_( union_( root_, other_root, discarded, pool, task_budget ) );
+	destroy_discarded_( discarded );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::set_union( const Map& other, ThreadPool * pool )
+{
+	if ( &other != this )
+	{
+		set_union( Map( other ), pool );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::set_intersection( const Map& other, ThreadPool * pool )
+{
+	if ( &other == this )
+	{
+		return;
+	}
+	std::vector<Node *> discarded;
+	set_root_( intersection_( root_, other.root_, discarded, pool, task_budget_( pool, counter_ + other.counter_ ) ) );
+	destroy_discarded_( discarded );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::set_difference( const Map& other, ThreadPool * pool )
+{
+	if ( &other == this )
+	{
+		clear();
+		return;
+	}
+	std::vector<Node *> discarded;
+	set_root_( difference_( root_, other.root_, discarded, pool, task_budget_( pool, counter_ + other.counter_ ) ) );
+	destroy_discarded_( discarded );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert( const Key& key, const T& value )
+{
+	t_insert_or_assign_( key, value );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert( const Key& key, T&& value )
+{
+	t_insert_or_assign_( key, std::move( value ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert( const std::pair<Key, T>& key_value_pair )
+{
+	insert( key_value_pair.first, key_value_pair.second );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert( std::pair<Key, T>&& key_value_pair )
+{
+	t_insert_or_assign_( std::move( key_value_pair.first ), std::move( key_value_pair.second ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert( CIterator hint, const Key& key, const T& value ) -> Iterator
+{
+	return t_insert_or_assign_at_( t_find_position_from_( finger_( hint ), key ), key, value ).first;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert( CIterator hint, const Key& key, T&& value ) -> Iterator
+{
+	return t_insert_or_assign_at_( t_find_position_from_( finger_( hint ), key ), key, std::move( value ) ).first;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename M>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert_or_assign( const Key& key, M&& obj ) -> std::pair<Iterator, bool>
+{
+	return t_insert_or_assign_( key, std::forward<M>( obj ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename M>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert_or_assign( Key&& key, M&& obj ) -> std::pair<Iterator, bool>
+{
+	return t_insert_or_assign_( std::move( key ), std::forward<M>( obj ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename... Args>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::try_emplace( const Key& key, Args&&... args ) -> std::pair<Iterator, bool>
+{
+	return t_try_emplace_( key, std::forward<Args>( args )... );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename... Args>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::try_emplace( Key&& key, Args&&... args ) -> std::pair<Iterator, bool>
+{
+	return t_try_emplace_( std::move( key ), std::forward<Args>( args )... );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename... Args>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::emplace( Args&&... args ) -> std::pair<Iterator, bool>
+{
+	// the key is known only after the pair is constructed
+	auto node = pool_.create( nullptr, nullptr, nullptr, false, std::forward<Args>( args )... );
+	auto position = t_find_position_( node->key() );
+	if ( position.found )
+	{
+		pool_.destroy( node );
+		return { Iterator( InternIter( position.node ) ), false };
+	}
+	EK_MAP_COUNT( nodes_created, 1 );
+	link_node_( position, node );
+	return { Iterator( InternIter( node ) ), true };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename... Args>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::emplace_hint( CIterator hint, Args&&... args ) -> Iterator
+{
+	// the key is known only after the pair is constructed
+	auto node = pool_.create( nullptr, nullptr, nullptr, false, std::forward<Args>( args )... );
+	auto position = t_find_position_from_( finger_( hint ), node->key() );
+	if ( position.found )
+	{
+		pool_.destroy( node );
+		return Iterator( InternIter( position.node ) );
+	}
+	EK_MAP_COUNT( nodes_created, 1 );
+	link_node_( position, node );
+	return Iterator( InternIter( node ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::erase( const Key& key )
+{
+	EK_MAP_TIME( erase_latency );
+	erase_node_( t_find_( key ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::erase( const K& key )
+{
+	EK_MAP_TIME( erase_latency );
+	erase_node_( t_find_( key ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::erase( CIterator first, CIterator last ) -> Iterator
+{
+	// A short range is erased node by node along successor links, which is amortized O(1) per node.
+	// A long one is split off the tree by the keys of 'first' and 'last' into parts: less than first,
+	// first itself, between them, last itself and greater than last. The whole middle part is destroyed
+	// without rebalancing and the rest is joined back in O(log n).
+	auto first_node = first.iter_.get();
+	auto last_node = last.iter_.get();
+	auto node = first_node;
+	for ( std::size_t i = 0; i < s_erase_split_threshold_ && node != last_node; ++i )
+	{
+		node = s_find_successor_( node );
+	}
+	if ( node == last_node )
+	{
+		while ( first_node != last_node )
+		{
+			auto next = s_find_successor_( first_node );
+			erase_node_( first_node );
+			first_node = next;
+		}
+		return Iterator( InternIter( last_node ) );
+	}
+
+	auto head = split_( root_, first_node->key() );
+	auto middle = head.right;
+	Node * tail = nullptr;
+	if ( last_node != nullptr )
+	{
+		auto rest = split_( head.right, last_node->key() );
+		middle = rest.left;
+		tail = join_( nullptr, rest.found, rest.right );
+	}
+	if ( middle != nullptr )
+	{
+		middle->set_parent( nullptr );
+		destroy_tree_( middle );
+	}
+	pool_.destroy( head.found );
+	set_root_( join_( head.left, tail ) );
+	counter_ = pool_.size();
+	return Iterator( InternIter( last_node ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::extract( CIterator pos ) -> NodeHandle
+{
+	auto node = pos.iter_.get();
+	if ( node == nullptr )
+	{
+		return NodeHandle();
+	}
+	unlink_node_( node );
+	return NodeHandle( pool_.detach( node ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::extract( const Key& key ) -> NodeHandle
+{
+	return extract( find( key ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert( NodeHandle&& node ) -> InsertReturn
+{
+	if ( node.empty() )
+	{
+		return { end(), false, NodeHandle() };
+	}
+	auto position = t_find_position_( node.key() );
+	if ( position.found )
+	{
+		return { Iterator( InternIter( position.node ) ), false, std::move( node ) };
+	}
+	auto inserted = pool_.attach( std::move( node.node_ ) );
+	link_node_( position, inserted );
+	return { Iterator( InternIter( inserted ) ), true, NodeHandle() };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::merge( Map& other )
+{
+	// Keys of 'other' come in ascending order, so each search starts from the place of the previous one.
+	if ( this == &other )
+	{
+		return;
+	}
+	Node * finger = nullptr;
+	auto node = other.get_minimum_();
+	while ( node != nullptr )
+	{
+		// unlinking moves nodes in the tree, but the successor stays the same node
+		auto next = s_find_successor_( node );
+		auto position = t_find_position_from_( finger, node->key() );
+		finger = position.node;
+		if ( !position.found )
+		{
+			other.unlink_node_( node );
+			link_node_( position, pool_.attach( other.pool_.detach( node ) ) );
+			finger = node;
+		}
+		node = next;
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::find( const Key& key ) -> Iterator
+{
+	auto node = t_find_( key );
+	return ( node != nullptr ) ? Iterator( InternIter( node ) ) : end();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::find( const Key& key ) const -> CIterator
+{
+	auto node = t_find_( key );
+	return ( node != nullptr ) ? CIterator( CInternIter( node ) ) : end();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::find( const K& key ) -> Iterator
+{
+	auto node = t_find_( key );
+	return ( node != nullptr ) ? Iterator( InternIter( node ) ) : end();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::find( const K& key ) const -> CIterator
+{
+	auto node = t_find_( key );
+	return ( node != nullptr ) ? CIterator( CInternIter( node ) ) : end();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename KeyIt, typename OutIt>
+OutIt Map<Key, T, Compare, Allocator, Augmentation, Threaded>::find_batch( KeyIt first, KeyIt last, OutIt out )
+{
+	t_find_batch_( first, last, s_deref_, [this, &out]( Node * node ) {
+		*out++ = ( node != nullptr ) ? Iterator( InternIter( node ) ) : end();
+	} );
+	return out;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename KeyIt, typename OutIt>
+OutIt Map<Key, T, Compare, Allocator, Augmentation, Threaded>::find_batch( KeyIt first, KeyIt last, OutIt out ) const
+{
+	t_find_batch_( first, last, s_deref_, [this, &out]( Node * node ) {
+		*out++ = ( node != nullptr ) ? CIterator( CInternIter( node ) ) : end();
+	} );
+	return out;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename KeyIt>
+std::size_t Map<Key, T, Compare, Allocator, Augmentation, Threaded>::count_batch( KeyIt first, KeyIt last ) const
+{
+	std::size_t count = 0;
+	t_find_batch_( first, last, s_deref_, [&count]( Node * node ) {
+		count += ( node != nullptr ) ? 1 : 0;
+	} );
+	return count;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::lower_bound( const Key& key ) -> Iterator
+{
+	return Iterator( InternIter( t_lower_bound_( key ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::lower_bound( const Key& key ) const -> CIterator
+{
+	return CIterator( CInternIter( t_lower_bound_( key ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::lower_bound( const K& key ) -> Iterator
+{
+	return Iterator( InternIter( t_lower_bound_( key ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::lower_bound( const K& key ) const -> CIterator
+{
+	return CIterator( CInternIter( t_lower_bound_( key ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::upper_bound( const Key& key ) -> Iterator
+{
+	return Iterator( InternIter( t_upper_bound_( key ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::upper_bound( const Key& key ) const -> CIterator
+{
+	return CIterator( CInternIter( t_upper_bound_( key ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::upper_bound( const K& key ) -> Iterator
+{
+	return Iterator( InternIter( t_upper_bound_( key ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K, typename C, typename>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::upper_bound( const K& key ) const -> CIterator
+{
+	return CIterator( CInternIter( t_upper_bound_( key ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::equal_range( const Key& key ) -> std::pair<Iterator, Iterator>
+{
+	auto first = lower_bound( key );
+	auto last = ( first != end() && !compare_( key, first->first ) ) ? std::next( first ) : first;
+	return { first, last };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::equal_range( const Key& key ) const
+	-> std::pair<CIterator, CIterator>
+{
+	auto first = lower_bound( key );
+	auto last = ( first != end() && !compare_( key, first->first ) ) ? std::next( first ) : first;
+	return { first, last };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::range( const Key& lo, const Key& hi ) -> IteratorRange<Iterator>
+{
+	auto first = lower_bound( lo );
+	return { first, compare_( lo, hi ) ? lower_bound( hi ) : first };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::range( const Key& lo, const Key& hi ) const
+	-> IteratorRange<CIterator>
+{
+	auto first = lower_bound( lo );
+	return { first, compare_( lo, hi ) ? lower_bound( hi ) : first };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::lower_bound_from( CIterator from, const Key& key ) -> Iterator
+{
+	return Iterator( InternIter( s_lower_bound_at_( t_find_position_from_( finger_( from ), key ) ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::lower_bound_from( CIterator from, const Key& key ) const -> CIterator
+{
+	return CIterator( CInternIter( s_lower_bound_at_( t_find_position_from_( finger_( from ), key ) ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+std::string Map<Key, T, Compare, Allocator, Augmentation, Threaded>::get_debug_output() const
+{
+	std::string result;
+	auto current = get_minimum_();
+
+	while ( current != nullptr )
+	{
+		result += s_format_line_( current ) + '\n';
+		current = s_find_successor_( current );
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+std::size_t Map<Key, T, Compare, Allocator, Augmentation, Threaded>::rank( const Key& key ) const
+{
+	static_assert( HasSubtreeSize<Augmentation>::value, "rank() requires OrderStatistics augmentation" );
+	std::size_t result = 0;
+	auto current = root_;
+	while ( current != nullptr )
+	{
+		if ( compare_( current->key(), key ) )
+		{
+			result += subtree_size_( current->left ) + 1;
+			current = current->right;
+		}
+		else
+		{
+			current = current->left;
+		}
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::select( std::size_t k ) -> Iterator
+{
+	return Iterator( InternIter( select_( k ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::select( std::size_t k ) const -> CIterator
+{
+	return CIterator( CInternIter( select_( k ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+std::size_t Map<Key, T, Compare, Allocator, Augmentation, Threaded>::count_range( const Key& lo, const Key& hi ) const
+{
+	if ( !compare_( lo, hi ) )
+	{
+		return 0;
+	}
+	return rank( hi ) - rank( lo );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename A>
+std::optional<typename A::value_type> Map<Key, T, Compare, Allocator, Augmentation, Threaded>::reduce( const Key& lo, const Key& hi ) const
+{
+	static_assert( s_is_augmented_, "reduce() requires an augmentation" );
+	// find the highest node in [lo, hi), the paths from it to lo and to hi border the range
+	auto split = root_;
+	while ( split != nullptr )
+	{
+		if ( compare_( split->key(), lo ) )
+		{
+			split = split->right;
+		}
+		else if ( !compare_( split->key(), hi ) )
+		{
+			split = split->left;
+		}
+		else
+		{
+			break;
+		}
+	}
+	if ( split == nullptr )
+	{
+		return std::nullopt;
+	}
+
+	auto result = s_make_aggregate_( split );
+	// everything in the left subtree is less than hi: take nodes not less than lo with their right subtrees
+	for ( auto n = split->left; n != nullptr; )
+	{
+		if ( compare_( n->key(), lo ) )
+		{
+			n = n->right;
+			continue;
+		}
+		auto part = s_make_aggregate_( n );
+		if ( n->right != nullptr )
+		{
+			part = Augmentation::combine( part, n->right->aggregate );
+		}
+		result = Augmentation::combine( part, result );
+		n = n->left;
+	}
+	// and symmetrically in the right subtree
+	for ( auto n = split->right; n != nullptr; )
+	{
+		if ( !compare_( n->key(), hi ) )
+		{
+			n = n->left;
+			continue;
+		}
+		auto part = s_make_aggregate_( n );
+		if ( n->left != nullptr )
+		{
+			part = Augmentation::combine( n->left->aggregate, part );
+		}
+		result = Augmentation::combine( result, part );
+		n = n->right;
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::overlapping( const Key& interval ) -> std::vector<Iterator>
+{
+	std::vector<Iterator> result;
+	for_each_overlapping_( root_, interval, [&result]( Node * node ) {
+		result.push_back( Iterator( InternIter( node ) ) );
+	} );
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::overlapping( const Key& interval ) const -> std::vector<CIterator>
+{
+	std::vector<CIterator> result;
+	for_each_overlapping_( root_, interval, [&result]( Node * node ) {
+		result.push_back( CIterator( CInternIter( node ) ) );
+	} );
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::refresh( CIterator pos )
+{
+	update_path_( pos.iter_.get() );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+std::string Map<Key, T, Compare, Allocator, Augmentation, Threaded>::check_red_black_tree_properties() const
+{
+	/*
+	Properties of red-black tree:
+	1. Each node is either red of black.
+	2. The root is black.
+	3. All leaves are black.
+	4. If a node is red, then both its children are black.
+	5. Every path from a given node to any of its descendant leaves
+	goes through the same number of black nodes.
+
+	Properties 1 and 3 don't require a check.
+	*/
+	std::string result;
+	for ( auto& violation : validate().violations )
+	{
+		std::string where = ( violation.position != end() )
+			? "Node with key " + s_to_string_( violation.position->first ) : std::string( "The tree" );
+		switch ( violation.kind )
+		{
+		case ViolationKind::red_root:
+			result += "Property 2 is violated: Root is not black.\n";
+			break;
+		case ViolationKind::red_red:
+			result += "Property 4 is violated: " + where + " has red parent.\n";
+			break;
+		case ViolationKind::black_height:
+			result += "Property 5 is violated: " + where + " has a leaf with another black height.\n";
+			break;
+		case ViolationKind::order:
+			result += where + " is out of key order.\n";
+			break;
+		case ViolationKind::parent_link:
+			result += where + " has a wrong parent link.\n";
+			break;
+		case ViolationKind::size:
+			result += "The number of nodes differs from the size.\n";
+			break;
+		case ViolationKind::aggregate:
+			result += "Aggregate of " + where + " is not up to date.\n";
+			break;
+		case ViolationKind::threads:
+			result += "Threads of " + where + " are wrong.\n";
+			break;
+		case ViolationKind::cached_maximum:
+			result += "The cached maximum is wrong.\n";
+			break;
+		}
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::validate() const -> ValidationReport
+{
+	ValidationReport report;
+	if ( root_ == nullptr )
+	{
+		if ( counter_ != 0 || rightmost_ != nullptr )
+		{
+			add_violation_( report, ViolationKind::size, nullptr );
+		}
+		return report;
+	}
+	if ( root_->is_red() )
+	{
+		add_violation_( report, ViolationKind::red_root, root_ );
+	}
+	std::optional<unsigned> leaf_black_depth;
+	if ( validate_subtree_( root_, nullptr, 0, 0, nullptr, nullptr, leaf_black_depth, report ) )
+	{
+		if ( report.nodes_checked != counter_ )
+		{
+			add_violation_( report, ViolationKind::size, nullptr );
+		}
+		if ( rightmost_ != s_get_maximum_( root_ ) )
+		{
+			add_violation_( report, ViolationKind::cached_maximum, nullptr );
+		}
+	}
+	report.black_height = leaf_black_depth.value_or( 0 );
+	return report;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::track_changes( std::size_t period )
+{
+	changes_.period = period;
+	changes_.countdown = 0;
+	changes_.whole_tree = false;
+	changes_.keys.clear();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::validate_changes() -> ValidationReport
+{
+	if ( changes_.whole_tree )
+	{
+		changes_.whole_tree = false;
+		changes_.keys.clear();
+		return validate();
+	}
+
+	ValidationReport report;
+	if ( root_ == nullptr )
+	{
+		changes_.keys.clear();
+		return report;
+	}
+	if ( root_->is_red() )
+	{
+		add_violation_( report, ViolationKind::red_root, root_ );
+	}
+	std::optional<unsigned> leaf_black_depth = s_black_height_( root_ );
+
+	struct Step
+	{
+		// a node of the path with the state of the descent before it
+		const Node * node;
+		const Node * parent;
+		unsigned depth;
+		unsigned black_depth;
+		const Node * lo;
+		const Node * hi;
+	};
+	std::vector<Step> path;
+	auto& keys = changes_.keys;
+	std::sort( keys.begin(), keys.end(), compare_ );
+	keys.erase( std::unique( keys.begin(), keys.end(),
+		[this]( const Key& a, const Key& b ) { return !compare_( a, b ) && !compare_( b, a ); } ), keys.end() );
+	for ( auto& key : keys )
+	{
+		// the path is checked on the way down; a broken step ends it
+		path.clear();
+		Step step{ root_, nullptr, 0, 0, nullptr, nullptr };
+		while ( step.node != nullptr )
+		{
+			auto node = step.node;
+			if ( node->parent() != step.parent )
+			{
+				add_violation_( report, ViolationKind::parent_link, node );
+				break;
+			}
+			if ( ( step.lo != nullptr && !compare_( step.lo->key(), node->key() ) ) ||
+				( step.hi != nullptr && !compare_( node->key(), step.hi->key() ) ) )
+			{
+				add_violation_( report, ViolationKind::order, node );
+				break;
+			}
+			path.push_back( step );
+			report.max_depth = std::max( report.max_depth, step.depth + 1 );
+			Step next{ nullptr, node, step.depth + 1, step.black_depth + ( node->is_black() ? 1 : 0 ), step.lo, step.hi };
+			if ( compare_( key, node->key() ) )
+			{
+				next.node = node->left;
+				next.hi = node;
+			}
+			else if ( compare_( node->key(), key ) )
+			{
+				next.node = node->right;
+				next.lo = node;
+			}
+			else
+			{
+				break;
+			}
+			step = next;
+		}
+		if ( path.empty() )
+		{
+			continue;
+		}
+		auto& top = path[( path.size() > s_validation_levels_ ) ? path.size() - s_validation_levels_ : 0];
+		for ( auto& above : path )
+		{
+			if ( &above == &top )
+			{
+				break;
+			}
+			++report.nodes_checked;
+			if ( above.node->is_red() && above.parent != nullptr && above.parent->is_red() )
+			{
+				add_violation_( report, ViolationKind::red_red, above.node );
+			}
+		}
+		validate_subtree_( top.node, top.parent, top.depth, top.black_depth, top.lo, top.hi, leaf_black_depth, report );
+	}
+	keys.clear();
+	report.black_height = leaf_black_depth.value_or( 0 );
+	return report;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+unsigned Map<Key, T, Compare, Allocator, Augmentation, Threaded>::get_black_height() const
+{
+	return s_black_height_( root_ );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+MapStatistics Map<Key, T, Compare, Allocator, Augmentation, Threaded>::statistics() const
+{
+	MapStatistics result;
+#ifdef EK_MAP_STATISTICS
+	counters_.fill( result );
+#endif
+	result.size = counter_;
+	result.height = s_height_( root_ );
+	result.height_bound = 2 * std::log2( double( counter_ ) + 1 );
+	result.slab_count = pool_.slab_count();
+	result.pool_capacity = pool_.capacity();
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_find_( const K& key ) const -> Node *
+{
+	EK_MAP_TIME( lookup_latency );
+	[[maybe_unused]] std::uint64_t comparisons = 0;
+	[[maybe_unused]] std::uint64_t levels = 0;
+	auto current = root_;
+	while ( current != nullptr )
+	{
+		++levels;
+		if ( compare_( key, current->key() ) )
+		{
+			current = current->left;
+			++comparisons;
+		}
+		else if ( compare_( current->key(), key ) )
+		{
+			current = current->right;
+			comparisons += 2;
+		}
+		else
+		{
+			comparisons += 2;
+			break;
+		}
+	}
+	EK_MAP_COUNT( lookups, 1 );
+	EK_MAP_COUNT( lookup_comparisons, comparisons );
+	EK_MAP_COUNT( lookup_levels, levels );
+	return current;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename It, typename KeyOf, typename F>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_find_batch_( It first, It last, KeyOf key_of, F&& f ) const
+{
+	// Calls f( node or nullptr ) for every key( iterator ) in order. A lane is one descent: while its
+	// next node is being fetched, the other lanes make their steps.
+	if ( counter_ < s_batch_threshold_ )
+	{
+		// the tree is likely in the cache already, the bookkeeping of lanes would only slow it down
+		for ( ; first != last; ++first )
+		{
+			f( t_find_( key_of( first ) ) );
+		}
+		return;
+	}
+	// A key given by value (proxy, generator or transform iterators) is gone after ++first,
+	// so the lane keeps a copy of it; keys in containers are referred to.
+	using KeyRef = decltype( key_of( first ) );
+	using KeyType = std::remove_cv_t<std::remove_reference_t<KeyRef>>;
+	constexpr bool copies_keys = !std::is_lvalue_reference_v<KeyRef>;
+	using LaneKey = std::conditional_t<copies_keys, std::optional<KeyType>, const KeyType *>;
+	LaneKey keys[s_batch_lanes_];
+	Node * nodes[s_batch_lanes_];
+	bool is_done[s_batch_lanes_];
+	while ( first != last )
+	{
+		std::size_t lane_count = 0;
+		for ( ; lane_count < s_batch_lanes_ && first != last; ++lane_count, ++first )
+		{
+			if constexpr ( copies_keys )
+			{
+				keys[lane_count].emplace( key_of( first ) );
+			}
+			else
+			{
+				keys[lane_count] = &key_of( first );
+			}
+			nodes[lane_count] = root_;
+			is_done[lane_count] = ( root_ == nullptr );
+		}
+
+		auto active_count = lane_count;
+		for ( std::size_t lane = 0; lane < lane_count; ++lane )
+		{
+			active_count -= is_done[lane] ? 1 : 0;
+		}
+		while ( active_count > 0 )
+		{
+			for ( std::size_t lane = 0; lane < lane_count; ++lane )
+			{
+				if ( is_done[lane] )
+				{
+					continue;
+				}
+				auto current = nodes[lane];
+				if ( compare_( *keys[lane], current->key() ) )
+				{
+					current = current->left;
+				}
+				else if ( compare_( current->key(), *keys[lane] ) )
+				{
+					current = current->right;
+				}
+				else
+				{
+					is_done[lane] = true;
+					--active_count;
+					continue;
+				}
+				nodes[lane] = current;
+				if ( current == nullptr )
+				{
+					is_done[lane] = true;
+					--active_count;
+				}
+				else
+				{
+					prefetch( current );
+				}
+			}
+		}
+
+		for ( std::size_t lane = 0; lane < lane_count; ++lane )
+		{
+			f( nodes[lane] );
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_find_position_( const K& key ) const -> Position
+{
+	return t_find_position_in_( root_, key );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_find_position_from_( Node * finger, const K& key ) const -> Position
+{
+	// Keys of a subtree lie between the keys of two ancestors: the parent of the lowest left link above it
+	// (upper bound) and the parent of the lowest right link (lower bound). For a key greater than the key
+	// of the finger only upper bounds matter: the climb passes right links without comparisons, and
+	// the descent starts from the highest node below the first upper bound that is greater than the key.
+	if ( finger == nullptr )
+	{
+		return t_find_position_( key );
+	}
+	auto start = finger;
+	if ( compare_( finger->key(), key ) )
+	{
+		if ( finger == rightmost_ )
+		{
+			return { finger, false, false }; // an append
+		}
+		for ( auto current = finger; current->parent() != nullptr; current = current->parent() )
+		{
+			auto parent = current->parent();
+			if ( parent->left != current )
+			{
+				continue;
+			}
+			if ( compare_( key, parent->key() ) )
+			{
+				break;
+			}
+			if ( !compare_( parent->key(), key ) )
+			{
+				return { parent, true, false };
+			}
+			start = parent;
+		}
+	}
+	else if ( compare_( key, finger->key() ) )
+	{
+		// the mirror image with lower bounds
+		for ( auto current = finger; current->parent() != nullptr; current = current->parent() )
+		{
+			auto parent = current->parent();
+			if ( parent->right != current )
+			{
+				continue;
+			}
+			if ( compare_( parent->key(), key ) )
+			{
+				break;
+			}
+			if ( !compare_( key, parent->key() ) )
+			{
+				return { parent, true, false };
+			}
+			start = parent;
+		}
+	}
+	else
+	{
+		return { finger, true, false };
+	}
+	return t_find_position_in_( start, key );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_lower_bound_( const K& key ) const -> Node *
+{
+	// the last node where the descent went left is the least key that is not less than 'key'
+	Node * result = nullptr;
+	auto current = root_;
+	while ( current != nullptr )
+	{
+		if ( compare_( current->key(), key ) )
+		{
+			current = current->right;
+		}
+		else
+		{
+			result = current;
+			current = current->left;
+		}
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_upper_bound_( const K& key ) const -> Node *
+{
+	Node * result = nullptr;
+	auto current = root_;
+	while ( current != nullptr )
+	{
+		if ( compare_( key, current->key() ) )
+		{
+			result = current;
+			current = current->left;
+		}
+		else
+		{
+			current = current->right;
+		}
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename K>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_find_position_in_( Node * subtree, const K& key ) const -> Position
+{
+	// 'subtree' is the root or a node whose subtree covers the place of 'key'
+	Position position;
+	auto current = subtree;
+	while ( current != nullptr )
+	{
+		position.node = current;
+		if ( compare_( key, current->key() ) )
+		{
+			position.left = true;
+			current = current->left;
+		}
+		else if ( compare_( current->key(), key ) )
+		{
+			position.left = false;
+			current = current->right;
+		}
+		else
+		{
+			position.found = true;
+			break;
+		}
+	}
+	return position;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::finger_( CIterator iter ) const -> Node *
+{
+	return ( iter.iter_.get() != nullptr ) ? iter.iter_.get() : rightmost_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_lower_bound_at_( const Position& position ) -> Node *
+{
+	if ( position.found || position.node == nullptr || position.left )
+	{
+		return position.node;
+	}
+	return s_find_successor_( position.node );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::get_minimum_() const -> Node *
+{
+	return s_get_minimum_( root_ );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::get_maximum_() const -> Node *
+{
+	return rightmost_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::update_aggregate_( Node * node )
+{
+	// recomputes aggregate of the node from its children, which must be up to date
+	if constexpr ( s_is_augmented_ )
+	{
+		auto aggregate = s_make_aggregate_( node );
+		if ( node->left != nullptr )
+		{
+			aggregate = Augmentation::combine( node->left->aggregate, aggregate );
+		}
+		if ( node->right != nullptr )
+		{
+			aggregate = Augmentation::combine( aggregate, node->right->aggregate );
+		}
+		node->aggregate = std::move( aggregate );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::update_path_( Node * node )
+{
+	if constexpr ( s_is_augmented_ )
+	{
+		for ( ; node != nullptr; node = node->parent() )
+		{
+			update_aggregate_( node );
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+std::size_t Map<Key, T, Compare, Allocator, Augmentation, Threaded>::subtree_size_( const Node * node ) const
+{
+	return ( node != nullptr ) ? Augmentation::size( node->aggregate ) : 0;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::select_( std::size_t k ) const -> Node *
+{
+	static_assert( HasSubtreeSize<Augmentation>::value, "select() requires OrderStatistics augmentation" );
+	auto current = root_;
+	while ( current != nullptr )
+	{
+		auto left_size = subtree_size_( current->left );
+		if ( k < left_size )
+		{
+			current = current->left;
+		}
+		else if ( k == left_size )
+		{
+			return current;
+		}
+		else
+		{
+			k -= left_size + 1;
+			current = current->right;
+		}
+	}
+	return nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename F>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::for_each_overlapping_( Node * node, const Key& interval, F&& f ) const
+{
+	static_assert( HasMaxEnd<Augmentation>::value, "overlapping() requires IntervalMaxEnd augmentation" );
+	// Intervals are half-open: [a, b) and [c, d) overlap if a < d and c < b.
+	// The recursion depth is bounded by the height of the tree.
+	if ( node == nullptr || !( interval.first < Augmentation::max_end( node->aggregate ) ) )
+	{
+		return; // every interval in the subtree ends before 'interval' starts
+	}
+	for_each_overlapping_( node->left, interval, f );
+	if ( node->key().first < interval.second )
+	{
+		if ( interval.first < node->key().second )
+		{
+			f( node );
+		}
+		for_each_overlapping_( node->right, interval, f );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_make_aggregate_( const Node * node ) -> typename Augmentation::value_type
+{
+	return Augmentation::make( node->key(), node->value() );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::left_rotate_( Node * n )
+{
+	left_rotate_( n, root_ );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::left_rotate_( Node * n, Node *& root )
+{
+	EK_MAP_COUNT( rotations, 1 );
+	auto rhs = n->right;
+	if ( n->parent() != nullptr )
+	{
+		auto*& parent_link = ( n->parent()->left == n ) ? n->parent()->left : n->parent()->right;
+		parent_link = rhs;
+	}
+	else
+	{
+		root = rhs;
+	}
+
+	rhs->set_parent( n->parent() );
+
+	n->right = rhs->left;
+	if ( rhs->left != nullptr )
+	{
+		rhs->left->set_parent( n );
+	}
+
+	rhs->left = n;
+	n->set_parent( rhs );
+
+	update_aggregate_( n );
+	update_aggregate_( rhs );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::right_rotate_( Node * n )
+{
+	right_rotate_( n, root_ );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::right_rotate_( Node * n, Node *& root )
+{
+	EK_MAP_COUNT( rotations, 1 );
+	auto lhs = n->left;
+	if ( n->parent() != nullptr )
+	{
+		auto*& parent_link = ( n->parent()->left == n ) ? n->parent()->left : n->parent()->right;
+		parent_link = lhs;
+	}
+	else
+	{
+		root = lhs;
+	}
+
+	lhs->set_parent( n->parent() );
+
+	n->left = lhs->right;
+	if ( lhs->right != nullptr )
+	{
+		lhs->right->set_parent( n );
+	}
+
+	lhs->right = n;
+	n->set_parent( lhs );
+
+	update_aggregate_( n );
+	update_aggregate_( lhs );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::swap_( Node * a, Node * b )
+{
+	if ( a == b )
+	{
+		return;
+	}
+	EK_MAP_COUNT( swaps, 1 );
+
+	// Aggregates belong to places in the tree as colors do. The content of subtrees between 'a' and 'b'
+	// changes, but the caller removes one of them right after, and that updates the whole path.
+	if constexpr ( s_is_augmented_ )
+	{
+		std::swap( a->aggregate, b->aggregate );
+	}
+
+	// 1. Save 'a' params:
+	auto ap = a->parent();
+	auto al = a->left;
+	auto ar = a->right;
+	bool ac = a->is_black();
+
+	// 2. Copy params from 'b' to 'a':
+	a->set_parent( b->parent() );
+	a->left = b->left;
+	a->right = b->right;
+	a->set_black( b->is_black() );
+
+	// 3. Fix links of other nodes that were connected with 'b':
+	if ( a->parent() == nullptr )
+	{
+		root_ = a;
+	}
+	else if ( a->parent() == a )
+	{
+		a->set_parent( b );
+	}
+	else
+	{
+		auto*& child_link = ( a->parent()->left == b ) ? a->parent()->left : a->parent()->right;
+		child_link = a;
+	}
+
+	if ( a->left != nullptr )
+	{
+		if ( a->left == a )
+		{
+			a->left = b;
+		}
+		else
+		{
+			a->left->set_parent( a );
+		}
+	}
+
+	if ( a->right != nullptr )
+	{
+		if ( a->right == a )
+		{
+			a->right = b;
+		}
+		else
+		{
+			a->right->set_parent( a );
+		}
+	}
+
+	// 4. Copy saved params from 'a' to 'b':
+	b->set_parent( ap );
+	b->left = al;
+	b->right = ar;
+	b->set_black( ac );
+	
+	// 5. Fix external links for b:
+	if ( b->parent() == nullptr )
+	{
+		root_ = b;
+	}
+	else if ( b->parent() == b )
+	{
+		b->set_parent( a );
+	}
+	else
+	{
+		auto*& child_link = ( b->parent()->left == a ) ? b->parent()->left : b->parent()->right;
+		child_link = b;
+	}
+
+	if ( b->left != nullptr )
+	{
+		if ( b->left == b )
+		{
+			b->left = a;
+		}
+		else
+		{
+			b->left->set_parent( b );
+		}
+	}
+
+	if ( b->right != nullptr )
+	{
+		if ( b->right == b )
+		{
+			b->right = a;
+		}
+		else
+		{
+			b->right->set_parent( b );
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert_fixup_( Node * n )
+{
+	insert_fixup_( n, root_ );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert_fixup_( Node * n, Node *& root )
+{
+	// case 1:
+	if ( n->parent() == nullptr )
+	{
+		n->set_black( true );
+		return;
+	}
+	
+	// case 2:
+	if ( n->parent()->is_black() )
+	{
+		return;
+	}
+
+	auto p = n->parent(); // must be != nullptr and must be red
+	auto g = n->parent()->parent(); // must be != nullptr and must be black
+	auto u = s_get_uncle_( n ); // may be == nullptr
+
+	// we assume that p is red
+	// case 3:
+	if ( u != nullptr && u->is_red() )
+	{
+		EK_MAP_COUNT( recolorings, 3 );
+		p->set_black( true );
+		u->set_black( true );
+		g->set_black( false );
+		insert_fixup_( g, root );
+		return;
+	}
+
+	// we assume that u is black (or nullptr).
+	// Next cases have suffixes L and R. L means that p is left child of g and vice versa.
+
+	// case 4L:
+	if ( p->right == n && g->left == p )
+	{
+		left_rotate_( p, root );
+		insert_fixup_( p, root );
+		return;
+	}
+
+	// case 4R:
+	if ( p->left == n && g->right == p )
+	{
+		right_rotate_( p, root );
+		insert_fixup_( p, root );
+		return;
+	}
+
+	// case 5L:
+	if ( p->left == n && g->left == p )
+	{
+		right_rotate_( g, root );
+		EK_MAP_COUNT( recolorings, 2 );
+		p->set_black( true );
+		g->set_black( false );
+		return;
+	}
+
+	// case 5R:
+	if ( p->right == n && g->right == p )
+	{
+		left_rotate_( g, root );
+		EK_MAP_COUNT( recolorings, 2 );
+		p->set_black( true );
+		g->set_black( false );
+		return;
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::remove_node_without_childs_( Node * node )
+{
+	if ( node->parent() == nullptr )
+	{
+		root_ = nullptr;
+	}
+	else
+	{
+		auto*& parent_link = ( node->parent()->left == node ) ? node->parent()->left : node->parent()->right;
+		parent_link = nullptr;
+		update_path_( node->parent() );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::erase_one_child_node_( Node * node )
+{
+	// node may have at most one child
+	if ( node->is_red() )
+	{
+		remove_node_without_childs_( node );
+	}
+	else
+	{
+		if ( node->left == nullptr && node->right == nullptr )
+		{
+			erase_fixup_( node );
+			remove_node_without_childs_( node );
+		}
+		else
+		{
+			auto child = ( node->left != nullptr ) ? node->left : node->right;
+			swap_( node, child );
+			remove_node_without_childs_( node );
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::erase_fixup_( Node * node )
+{
+	if ( node->parent() == nullptr )
+	{
+		// case 1:
+		return;
+	}
+
+	auto sibling = s_get_sibling_( node );
+	
+	if ( sibling->is_red() )
+	{
+		// case 2:
+		EK_MAP_COUNT( recolorings, 2 );
+		node->parent()->set_black( false );
+		sibling->set_black( true );
+		if ( node->parent()->left == node )
+		{
+			left_rotate_( node->parent() );
+		}
+		else
+		{
+			right_rotate_( node->parent() );
+		}
+		sibling = s_get_sibling_( node );
+	}
+
+	if ( node->parent()->is_black() && sibling->is_black() &&
+		 ( sibling->left == nullptr || sibling->left->is_black() ) &&
+		 ( sibling->right == nullptr || sibling->right->is_black() ) )
+	{
+		// case 3:
+		EK_MAP_COUNT( recolorings, 1 );
+		sibling->set_black( false );
+		erase_fixup_( node->parent() );
+		return;
+	}
+
+	if ( node->parent()->is_red() && sibling->is_black() &&
+		 ( sibling->left == nullptr || sibling->left->is_black() ) &&
+		 ( sibling->right == nullptr || sibling->right->is_black() ) )
+	{
+		// case 4:
+		EK_MAP_COUNT( recolorings, 2 );
+		node->parent()->set_black( true );
+		sibling->set_black( false );
+		return;
+	}
+
+	if ( sibling->is_black() )
+	{
+		// case 5:
+		if ( node->parent()->left == node )
+		{
+			if ( sibling->left != nullptr && sibling->left->is_red() &&
+				( sibling->right == nullptr || sibling->right->is_black() ) )
+			{
+				right_rotate_( sibling );
+				sibling->set_black( false );
+				sibling->parent()->set_black( true );
+				EK_MAP_COUNT( recolorings, 2 );
+				sibling = s_get_sibling_( node );
+			}
+		}
+		else
+		{
+			if ( ( sibling->left == nullptr || sibling->left->is_black() ) &&
+				 sibling->right != nullptr && sibling->right->is_red() )
+			{
+				left_rotate_( sibling );
+				sibling->set_black( false );
+				sibling->parent()->set_black( true );
+				EK_MAP_COUNT( recolorings, 2 );
+				sibling = s_get_sibling_( node );
+			}
+		}
+	}
+
+	if ( sibling->is_black() )
+	{
+		// case 6:
+		if ( node->parent()->left == node )
+		{
+			if ( sibling->right != nullptr && sibling->right->is_red() )
+			{
+				EK_MAP_COUNT( recolorings, 3 );
+				sibling->set_black( node->parent()->is_black() );
+				node->parent()->set_black( true );
+				sibling->right->set_black( true );
+				left_rotate_( node->parent() );
+			}
+		}
+		else
+		{
+			if ( sibling->left != nullptr && sibling->left->is_red() )
+			{
+				EK_MAP_COUNT( recolorings, 3 );
+				sibling->set_black( node->parent()->is_black() );
+				node->parent()->set_black( true );
+				sibling->left->set_black( true );
+				right_rotate_( node->parent() );
+			}
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::validate_subtree_( const Node * subtree, const Node * parent, unsigned depth,
+	unsigned black_depth, const Node * lo, const Node * hi, std::optional<unsigned>& leaf_black_depth,
+	ValidationReport& report ) const
+{
+	// In-order walk with an explicit stack. 'parent', 'depth' and 'black_depth' describe the place
+	// of the subtree, 'lo' and 'hi' are its neighbours in key order (nullptr at the ends of the map).
+	// Every missing child ends a path to a leaf, whose black depth must equal leaf_black_depth
+	// (the first one sets it). Returns false if the walk met more nodes than the map has.
+	struct Frame
+	{
+		const Node * node;
+		unsigned depth;
+		unsigned black_depth;
+	};
+	std::vector<Frame> stack;
+	std::size_t visited = 0;
+	auto check_leaf = [&]( const Node * node, unsigned node_black_depth )
+	{
+		if ( !leaf_black_depth )
+		{
+			leaf_black_depth = node_black_depth;
+		}
+		else if ( *leaf_black_depth != node_black_depth )
+		{
+			add_violation_( report, ViolationKind::black_height, node );
+		}
+	};
+	auto push_left_path = [&]( const Node * node, const Node * node_parent, unsigned node_depth,
+		unsigned node_black_depth )
+	{
+		for ( ; node != nullptr; node_parent = node, node = node->left )
+		{
+			if ( ++visited > counter_ )
+			{
+				add_violation_( report, ViolationKind::size, nullptr ); // a cycle or a foreign subtree
+				return false;
+			}
+			++node_depth;
+			node_black_depth += node->is_black() ? 1 : 0;
+			report.max_depth = std::max( report.max_depth, node_depth );
+			if ( node->parent() != node_parent )
+			{
+				add_violation_( report, ViolationKind::parent_link, node );
+			}
+			if ( node->is_red() && node_parent != nullptr && node_parent->is_red() )
+			{
+				add_violation_( report, ViolationKind::red_red, node );
+			}
+			if ( node->left == nullptr )
+			{
+				check_leaf( node, node_black_depth );
+			}
+			stack.push_back( { node, node_depth, node_black_depth } );
+		}
+		return true;
+	};
+
+	auto previous = lo;
+	if ( !push_left_path( subtree, parent, depth, black_depth ) )
+	{
+		return false;
+	}
+	while ( !stack.empty() )
+	{
+		auto frame = stack.back();
+		stack.pop_back();
+		auto node = frame.node;
+		++report.nodes_checked;
+		if ( previous != nullptr && !compare_( previous->key(), node->key() ) )
+		{
+			add_violation_( report, ViolationKind::order, node );
+		}
+		if constexpr ( Threaded )
+		{
+			if ( node->prev != previous || ( previous != nullptr && previous->next != node ) )
+			{
+				add_violation_( report, ViolationKind::threads, node );
+			}
+		}
+		if constexpr ( s_is_augmented_ )
+		{
+			auto aggregate = s_make_aggregate_( node );
+			if ( node->left != nullptr )
+			{
+				aggregate = Augmentation::combine( node->left->aggregate, aggregate );
+			}
+			if ( node->right != nullptr )
+			{
+				aggregate = Augmentation::combine( aggregate, node->right->aggregate );
+			}
+			if ( !( aggregate == node->aggregate ) )
+			{
+				add_violation_( report, ViolationKind::aggregate, node );
+			}
+		}
+		if ( node->right == nullptr )
+		{
+			check_leaf( node, frame.black_depth );
+		}
+		previous = node;
+		if ( !push_left_path( node->right, node, frame.depth, frame.black_depth ) )
+		{
+			return false;
+		}
+	}
+	if ( previous != nullptr && hi != nullptr && !compare_( previous->key(), hi->key() ) )
+	{
+		add_violation_( report, ViolationKind::order, hi );
+	}
+	if constexpr ( Threaded )
+	{
+		if ( previous != nullptr && ( previous->next != hi || ( hi != nullptr && hi->prev != previous ) ) )
+		{
+			add_violation_( report, ViolationKind::threads, previous );
+		}
+	}
+	return true;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::add_violation_( ValidationReport& report, ViolationKind kind, const Node * node ) const
+{
+	report.violations.push_back( { kind, ( node != nullptr ) ? CIterator( CInternIter( const_cast<Node *>( node ) ) ) : end() } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::note_change_( const Key& key )
+{
+	if ( changes_.period == 0 || changes_.whole_tree || ++changes_.countdown < changes_.period )
+	{
+		return;
+	}
+	changes_.countdown = 0;
+	if ( changes_.keys.size() == s_max_tracked_changes_ )
+	{
+		note_bulk_change_();
+	}
+	else
+	{
+		changes_.keys.push_back( key );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::note_bulk_change_()
+{
+	if ( changes_.period != 0 )
+	{
+		changes_.whole_tree = true;
+		changes_.keys.clear();
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename... Args>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_emplace_at_( const Position& position, Args&&... args ) -> Node *
+{
+	auto node = pool_.create( nullptr, nullptr, nullptr, false, std::forward<Args>( args )... );
+	EK_MAP_COUNT( nodes_created, 1 );
+	link_node_( position, node );
+	return node;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::link_node_( const Position& position, Node * node )
+{
+	// just insert red node in binary tree at the found position and restore the properties
+	note_change_( node->key() );
+	node->set_parent( position.node );
+	if constexpr ( Threaded )
+	{
+		// a new left child comes right before its parent, a new right child right after it
+		if ( position.node == nullptr )
+		{
+			s_link_threads_( nullptr, node, nullptr );
+		}
+		else if ( position.left )
+		{
+			s_link_threads_( position.node->prev, node, position.node );
+		}
+		else
+		{
+			s_link_threads_( position.node, node, position.node->next );
+		}
+	}
+	if ( position.node == nullptr || ( position.node == rightmost_ && !position.left ) )
+	{
+		rightmost_ = node;
+	}
+	if ( position.node == nullptr )
+	{
+		root_ = node;
+	}
+	else
+	{
+		auto*& parent_link = position.left ? position.node->left : position.node->right;
+		parent_link = node;
+	}
+	++counter_;
+	update_path_( node );
+	insert_fixup_( node );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename ForwardIt>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::insert_batch( ForwardIt first, ForwardIt last )
+{
+	if ( counter_ < s_batch_threshold_ )
+	{
+		for ( ; first != last; ++first )
+		{
+			auto&& pair = *first;
+			t_insert_or_assign_( std::forward<decltype( pair )>( pair ).first,
+				std::forward<decltype( pair )>( pair ).second );
+		}
+		return;
+	}
+	// Rebalancing after an insertion only rotates nodes, so the found nodes stay valid.
+	// Absent keys are searched again, as a duplicate key may have been inserted before.
+	Node * found[s_batch_lanes_];
+	while ( first != last )
+	{
+		auto chunk_end = t_find_chunk_( first, last, s_pair_key_, found );
+		for ( std::size_t i = 0; first != chunk_end; ++first, ++i )
+		{
+			auto&& pair = *first;
+			if ( found[i] != nullptr )
+			{
+				found[i]->value() = std::forward<decltype( pair )>( pair ).second;
+				update_path_( found[i] );
+			}
+			else
+			{
+				t_insert_or_assign_( std::forward<decltype( pair )>( pair ).first,
+					std::forward<decltype( pair )>( pair ).second );
+			}
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename ForwardIt>
+std::size_t Map<Key, T, Compare, Allocator, Augmentation, Threaded>::erase_batch( ForwardIt first, ForwardIt last )
+{
+	auto size_before = counter_;
+	if ( counter_ < s_batch_threshold_ )
+	{
+		for ( ; first != last; ++first )
+		{
+			erase_node_( t_find_( *first ) );
+		}
+		return size_before - counter_;
+	}
+	// Keys that are not found are absent for sure. A found node may be erased before its turn
+	// by a duplicate key, so it is searched again.
+	Node * found[s_batch_lanes_];
+	while ( first != last )
+	{
+		auto chunk_end = t_find_chunk_( first, last, s_deref_, found );
+		for ( std::size_t i = 0; first != chunk_end; ++first, ++i )
+		{
+			if ( found[i] != nullptr )
+			{
+				erase_node_( t_find_( *first ) );
+			}
+		}
+	}
+	return size_before - counter_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename ForwardIt, typename KeyOf>
+ForwardIt Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_find_chunk_( ForwardIt first, ForwardIt last,
+	KeyOf key_of, Node ** found ) const
+{
+	// Finds the next s_batch_lanes_ keys by lanes and returns the end of them.
+	auto chunk_end = first;
+	for ( std::size_t i = 0; i < s_batch_lanes_ && chunk_end != last; ++i )
+	{
+		++chunk_end;
+	}
+	t_find_batch_( first, chunk_end, key_of, [&found]( Node * node ) { *found++ = node; } );
+	return chunk_end;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename KeyArg, typename M>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_insert_or_assign_( KeyArg&& key, M&& obj ) -> std::pair<Iterator, bool>
+{
+	EK_MAP_TIME( insert_latency );
+	return t_insert_or_assign_at_( t_find_position_( key ), std::forward<KeyArg>( key ), std::forward<M>( obj ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename KeyArg, typename M>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_insert_or_assign_at_( const Position& position, KeyArg&& key,
+	M&& obj ) -> std::pair<Iterator, bool>
+{
+	if ( position.found )
+	{
+		position.node->value() = std::forward<M>( obj );
+		update_path_( position.node );
+		return { Iterator( InternIter( position.node ) ), false };
+	}
+	auto node = t_emplace_at_( position, std::forward<KeyArg>( key ), std::forward<M>( obj ) );
+	return { Iterator( InternIter( node ) ), true };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename KeyArg, typename... Args>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_try_emplace_( KeyArg&& key, Args&&... args ) -> std::pair<Iterator, bool>
+{
+	EK_MAP_TIME( insert_latency );
+	auto position = t_find_position_( key );
+	if ( position.found )
+	{
+		return { Iterator( InternIter( position.node ) ), false };
+	}
+	auto node = t_emplace_at_( position, std::piecewise_construct,
+							   std::forward_as_tuple( std::forward<KeyArg>( key ) ),
+							   std::forward_as_tuple( std::forward<Args>( args )... ) );
+	return { Iterator( InternIter( node ) ), true };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::erase_node_( Node * n )
+{
+	if ( n == nullptr )
+	{
+		return;
+	}
+	unlink_node_( n );
+	pool_.destroy( n );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::unlink_node_( Node * n )
+{
+	// takes the node out of the tree, the node itself stays alive
+	note_change_( n->key() );
+	if ( n == rightmost_ )
+	{
+		rightmost_ = s_find_predecessor_( n );
+	}
+	if constexpr ( Threaded )
+	{
+		// the list is in key order, so swap_() below doesn't change it
+		if ( n->prev != nullptr )
+		{
+			n->prev->next = n->next;
+		}
+		if ( n->next != nullptr )
+		{
+			n->next->prev = n->prev;
+		}
+	}
+	if ( n->left != nullptr && n->right != nullptr )
+	{
+		// nodes are swapped, not their data, so rightmost_ stays valid
+		auto successor = s_get_minimum_( n->right );
+		swap_( n, successor );
+	}
+
+	erase_one_child_node_( n );
+	--counter_;
+	// a red leaf without links, ready to be linked again
+	n->left = nullptr;
+	n->right = nullptr;
+	n->parent_and_color = 0;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::copy_tree_( const Node * source, NodePool& pool ) -> Node *
+{
+	// Pre-order walk with an explicit stack of right children still to copy, so there is no recursion
+	// and nodes are created in the same order as by a recursive copy. The stack holds at most one entry
+	// per level and the height of a red-black tree is below 2 * log2(n + 1) <= 128.
+	// Aggregates are taken from the source nodes, the copied subtrees are identical.
+	if ( source == nullptr )
+	{
+		return nullptr;
+	}
+	auto make_copy = [&pool]( Node * parent, const Node * from )
+	{
+		auto copy = pool.create( parent, nullptr, nullptr, from->is_black(), from->data );
+		if constexpr ( s_is_augmented_ )
+		{
+			copy->aggregate = from->aggregate;
+		}
+		return copy;
+	};
+	auto root = make_copy( nullptr, source );
+	try
+	{
+		std::array<std::pair<const Node *, Node *>, 128> pending; // right child to copy, parent of its copy
+		std::size_t pending_count = 0;
+		auto from = source;
+		auto to = root;
+		while ( true )
+		{
+			if ( from->right != nullptr )
+			{
+				pending[pending_count++] = { from->right, to };
+			}
+			if ( from->left != nullptr )
+			{
+				to->left = make_copy( to, from->left );
+				to = to->left;
+				from = from->left;
+			}
+			else if ( pending_count != 0 )
+			{
+				auto [right, parent] = pending[--pending_count];
+				parent->right = make_copy( parent, right );
+				to = parent->right;
+				from = right;
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+	catch ( ... )
+	{
+		s_destroy_tree_( root, pool );
+		throw;
+	}
+	return root;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::copy_tree_( const Node * source, NodePool& pool, ThreadPool * threads,
+	unsigned task_budget ) -> Node *
+{
+	// The right subtree is copied by another task to a pool of its own, which joins 'pool' afterwards.
+	// Failures are caught inside the tasks, so a copied subtree is destroyed even if the other one failed.
+	if ( source == nullptr || threads == nullptr || task_budget <= 1 )
+	{
+		return copy_tree_( source, pool );
+	}
+	NodePool right_pool( pool.get_allocator() );
+	Node * left = nullptr;
+	Node * right = nullptr;
+	std::exception_ptr left_error;
+	std::exception_ptr right_error;
+	s_run_both_( threads, task_budget,
+		[&]
+		{
+			try
+			{
+				left = copy_tree_( source->left, pool, threads, task_budget / 2 );
+			}
+			catch ( ... )
+			{
+				left_error = std::current_exception();
+			}
+		},
+		[&]
+		{
+			try
+			{
+				right = copy_tree_( source->right, right_pool, threads, task_budget / 2 );
+			}
+			catch ( ... )
+			{
+				right_error = std::current_exception();
+			}
+		} );
+	pool.splice( right_pool );
+
+	Node * root = nullptr;
+	if ( left_error == nullptr && right_error == nullptr )
+	{
+		try
+		{
+			root = pool.create( nullptr, left, right, source->is_black(), source->data );
+		}
+		catch ( ... )
+		{
+			left_error = std::current_exception();
+		}
+	}
+	if ( root == nullptr )
+	{
+		s_destroy_tree_( left, pool );
+		s_destroy_tree_( right, pool );
+		std::rethrow_exception( ( left_error != nullptr ) ? left_error : right_error );
+	}
+	for ( auto child : { left, right } )
+	{
+		if ( child != nullptr )
+		{
+			child->set_parent( root );
+		}
+	}
+	update_aggregate_( root );
+	return root;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::destroy_tree_( Node * n )
+{
+	s_destroy_tree_( n, pool_ );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_destroy_tree_( Node * n, NodePool& pool )
+{
+	// Post-order walk over parent links, so no recursion and no extra memory is needed.
+	while ( n != nullptr )
+	{
+		if ( n->left != nullptr )
+		{
+			n = n->left;
+		}
+		else if ( n->right != nullptr )
+		{
+			n = n->right;
+		}
+		else
+		{
+			auto parent = n->parent();
+			if ( parent != nullptr )
+			{
+				auto*& parent_link = ( parent->left == n ) ? parent->left : parent->right;
+				parent_link = nullptr;
+			}
+			pool.destroy( n );
+			n = parent;
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::split_( Node * tree, const Key& key ) -> Split
+{
+	// The recursion goes down one path, so its depth is bounded by the height of the tree.
+	if ( tree == nullptr )
+	{
+		return {};
+	}
+	auto left = tree->left;
+	auto right = tree->right;
+	tree->left = nullptr;
+	tree->right = nullptr;
+	for ( auto child : { left, right } )
+	{
+		if ( child != nullptr )
+		{
+			child->set_parent( nullptr );
+		}
+	}
+
+	if ( compare_( key, tree->key() ) )
+	{
+		auto parts = split_( left, key );
+		return { parts.left, parts.found, join_( parts.right, tree, right ) };
+	}
+	if ( compare_( tree->key(), key ) )
+	{
+		auto parts = split_( right, key );
+		return { join_( left, tree, parts.left ), parts.found, parts.right };
+	}
+	return { left, tree, right };
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::join_( Node * left, Node * middle, Node * right ) -> Node *
+{
+	// Joins trees with keys left < middle < right in O(difference of their black heights + 1) rotations.
+	// The middle node takes the place of the first black node on the facing spine of the higher tree
+	// that has the black height of the lower one, and the red-red conflict is fixed as after insertion.
+	if constexpr ( Threaded )
+	{
+		s_link_threads_( s_get_maximum_( left ), middle, s_get_minimum_( right ) );
+	}
+	for ( auto tree : { left, right } )
+	{
+		if ( tree != nullptr )
+		{
+			tree->set_parent( nullptr );
+			tree->set_black( true );
+		}
+	}
+	middle->set_parent( nullptr );
+	auto left_height = s_black_height_( left );
+	auto right_height = s_black_height_( right );
+
+	if ( left_height == right_height )
+	{
+		middle->left = left;
+		middle->right = right;
+		middle->set_black( true );
+		for ( auto tree : { left, right } )
+		{
+			if ( tree != nullptr )
+			{
+				tree->set_parent( middle );
+			}
+		}
+		update_aggregate_( middle );
+		return middle;
+	}
+
+	auto root = ( left_height > right_height ) ? left : right;
+	auto low_height = std::min( left_height, right_height );
+	auto height = std::max( left_height, right_height );
+	Node * parent = nullptr;
+	auto node = root;
+	// 'height' is the black height of 'node'
+	while ( node != nullptr && ( node->is_red() || height > low_height ) )
+	{
+		if ( node->is_black() )
+		{
+			--height;
+		}
+		parent = node;
+		node = ( root == left ) ? node->right : node->left;
+	}
+
+	middle->set_black( false );
+	middle->set_parent( parent );
+	if ( root == left )
+	{
+		parent->right = middle;
+		middle->left = node;
+		middle->right = right;
+	}
+	else
+	{
+		parent->left = middle;
+		middle->left = left;
+		middle->right = node;
+	}
+	for ( auto child : { middle->left, middle->right } )
+	{
+		if ( child != nullptr )
+		{
+			child->set_parent( middle );
+		}
+	}
+	update_path_( middle );
+	insert_fixup_( middle, root );
+	return root;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::join_( Node * left, Node * right ) -> Node *
+{
+	if ( left == nullptr || right == nullptr )
+	{
+		return ( left != nullptr ) ? left : right;
+	}
+	auto parts = split_( right, s_get_minimum_( right )->key() );
+	return join_( left, parts.found, parts.right );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::union_( Node * a, Node * b, std::vector<Node *>& discarded, ThreadPool * pool,
+	unsigned task_budget ) -> Node *
+{
+	if ( a == nullptr || b == nullptr )
+	{
+		return ( a != nullptr ) ? a : b;
+	}
+	auto b_left = b->left;
+	auto b_right = b->right;
+	auto parts = split_( a, b->key() );
+	if ( parts.found != nullptr )
+	{
+		discarded.push_back( parts.found ); // the node of 'b' is kept
+	}
+
+	Node * left = nullptr;
+	Node * right = nullptr;
+	std::vector<Node *> right_discarded;
+	s_run_both_( pool, task_budget,
+		[&] { left = union_( parts.left, b_left, discarded, pool, task_budget / 2 ); },
+		[&] { right = union_( parts.right, b_right, right_discarded, pool, task_budget / 2 ); } );
+	discarded.insert( discarded.end(), right_discarded.begin(), right_discarded.end() );
+	return join_( left, b, right );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::intersection_( Node * a, const Node * b, std::vector<Node *>& discarded, ThreadPool * pool,
+	unsigned task_budget ) -> Node *
+{
+	if ( a == nullptr )
+	{
+		return nullptr;
+	}
+	if ( b == nullptr )
+	{
+		a->set_parent( nullptr );
+		discarded.push_back( a );
+		return nullptr;
+	}
+	auto parts = split_( a, b->key() );
+
+	Node * left = nullptr;
+	Node * right = nullptr;
+	std::vector<Node *> right_discarded;
+	s_run_both_( pool, task_budget,
+		[&] { left = intersection_( parts.left, b->left, discarded, pool, task_budget / 2 ); },
+		[&] { right = intersection_( parts.right, b->right, right_discarded, pool, task_budget / 2 ); } );
+	discarded.insert( discarded.end(), right_discarded.begin(), right_discarded.end() );
+	return ( parts.found != nullptr ) ? join_( left, parts.found, right ) : join_( left, right );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::difference_( Node * a, const Node * b, std::vector<Node *>& discarded, ThreadPool * pool,
+	unsigned task_budget ) -> Node *
+{
+	if ( a == nullptr || b == nullptr )
+	{
+		return a;
+	}
+	auto parts = split_( a, b->key() );
+	if ( parts.found != nullptr )
+	{
+		discarded.push_back( parts.found );
+	}
+
+	Node * left = nullptr;
+	Node * right = nullptr;
+	std::vector<Node *> right_discarded;
+	s_run_both_( pool, task_budget,
+		[&] { left = difference_( parts.left, b->left, discarded, pool, task_budget / 2 ); },
+		[&] { right = difference_( parts.right, b->right, right_discarded, pool, task_budget / 2 ); } );
+	discarded.insert( discarded.end(), right_discarded.begin(), right_discarded.end() );
+	return join_( left, right );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::adopt_tree_( Map& other ) -> Node *
+{
+	// moves the nodes of 'other' to our pool: the whole slabs if the allocators are equal, else by copying
+	Node * root = nullptr;
+	if ( get_allocator() == other.get_allocator() )
+	{
+		pool_.splice( other.pool_ );
+		root = other.root_;
+		other.root_ = nullptr;
+		other.rightmost_ = nullptr;
+		other.counter_ = 0;
+	}
+	else
+	{
+		pool_.reserve( other.counter_ );
+		root = copy_tree_( other.root_, pool_ );
+		s_thread_( root );
+		other.clear();
+	}
+	return root;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::set_root_( Node * root )
+{
+	note_bulk_change_();
+	root_ = root;
+	rightmost_ = s_get_maximum_( root_ );
+	if ( root_ != nullptr )
+	{
+		root_->set_parent( nullptr );
+		root_->set_black( true );
+		if constexpr ( Threaded )
+		{
+			// the ends of the list may still point to nodes of other trees
+			s_get_minimum_( root_ )->prev = nullptr;
+			rightmost_->next = nullptr;
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::destroy_discarded_( const std::vector<Node *>& discarded )
+{
+	for ( auto tree : discarded )
+	{
+		destroy_tree_( tree );
+	}
+	counter_ = pool_.size();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+unsigned Map<Key, T, Compare, Allocator, Augmentation, Threaded>::task_budget_( ThreadPool * pool, std::size_t size ) const
+{
+	// The recursion forks a task while its budget is above one, each half gets a half of the budget.
+	// Four tasks per thread balance the uneven halves well enough.
+	if ( pool == nullptr || size < s_parallel_threshold_ )
+	{
+		return 0;
+	}
+	return pool->thread_count() * 4;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename Left, typename Right>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_run_both_( ThreadPool * pool, unsigned task_budget, Left&& left, Right&& right )
+{
+	if ( pool != nullptr && task_budget > 1 )
+	{
+		auto future = pool->submit( std::forward<Right>( right ) );
+		try
+		{
+			left();
+		}
+		catch ( ... )
+		{
+			// the right task may use the stack of the caller, so it must end before the exception leaves
+			try
+			{
+				pool->wait( future );
+			}
+			catch ( ... )
+			{
+			}
+			throw;
+		}
+		pool->wait( future );
+	}
+	else
+	{
+		left();
+		right();
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+unsigned Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_black_height_( const Node * node )
+{
+	// number of black nodes on a path from the node down to a leaf
+	unsigned height = 0;
+	for ( ; node != nullptr; node = node->left )
+	{
+		if ( node->is_black() )
+		{
+			++height;
+		}
+	}
+	return height;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename ForwardIt>
+bool Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_is_strictly_sorted_( ForwardIt first, ForwardIt last ) const
+{
+	if ( first == last )
+	{
+		return true;
+	}
+	for ( auto next = std::next( first ); next != last; ++first, ++next )
+	{
+		if ( !compare_( ( *first ).first, ( *next ).first ) )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::sort_unique_( std::vector<std::pair<Key, T>>& pairs, ThreadPool * pool ) const
+{
+	// The buffer of the parallel merge sort needs default constructible pairs; others are sorted in one thread.
+	bool sorted = false;
+	if constexpr ( std::is_default_constructible_v<std::pair<Key, T>> )
+	{
+		auto task_budget = task_budget_( pool, pairs.size() );
+		if ( task_budget > 1 )
+		{
+			std::vector<std::pair<Key, T>> buffer( pairs.size() );
+			t_merge_sort_( pairs.begin(), pairs.end(), buffer.begin(), false, pool, task_budget );
+			sorted = true;
+		}
+	}
+	if ( !sorted )
+	{
+		std::stable_sort( pairs.begin(), pairs.end(), [this]( const auto& a, const auto& b )
+		{
+			return compare_( a.first, b.first );
+		} );
+	}
+
+	// of equal keys only the last one is kept, as if the pairs were inserted one by one
+	std::size_t out = 0;
+	for ( std::size_t i = 0; i < pairs.size(); ++i )
+	{
+		if ( i + 1 < pairs.size() && !compare_( pairs[i].first, pairs[i + 1].first ) )
+		{
+			continue;
+		}
+		if ( out != i )
+		{
+			pairs[out] = std::move( pairs[i] );
+		}
+		++out;
+	}
+	pairs.erase( pairs.begin() + out, pairs.end() );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename Iter>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_build_( Iter first, std::size_t n, ThreadPool * threads )
+{
+	// Sizes of the subtrees of every node differ at most by one, so all nil links lie on the two last levels.
+	// Then a tree with black inner levels and red deepest level (floor(log2(n))) satisfies all properties.
+	unsigned red_depth = 0;
+	while ( ( std::size_t( 2 ) << red_depth ) <= n )
+	{
+		++red_depth;
+	}
+	using Category = typename std::iterator_traits<Iter>::iterator_category;
+	if constexpr ( std::is_base_of_v<std::random_access_iterator_tag, Category> )
+	{
+		root_ = t_build_subtree_( first, n, 0, red_depth, pool_, threads, task_budget_( threads, n ) );
+	}
+	else
+	{
+		root_ = t_build_subtree_( first, n, 0, red_depth, pool_ );
+	}
+	s_thread_( root_ );
+	rightmost_ = s_get_maximum_( root_ );
+	counter_ = n;
+	note_bulk_change_();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename Iter>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_build_subtree_( Iter& iter, std::size_t n, unsigned depth, unsigned red_depth,
+	NodePool& pool ) -> Node *
+{
+	// builds subtree of n nodes from the next n pairs taken in order
+	if ( n == 0 )
+	{
+		return nullptr;
+	}
+
+	auto left_size = n / 2;
+	auto left = t_build_subtree_( iter, left_size, depth + 1, red_depth, pool );
+
+	auto&& pair = *iter;
+	bool is_black = ( depth == 0 || depth != red_depth );
+	auto node = pool.create( nullptr, left, nullptr, is_black, pair.first,
+							 std::forward<decltype( pair )>( pair ).second );
+	++iter;
+
+	node->right = t_build_subtree_( iter, n - 1 - left_size, depth + 1, red_depth, pool );
+	if ( node->left != nullptr )
+	{
+		node->left->set_parent( node );
+	}
+	if ( node->right != nullptr )
+	{
+		node->right->set_parent( node );
+	}
+	update_aggregate_( node );
+	return node;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename RandomIt>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_build_subtree_( RandomIt first, std::size_t n, unsigned depth, unsigned red_depth,
+	NodePool& pool, ThreadPool * threads, unsigned task_budget ) -> Node *
+{
+	// As copy_tree_(): the right subtree is built by another task to a pool of its own, which joins 'pool'
+	// afterwards, and failures are caught inside the tasks, so a built subtree is destroyed if the other one failed.
+	if ( n == 0 || threads == nullptr || task_budget <= 1 )
+	{
+		return t_build_subtree_( first, n, depth, red_depth, pool );
+	}
+	auto left_size = n / 2;
+	auto middle = first + static_cast<std::ptrdiff_t>( left_size );
+	NodePool right_pool( pool.get_allocator() );
+	Node * left = nullptr;
+	Node * right = nullptr;
+	std::exception_ptr left_error;
+	std::exception_ptr right_error;
+	s_run_both_( threads, task_budget,
+		[&]
+		{
+			try
+			{
+				left = t_build_subtree_( first, left_size, depth + 1, red_depth, pool, threads, task_budget / 2 );
+			}
+			catch ( ... )
+			{
+				left_error = std::current_exception();
+			}
+		},
+		[&]
+		{
+			try
+			{
+				right = t_build_subtree_( middle + 1, n - 1 - left_size, depth + 1, red_depth, right_pool, threads,
+					task_budget / 2 );
+			}
+			catch ( ... )
+			{
+				right_error = std::current_exception();
+			}
+		} );
+	pool.splice( right_pool );
+
+	Node * node = nullptr;
+	if ( left_error == nullptr && right_error == nullptr )
+	{
+		try
+		{
+			auto&& pair = *middle;
+			bool is_black = ( depth == 0 || depth != red_depth );
+			node = pool.create( nullptr, left, right, is_black, pair.first, std::forward<decltype( pair )>( pair ).second );
+		}
+		catch ( ... )
+		{
+			left_error = std::current_exception();
+		}
+	}
+	if ( node == nullptr )
+	{
+		s_destroy_tree_( left, pool );
+		s_destroy_tree_( right, pool );
+		std::rethrow_exception( ( left_error != nullptr ) ? left_error : right_error );
+	}
+	for ( auto child : { left, right } )
+	{
+		if ( child != nullptr )
+		{
+			child->set_parent( node );
+		}
+	}
+	update_aggregate_( node );
+	return node;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename RandomIt>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_merge_sort_( RandomIt first, RandomIt last, RandomIt buffer, bool into_buffer, ThreadPool * pool,
+	unsigned task_budget ) const
+{
+	// Stable sort of [first, last) by keys, into itself or into 'buffer' of the same length. The halves are
+	// sorted by parallel tasks into the other array and merged back by t_merge_(), so no pass only copies.
+	if ( pool == nullptr || task_budget <= 1 )
+	{
+		std::stable_sort( first, last, [this]( const auto& a, const auto& b ) { return compare_( a.first, b.first ); } );
+		if ( into_buffer )
+		{
+			std::move( first, last, buffer );
+		}
+		return;
+	}
+	auto n = last - first;
+	auto middle = first + n / 2;
+	auto buffer_middle = buffer + n / 2;
+	s_run_both_( pool, task_budget,
+		[&] { t_merge_sort_( first, middle, buffer, !into_buffer, pool, task_budget / 2 ); },
+		[&] { t_merge_sort_( middle, last, buffer_middle, !into_buffer, pool, task_budget / 2 ); } );
+	if ( into_buffer )
+	{
+		t_merge_( first, middle, middle, last, buffer, pool, task_budget );
+	}
+	else
+	{
+		t_merge_( buffer, buffer_middle, buffer_middle, buffer + n, first, pool, task_budget );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename RandomIt>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_merge_( RandomIt first1, RandomIt last1, RandomIt first2, RandomIt last2, RandomIt out,
+	ThreadPool * pool, unsigned task_budget ) const
+{
+	// Stable merge of two sorted runs by parallel tasks. The longer run is cut in the middle and the other one
+	// at the same key, with equal keys of the first run on the left side, so both sides merge independently.
+	auto by_key = [this]( const auto& a, const auto& b ) { return compare_( a.first, b.first ); };
+	if ( pool == nullptr || task_budget <= 1 )
+	{
+		std::merge( std::make_move_iterator( first1 ), std::make_move_iterator( last1 ), std::make_move_iterator( first2 ),
+			std::make_move_iterator( last2 ), out, by_key );
+		return;
+	}
+	RandomIt cut1;
+	RandomIt cut2;
+	if ( last1 - first1 >= last2 - first2 )
+	{
+		cut1 = first1 + ( last1 - first1 ) / 2;
+		cut2 = std::lower_bound( first2, last2, *cut1, by_key );
+	}
+	else
+	{
+		cut2 = first2 + ( last2 - first2 ) / 2;
+		cut1 = std::upper_bound( first1, last1, *cut2, by_key );
+	}
+	auto out_cut = out + ( cut1 - first1 ) + ( cut2 - first2 );
+	s_run_both_( pool, task_budget,
+		[&] { t_merge_( first1, cut1, first2, cut2, out, pool, task_budget / 2 ); },
+		[&] { t_merge_( cut1, last1, cut2, last2, out_cut, pool, task_budget / 2 ); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename F>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::t_for_each_subtree_( const Node * root, F& f, ThreadPool * pool, unsigned task_budget )
+{
+	// The right subtree goes to another task while the budget lasts, the rest is visited in order.
+	if ( root == nullptr )
+	{
+		return;
+	}
+	if ( pool == nullptr || task_budget <= 1 )
+	{
+		auto stop = s_find_successor_( s_get_maximum_( root ) );
+		for ( auto node = s_get_minimum_( root ); node != stop; node = s_find_successor_( node ) )
+		{
+			f( static_cast<const value_type&>( node->data ) );
+		}
+		return;
+	}
+	s_run_both_( pool, task_budget,
+		[&]
+		{
+			t_for_each_subtree_( root->left, f, pool, task_budget / 2 );
+			f( static_cast<const value_type&>( root->data ) );
+		},
+		[&] { t_for_each_subtree_( root->right, f, pool, task_budget / 2 ); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+unsigned Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_height_( const Node * root )
+{
+	// Depth-first walk over parent links: 'previous' tells whether the walk came down or up from a child.
+	unsigned height = 0;
+	unsigned depth = 0;
+	const Node * previous = nullptr;
+	for ( auto node = root; node != nullptr; )
+	{
+		const Node * next = nullptr;
+		if ( previous == node->parent() )
+		{
+			height = std::max( height, ++depth );
+			next = ( node->left != nullptr ) ? node->left : node->right;
+		}
+		else if ( previous == node->left )
+		{
+			next = node->right;
+		}
+		if ( next == nullptr )
+		{
+			next = node->parent();
+			--depth;
+		}
+		previous = node;
+		node = next;
+	}
+	return height;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_get_grandparent_( Node * node ) -> Node *
+{
+	return ( node->parent() != nullptr ) ? node->parent()->parent() : nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_get_sibling_( Node * node ) -> Node *
+{
+	if ( node->parent() == nullptr )
+	{
+		return nullptr;
+	}
+	return ( node->parent()->left == node ) ? node->parent()->right : node->parent()->left;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_get_uncle_( Node * node ) -> Node *
+{
+	auto g = s_get_grandparent_( node );
+	if ( g == nullptr )
+	{
+		return nullptr;
+	}
+	return ( g->left == node->parent() ) ? g->right : g->left;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_get_minimum_( Node * node ) -> Node *
+{
+	return const_cast<Node *>( s_get_minimum_( static_cast<const Node *>( node ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_get_minimum_( const Node * node ) -> const Node *
+{
+	if ( node == nullptr )
+	{
+		return nullptr;
+	}
+
+	auto current = node;
+	while ( current->left != nullptr )
+	{
+		current = current->left;
+	}
+	return current;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_get_maximum_( Node * node ) -> Node *
+{
+	return const_cast<Node *>( s_get_maximum_( static_cast<const Node *>( node ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_get_maximum_( const Node * node ) -> const Node *
+{
+	if ( node == nullptr )
+	{
+		return nullptr;
+	}
+
+	auto current = node;
+	while ( current->right != nullptr )
+	{
+		current = current->right;
+	}
+	return current;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_find_successor_( Node * node ) -> Node *
+{
+	return const_cast<Node *>( s_find_successor_( static_cast<const Node *>( node ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_find_successor_( const Node * node ) -> const Node *
+{
+	auto current = s_get_minimum_( static_cast<const Node *>( node->right ) );
+	if ( current == nullptr )
+	{
+		// climb while we come from the right subtree
+		current = node;
+		while ( current->parent() != nullptr && current->parent()->right == current )
+		{
+			current = current->parent();
+		}
+		current = current->parent();
+	}
+	return current;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_find_predecessor_( Node * node ) -> Node *
+{
+	return const_cast<Node *>( s_find_predecessor_( static_cast<const Node *>( node ) ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+auto Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_find_predecessor_( const Node * node ) -> const Node *
+{
+	auto current = s_get_maximum_( static_cast<const Node *>( node->left ) );
+	if ( current == nullptr )
+	{
+		// climb while we come from the left subtree
+		current = node;
+		while ( current->parent() != nullptr && current->parent()->left == current )
+		{
+			current = current->parent();
+		}
+		current = current->parent();
+	}
+	return current;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_link_threads_( Node * prev, Node * node, Node * next )
+{
+	node->prev = prev;
+	node->next = next;
+	if ( prev != nullptr )
+	{
+		prev->next = node;
+	}
+	if ( next != nullptr )
+	{
+		next->prev = node;
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+void Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_thread_( Node * root )
+{
+	// Links the nodes of a tree made as a whole (built or copied) in key order, in O(n).
+	if constexpr ( Threaded )
+	{
+		Node * prev = nullptr;
+		for ( auto node = s_get_minimum_( root ); node != nullptr; node = s_find_successor_( node ) )
+		{
+			s_link_threads_( prev, node, nullptr );
+			prev = node;
+		}
+	}
+	else
+	{
+		static_cast<void>( root );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+std::string Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_format_line_( const Node * node )
+{
+	auto k = s_to_string_( node->key() );
+	auto p = ( node->parent() != nullptr ) ? s_to_string_( node->parent()->key() ) : "nul";
+	auto l = ( node->left != nullptr ) ? s_to_string_( node->left->key() ) : "nul";
+	auto r = ( node->right != nullptr ) ? s_to_string_( node->right->key() ) : "nul";
+	auto c = ( node->is_black() ) ? "B" : "R";
+	auto v = s_to_string_( node->value() ).substr( 0, 10 );
+
+	std::ostringstream line;
+	line << std::left << "K=" << std::setw( 3 ) << k << " PK=" << std::setw( 3 ) << p
+		<< " LK=" << std::setw( 3 ) << l << " RK=" << std::setw( 3 ) << r << " C=" << c << " V=" << v;
+	return line.str();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator, typename Augmentation, bool Threaded>
+template<typename Value>
+std::string Map<Key, T, Compare, Allocator, Augmentation, Threaded>::s_to_string_( const Value& value )
+{
+	// Keys and values are printed with operator<<; types without it are shown as '?'.
+	if constexpr ( IsStreamable<Value>::value )
+	{
+		std::ostringstream stream;
+		stream << value;
+		return stream.str();
+	}
+	else
+	{
+		return "?";
+	}
+}
+
+} // namespace EK
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace EK
+{
+
+class MappedFile
+{
+	// Read-only memory mapping of a whole file. Pages are read from the disk on the first access,
+	// so opening takes O(1) whatever the size of the file is.
+public:
+	MappedFile() = default;
+	explicit MappedFile( const std::string& path );
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+	MappedFile( MappedFile&& rhs ) noexcept;
+	MappedFile& operator=( MappedFile&& rhs ) noexcept;
+	~MappedFile();
+
+	const char * data() const;
+	std::size_t size() const;
+
+private:
+	const char * data_ = nullptr;
+	std::size_t size_ = 0;
+
+	void unmap_();
+};
+
+inline MappedFile::MappedFile( const std::string& path )
+{
+#ifdef _WIN32
+	auto file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( file == INVALID_HANDLE_VALUE )
+	{
+		throw std::runtime_error( "Cannot open " + path + "." );
+	}
+	LARGE_INTEGER size;
+	if ( !GetFileSizeEx( file, &size ) )
+	{
+		CloseHandle( file );
+		throw std::runtime_error( "Cannot get the size of " + path + "." );
+	}
+	size_ = static_cast<std::size_t>( size.QuadPart );
+	if ( size_ != 0 )
+	{
+		auto mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if ( mapping != nullptr )
+		{
+			data_ = static_cast<const char *>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+			CloseHandle( mapping ); // the view keeps the mapping
+		}
+	}
+	CloseHandle( file );
+#else
+	auto file = ::open( path.c_str(), O_RDONLY );
+	if ( file < 0 )
+	{
+		throw std::runtime_error( "Cannot open " + path + "." );
+	}
+	struct stat status;
+	if ( ::fstat( file, &status ) != 0 )
+	{
+		::close( file );
+		throw std::runtime_error( "Cannot get the size of " + path + "." );
+	}
+	size_ = static_cast<std::size_t>( status.st_size );
+	if ( size_ != 0 )
+	{
+		auto address = ::mmap( nullptr, size_, PROT_READ, MAP_SHARED, file, 0 );
+		data_ = ( address != MAP_FAILED ) ? static_cast<const char *>( address ) : nullptr;
+	}
+	::close( file ); // the mapping stays valid
+#endif
+	if ( size_ != 0 && data_ == nullptr )
+	{
+		throw std::runtime_error( "Cannot map " + path + " to memory." );
+	}
+}
+
+inline MappedFile::MappedFile( MappedFile&& rhs ) noexcept : data_( rhs.data_ ), size_( rhs.size_ )
+{
+	rhs.data_ = nullptr;
+	rhs.size_ = 0;
+}
+
+inline MappedFile& MappedFile::operator=( MappedFile&& rhs ) noexcept
+{
+	if ( this != &rhs )
+	{
+		unmap_();
+		data_ = std::exchange( rhs.data_, nullptr );
+		size_ = std::exchange( rhs.size_, 0 );
+	}
+	return *this;
+}
+
+inline MappedFile::~MappedFile()
+{
+	unmap_();
+}
+
+inline const char * MappedFile::data() const
+{
+	return data_;
+}
+
+inline std::size_t MappedFile::size() const
+{
+	return size_;
+}
+
+inline void MappedFile::unmap_()
+{
+	if ( data_ != nullptr )
+	{
+#ifdef _WIN32
+		UnmapViewOfFile( data_ );
+#else
+		::munmap( const_cast<char *>( data_ ), size_ );
+#endif
+		data_ = nullptr;
+		size_ = 0;
+	}
+}
+
+} // namespace EK
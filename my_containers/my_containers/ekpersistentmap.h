@@ -0,0 +1,673 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace EK
+{
+
+template<typename Key = int, typename T = std::string, typename Compare = std::less<Key>,
+		 typename Allocator = std::allocator<std::pair<const Key, T>>>
+class PersistentMap
+{
+	// Red-black tree of immutable nodes shared between versions of the map.
+	// A copy (or snapshot()) shares the root in O(1); insert() and erase() copy only the nodes on the path
+	// from the root (and the few nodes that are recolored or rotated), O(log n), so other versions never
+	// see the change. Nodes have atomic reference counts, so versions may be used by different threads
+	// (one version object is not synchronized, as any other container).
+	// Balancing follows the functional red-black trees of Okasaki (insertion) and Kahrs (deletion).
+	// Nodes have no parent links, so it is a separate class rather than a mode of EK::Map.
+	struct Node;
+
+	class NodePtr
+	{
+		// Intrusive reference to a node.
+	public:
+		NodePtr() = default;
+		explicit NodePtr( Node * node ); // adopts a new node with the count of 1
+		NodePtr( const NodePtr& rhs );
+		NodePtr( NodePtr&& rhs ) noexcept;
+		NodePtr& operator=( NodePtr rhs ) noexcept;
+		~NodePtr();
+
+		const Node * get() const { return node_; }
+		const Node * operator->() const { return node_; }
+		explicit operator bool() const { return node_ != nullptr; }
+
+	private:
+		Node * node_ = nullptr;
+	};
+
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using key_compare = Compare;
+	using allocator_type = Allocator;
+	using size_type = std::size_t;
+	using value_type = std::pair<const Key, T>;
+
+	class CIterator
+	{
+		// Iterators keep the path from the root, as nodes have no parent links.
+		// They stay valid while the version of the map they came from is alive and unchanged.
+		friend class PersistentMap;
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = PersistentMap::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type *;
+		using reference = const value_type&;
+
+		CIterator() = default;
+		CIterator& operator++();
+		CIterator operator++( int );
+		bool operator==( const CIterator& other ) const;
+		bool operator!=( const CIterator& other ) const;
+		reference operator*() const;
+		pointer operator->() const;
+	private:
+		std::vector<const Node *> stack_; // the current node on the top, then the ancestors still to visit
+		void push_left_path_( const Node * node );
+	};
+
+	PersistentMap() = default;
+	explicit PersistentMap( const Compare& compare );
+	PersistentMap( const std::initializer_list<std::pair<Key, T>>& list );
+	template<typename InputIt>
+	PersistentMap( InputIt first, InputIt last, const Compare& compare = Compare() );
+	PersistentMap( const PersistentMap& rhs ) = default; // O(1), shares the nodes
+	PersistentMap& operator=( const PersistentMap& rhs ) = default;
+	PersistentMap( PersistentMap&& rhs ) noexcept;
+	PersistentMap& operator=( PersistentMap&& rhs ) noexcept;
+	~PersistentMap() = default;
+
+	PersistentMap snapshot() const;
+
+	CIterator begin() const;
+	CIterator end() const;
+	CIterator find( const Key& key ) const;
+	std::size_t count( const Key& key ) const;
+	bool contains( const Key& key ) const;
+	const T& at( const Key& key ) const;
+	std::size_t size() const;
+	bool empty() const;
+
+	// insert() overwrites the value of an existing key, like EK::Map::insert().
+	void insert( const Key& key, const T& value );
+	void erase( const Key& key );
+	void clear();
+
+	key_compare key_comp() const;
+	std::string check_red_black_tree_properties() const;
+
+private:
+	using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+	using NodeTraits = std::allocator_traits<NodeAllocator>;
+	static_assert( NodeTraits::is_always_equal::value,
+		"nodes are freed by whichever version releases them last, so the allocator must be stateless" );
+
+	struct Node
+	{
+		std::atomic<std::size_t> references{ 1 };
+		bool is_black;
+		NodePtr left;
+		NodePtr right;
+		value_type data;
+
+		template<typename... Args>
+		Node( bool black, NodePtr l, NodePtr r, Args&&... args )
+			: is_black( black ), left( std::move( l ) ), right( std::move( r ) ), data( std::forward<Args>( args )... )
+		{
+		}
+		const Key& key() const { return data.first; }
+	};
+
+	NodePtr root_;
+	std::size_t counter_ = 0;
+	Compare compare_;
+
+	const Node * t_find_( const Key& key ) const;
+	NodePtr insert_( const NodePtr& node, const Key& key, const T& value, bool& inserted ) const;
+	NodePtr erase_( const NodePtr& node, const Key& key ) const;
+	int check_subtree_( const Node * node, std::string& errors ) const;
+
+	static NodePtr s_make_( bool black, NodePtr left, const value_type& data, NodePtr right );
+	static NodePtr s_balance_( NodePtr left, const value_type& data, NodePtr right );
+	static NodePtr s_balance_left_( NodePtr left, const value_type& data, NodePtr right );
+	static NodePtr s_balance_right_( NodePtr left, const value_type& data, NodePtr right );
+	static NodePtr s_append_( const NodePtr& left, const NodePtr& right );
+	static NodePtr s_recolor_( const NodePtr& node, bool black );
+	static bool s_is_red_( const NodePtr& node );
+	static bool s_is_black_( const NodePtr& node );
+	static void s_release_( Node * node );
+};
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+PersistentMap<Key, T, Compare, Allocator>::NodePtr::NodePtr( Node * node ) : node_( node )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+PersistentMap<Key, T, Compare, Allocator>::NodePtr::NodePtr( const NodePtr& rhs ) : node_( rhs.node_ )
+{
+	if ( node_ != nullptr )
+	{
+		node_->references.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+PersistentMap<Key, T, Compare, Allocator>::NodePtr::NodePtr( NodePtr&& rhs ) noexcept : node_( rhs.node_ )
+{
+	rhs.node_ = nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::NodePtr::operator=( NodePtr rhs ) noexcept -> NodePtr&
+{
+	std::swap( node_, rhs.node_ );
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+PersistentMap<Key, T, Compare, Allocator>::NodePtr::~NodePtr()
+{
+	if ( node_ != nullptr && node_->references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+	{
+		s_release_( node_ );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::CIterator::operator++() -> CIterator&
+{
+	auto node = stack_.back();
+	stack_.pop_back();
+	push_left_path_( node->right.get() );
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::CIterator::operator++( int ) -> CIterator
+{
+	auto result = *this;
+	++( *this );
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool PersistentMap<Key, T, Compare, Allocator>::CIterator::operator==( const CIterator& other ) const
+{
+	auto node = stack_.empty() ? nullptr : stack_.back();
+	auto other_node = other.stack_.empty() ? nullptr : other.stack_.back();
+	return node == other_node;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool PersistentMap<Key, T, Compare, Allocator>::CIterator::operator!=( const CIterator& other ) const
+{
+	return !( *this == other );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::CIterator::operator*() const -> reference
+{
+	if ( stack_.empty() )
+	{
+		throw std::out_of_range( "Iterator is out of range." );
+	}
+	return stack_.back()->data;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::CIterator::operator->() const -> pointer
+{
+	return &**this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void PersistentMap<Key, T, Compare, Allocator>::CIterator::push_left_path_( const Node * node )
+{
+	for ( ; node != nullptr; node = node->left.get() )
+	{
+		stack_.push_back( node );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+PersistentMap<Key, T, Compare, Allocator>::PersistentMap( const Compare& compare ) : compare_( compare )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+PersistentMap<Key, T, Compare, Allocator>::PersistentMap( const std::initializer_list<std::pair<Key, T>>& list )
+	: PersistentMap( list.begin(), list.end() )
+{
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+template<typename InputIt>
+PersistentMap<Key, T, Compare, Allocator>::PersistentMap( InputIt first, InputIt last, const Compare& compare )
+	: compare_( compare )
+{
+	for ( ; first != last; ++first )
+	{
+		insert( first->first, first->second );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+PersistentMap<Key, T, Compare, Allocator>::PersistentMap( PersistentMap&& rhs ) noexcept
+	: root_( std::move( rhs.root_ ) ), counter_( rhs.counter_ ), compare_( std::move( rhs.compare_ ) )
+{
+	rhs.counter_ = 0;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::operator=( PersistentMap&& rhs ) noexcept -> PersistentMap&
+{
+	if ( this != &rhs )
+	{
+		root_ = std::move( rhs.root_ );
+		counter_ = rhs.counter_;
+		compare_ = std::move( rhs.compare_ );
+		rhs.counter_ = 0;
+	}
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::snapshot() const -> PersistentMap
+{
+	return *this;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::begin() const -> CIterator
+{
+	CIterator iter;
+	iter.push_left_path_( root_.get() );
+	return iter;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::end() const -> CIterator
+{
+	return CIterator();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::find( const Key& key ) const -> CIterator
+{
+	// ancestors are kept only where the path goes left, they come after the found node
+	CIterator iter;
+	auto current = root_.get();
+	while ( current != nullptr )
+	{
+		if ( compare_( key, current->key() ) )
+		{
+			iter.stack_.push_back( current );
+			current = current->left.get();
+		}
+		else if ( compare_( current->key(), key ) )
+		{
+			current = current->right.get();
+		}
+		else
+		{
+			iter.stack_.push_back( current );
+			return iter;
+		}
+	}
+	return end();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::size_t PersistentMap<Key, T, Compare, Allocator>::count( const Key& key ) const
+{
+	return ( t_find_( key ) != nullptr ) ? 1 : 0;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool PersistentMap<Key, T, Compare, Allocator>::contains( const Key& key ) const
+{
+	return t_find_( key ) != nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+const T& PersistentMap<Key, T, Compare, Allocator>::at( const Key& key ) const
+{
+	auto node = t_find_( key );
+	if ( node == nullptr )
+	{
+		throw std::out_of_range( "Key is absent." );
+	}
+	return node->data.second;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::size_t PersistentMap<Key, T, Compare, Allocator>::size() const
+{
+	return counter_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool PersistentMap<Key, T, Compare, Allocator>::empty() const
+{
+	return counter_ == 0;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void PersistentMap<Key, T, Compare, Allocator>::insert( const Key& key, const T& value )
+{
+	bool inserted = false;
+	root_ = s_recolor_( insert_( root_, key, value, inserted ), true );
+	if ( inserted )
+	{
+		++counter_;
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void PersistentMap<Key, T, Compare, Allocator>::erase( const Key& key )
+{
+	if ( t_find_( key ) == nullptr )
+	{
+		return; // nothing is copied
+	}
+	root_ = s_recolor_( erase_( root_, key ), true );
+	--counter_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void PersistentMap<Key, T, Compare, Allocator>::clear()
+{
+	root_ = NodePtr();
+	counter_ = 0;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+Compare PersistentMap<Key, T, Compare, Allocator>::key_comp() const
+{
+	return compare_;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::string PersistentMap<Key, T, Compare, Allocator>::check_red_black_tree_properties() const
+{
+	// the same properties as EK::Map checks, see Map::check_red_black_tree_properties()
+	std::string result;
+	if ( s_is_red_( root_ ) )
+	{
+		result.append( "Property 2 is violated: Root is not black.\n" );
+	}
+	check_subtree_( root_.get(), result );
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::t_find_( const Key& key ) const -> const Node *
+{
+	auto current = root_.get();
+	while ( current != nullptr )
+	{
+		if ( compare_( key, current->key() ) )
+		{
+			current = current->left.get();
+		}
+		else if ( compare_( current->key(), key ) )
+		{
+			current = current->right.get();
+		}
+		else
+		{
+			return current;
+		}
+	}
+	return nullptr;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::insert_( const NodePtr& node, const Key& key, const T& value,
+	bool& inserted ) const -> NodePtr
+{
+	// returns the new version of the subtree, its root may be red with a red child
+	if ( !node )
+	{
+		inserted = true;
+		return s_make_( false, NodePtr(), value_type( key, value ), NodePtr() );
+	}
+	if ( compare_( key, node->key() ) )
+	{
+		auto left = insert_( node->left, key, value, inserted );
+		return node->is_black ? s_balance_( std::move( left ), node->data, node->right )
+			: s_make_( false, std::move( left ), node->data, node->right );
+	}
+	if ( compare_( node->key(), key ) )
+	{
+		auto right = insert_( node->right, key, value, inserted );
+		return node->is_black ? s_balance_( node->left, node->data, std::move( right ) )
+			: s_make_( false, node->left, node->data, std::move( right ) );
+	}
+	return s_make_( node->is_black, node->left, value_type( node->key(), value ), node->right );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::erase_( const NodePtr& node, const Key& key ) const -> NodePtr
+{
+	// The key is present. Deleting from a black subtree lowers its black height by one,
+	// s_balance_left_() and s_balance_right_() restore it.
+	if ( compare_( key, node->key() ) )
+	{
+		auto left = erase_( node->left, key );
+		return s_is_black_( node->left ) ? s_balance_left_( std::move( left ), node->data, node->right )
+			: s_make_( false, std::move( left ), node->data, node->right );
+	}
+	if ( compare_( node->key(), key ) )
+	{
+		auto right = erase_( node->right, key );
+		return s_is_black_( node->right ) ? s_balance_right_( node->left, node->data, std::move( right ) )
+			: s_make_( false, node->left, node->data, std::move( right ) );
+	}
+	return s_append_( node->left, node->right );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+int PersistentMap<Key, T, Compare, Allocator>::check_subtree_( const Node * node, std::string& errors ) const
+{
+	// returns the black height of the subtree or -1 if the children heights differ
+	if ( node == nullptr )
+	{
+		return 0;
+	}
+	if ( !node->is_black && ( s_is_red_( node->left ) || s_is_red_( node->right ) ) )
+	{
+		errors += "Property 4 is violated: a red node has a red child.\n";
+	}
+	if ( ( node->left && !compare_( node->left->key(), node->key() ) )
+		|| ( node->right && !compare_( node->key(), node->right->key() ) ) )
+	{
+		errors += "Keys are out of order.\n";
+	}
+	auto left = check_subtree_( node->left.get(), errors );
+	auto right = check_subtree_( node->right.get(), errors );
+	if ( left < 0 || right < 0 )
+	{
+		return -1;
+	}
+	if ( left != right )
+	{
+		errors += "Property 5 is violated: black heights of subtrees differ.\n";
+		return -1;
+	}
+	return left + ( node->is_black ? 1 : 0 );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::s_make_( bool black, NodePtr left, const value_type& data,
+	NodePtr right ) -> NodePtr
+{
+	NodeAllocator alloc;
+	auto node = NodeTraits::allocate( alloc, 1 );
+	try
+	{
+		NodeTraits::construct( alloc, node, black, std::move( left ), std::move( right ), data );
+	}
+	catch ( ... )
+	{
+		NodeTraits::deallocate( alloc, node, 1 );
+		throw;
+	}
+	return NodePtr( node );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::s_balance_( NodePtr a, const value_type& x, NodePtr b ) -> NodePtr
+{
+	// A black node with children a and b, where one of them may be red with a red child
+	// (or both may be red after deletion).
+	if ( s_is_red_( a ) && s_is_red_( b ) )
+	{
+		return s_make_( false, s_recolor_( a, true ), x, s_recolor_( b, true ) );
+	}
+	if ( s_is_red_( a ) && s_is_red_( a->left ) )
+	{
+		return s_make_( false, s_recolor_( a->left, true ), a->data, s_make_( true, a->right, x, std::move( b ) ) );
+	}
+	if ( s_is_red_( a ) && s_is_red_( a->right ) )
+	{
+		auto& ar = a->right;
+		return s_make_( false, s_make_( true, a->left, a->data, ar->left ), ar->data, s_make_( true, ar->right, x, std::move( b ) ) );
+	}
+	if ( s_is_red_( b ) && s_is_red_( b->right ) )
+	{
+		return s_make_( false, s_make_( true, std::move( a ), x, b->left ), b->data, s_recolor_( b->right, true ) );
+	}
+	if ( s_is_red_( b ) && s_is_red_( b->left ) )
+	{
+		auto& bl = b->left;
+		return s_make_( false, s_make_( true, std::move( a ), x, bl->left ), bl->data, s_make_( true, bl->right, b->data, b->right ) );
+	}
+	return s_make_( true, std::move( a ), x, std::move( b ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::s_balance_left_( NodePtr a, const value_type& x, NodePtr b ) -> NodePtr
+{
+	// the left subtree a has lost one black level
+	if ( s_is_red_( a ) )
+	{
+		return s_make_( false, s_recolor_( a, true ), x, std::move( b ) );
+	}
+	if ( s_is_black_( b ) )
+	{
+		return s_balance_( std::move( a ), x, s_recolor_( b, false ) );
+	}
+	if ( s_is_red_( b ) && s_is_black_( b->left ) )
+	{
+		auto& bl = b->left;
+		return s_make_( false, s_make_( true, std::move( a ), x, bl->left ), bl->data,
+			s_balance_( bl->right, b->data, s_recolor_( b->right, false ) ) );
+	}
+	throw std::logic_error( "EK::PersistentMap: red-black invariant is broken" );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::s_balance_right_( NodePtr a, const value_type& x, NodePtr b ) -> NodePtr
+{
+	// the right subtree b has lost one black level
+	if ( s_is_red_( b ) )
+	{
+		return s_make_( false, std::move( a ), x, s_recolor_( b, true ) );
+	}
+	if ( s_is_black_( a ) )
+	{
+		return s_balance_( s_recolor_( a, false ), x, std::move( b ) );
+	}
+	if ( s_is_red_( a ) && s_is_black_( a->right ) )
+	{
+		auto& ar = a->right;
+		return s_make_( false, s_balance_( s_recolor_( a->left, false ), a->data, ar->left ), ar->data,
+			s_make_( true, ar->right, x, std::move( b ) ) );
+	}
+	throw std::logic_error( "EK::PersistentMap: red-black invariant is broken" );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::s_append_( const NodePtr& a, const NodePtr& b ) -> NodePtr
+{
+	// joins the children of a deleted node: all keys of a are less than keys of b, black heights are equal
+	if ( !a )
+	{
+		return b;
+	}
+	if ( !b )
+	{
+		return a;
+	}
+	if ( s_is_red_( a ) && s_is_red_( b ) )
+	{
+		auto middle = s_append_( a->right, b->left );
+		if ( s_is_red_( middle ) )
+		{
+			return s_make_( false, s_make_( false, a->left, a->data, middle->left ), middle->data,
+				s_make_( false, middle->right, b->data, b->right ) );
+		}
+		return s_make_( false, a->left, a->data, s_make_( false, std::move( middle ), b->data, b->right ) );
+	}
+	if ( s_is_black_( a ) && s_is_black_( b ) )
+	{
+		auto middle = s_append_( a->right, b->left );
+		if ( s_is_red_( middle ) )
+		{
+			return s_make_( false, s_make_( true, a->left, a->data, middle->left ), middle->data,
+				s_make_( true, middle->right, b->data, b->right ) );
+		}
+		return s_balance_left_( a->left, a->data, s_make_( true, std::move( middle ), b->data, b->right ) );
+	}
+	if ( s_is_red_( b ) )
+	{
+		return s_make_( false, s_append_( a, b->left ), b->data, b->right );
+	}
+	return s_make_( false, a->left, a->data, s_append_( a->right, b ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto PersistentMap<Key, T, Compare, Allocator>::s_recolor_( const NodePtr& node, bool black ) -> NodePtr
+{
+	if ( !node || node->is_black == black )
+	{
+		return node;
+	}
+	return s_make_( black, node->left, node->data, node->right );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool PersistentMap<Key, T, Compare, Allocator>::s_is_red_( const NodePtr& node )
+{
+	return node && !node->is_black;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool PersistentMap<Key, T, Compare, Allocator>::s_is_black_( const NodePtr& node )
+{
+	return node && node->is_black;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void PersistentMap<Key, T, Compare, Allocator>::s_release_( Node * node )
+{
+	// Children are released by the destructor of the node, the recursion depth is bounded by the height.
+	NodeAllocator alloc;
+	NodeTraits::destroy( alloc, node );
+	NodeTraits::deallocate( alloc, node, 1 );
+}
+
+} // namespace EK
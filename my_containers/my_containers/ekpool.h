@@ -0,0 +1,542 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace EK
+{
+
+template<typename T, typename Allocator = std::allocator<T>>
+class Pool
+{
+	// Slab allocator for objects of one type.
+	// Memory is taken from Allocator in slabs of growing size and is never given back one object at a time:
+	// destroyed objects go to a free list and are reused by the next create().
+	// All slabs are returned to Allocator at once by release() or by the destructor.
+	// Objects can move between pools without copying: detach() takes an object out of a pool and attach() gives it
+	// to another one. A slab is shared by all pools that hold its objects and is returned with the last of them.
+public:
+	class Detached;
+
+	explicit Pool( const Allocator& alloc = Allocator() );
+	Pool( const Pool& ) = delete;
+	Pool& operator=( const Pool& ) = delete;
+	Pool( Pool&& rhs ) noexcept;
+	// Takes the allocator of 'rhs' only if it propagates on move assignment; the slabs of 'rhs'
+	// are taken anyway, as every slab is freed by the allocator it came from.
+	Pool& operator=( Pool&& rhs ) noexcept;
+	~Pool();
+
+	template<typename... Args>
+	T * create( Args&&... args );
+	void destroy( T * object );
+	void release();
+	// Takes all slabs of 'other', so objects created by it are owned by this pool; 'other' becomes empty.
+	// Both pools must have equal allocators. It takes O(number of free slots of 'other').
+	void splice( Pool& other );
+	// Hands 'count' objects of 'other' to this pool where they are: the pools share all slabs of 'other'
+	// from now on, and the objects are destroyed by this pool. Both pools must have equal allocators.
+	// It takes O(number of slabs of both pools). A shared slab is returned to Allocator only when both
+	// pools have released it, and recycle() does nothing while any slab is shared.
+	void share( Pool& other, std::size_t count );
+	// Both take O(log(number of slabs)). The object stays alive and keeps its address.
+	Detached detach( T * object );
+	T * attach( Detached&& detached );
+	// Makes room for n more objects with at most one new slab, so a batch of creations takes one allocation.
+	void reserve( std::size_t n );
+	// When no object is alive and no slab is shared, the free slots are reordered by address,
+	// so the next creations fill the slabs in order as if they were new. It takes O(capacity).
+	void recycle();
+
+	Allocator get_allocator() const;
+	std::size_t size() const;
+	std::size_t capacity() const;
+	std::size_t slab_count() const;
+
+private:
+	union Slot
+	{
+		Slot * next;
+		alignas( T ) unsigned char storage[sizeof( T )];
+	};
+
+	using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+	using SlotTraits = std::allocator_traits<SlotAllocator>;
+
+	struct SlabDeleter
+	{
+		SlotAllocator alloc;
+		std::size_t count;
+		void operator()( Slot * slots ) { SlotTraits::deallocate( alloc, slots, count ); }
+	};
+
+	struct Slab
+	{
+		std::shared_ptr<Slot> slots; // shared with other pools that hold objects of the slab
+		std::size_t count = 0;
+	};
+
+public:
+	class Detached
+	{
+		// An object taken out of a pool. It keeps the slab of the object allocated.
+		// If it is not given to a pool, the object is destroyed with it and its slot goes back to the free list
+		// of the pool it came from; if that pool is gone or holds the slab no more, the slot is freed with the slab.
+		friend class Pool;
+	public:
+		Detached() = default;
+		Detached( Detached&& rhs ) noexcept;
+		Detached& operator=( Detached&& rhs ) noexcept;
+		~Detached();
+		T * get() const;
+	private:
+		T * object_ = nullptr;
+		Slab slab_;
+		std::shared_ptr<Pool *> origin_; // the pool it came from, nullptr when that pool is gone
+		Detached( T * object, Slab slab, std::shared_ptr<Pool *> origin );
+		void reset_();
+	};
+
+private:
+
+	static constexpr std::size_t first_slab_size_ = 16;
+	static constexpr std::size_t max_slab_size_ = 4096;
+
+	SlotAllocator alloc_;
+	std::vector<Slab> slabs_;
+	Slot * free_list_ = nullptr;
+	Slot * cursor_ = nullptr; // next never used slot of the last slab
+	Slot * cursor_end_ = nullptr;
+	std::size_t live_ = 0;
+	std::size_t capacity_ = 0;
+	std::size_t free_count_ = 0; // length of free_list_
+	std::size_t last_slab_size_ = 0; // slabs grow from it
+	// Shared with the objects detached from this pool: it follows the pool when it moves and is reset
+	// when the pool is destroyed. Made by the first detach().
+	std::shared_ptr<Pool *> self_;
+
+	Slot * allocate_slot_();
+	void add_slab_( std::size_t count );
+	void free_cursor_slots_();
+	// slabs_ are sorted by address, so the slab of an object is found by a binary search
+	typename std::vector<Slab>::iterator find_slab_( const void * object );
+	void insert_slab_( Slab slab );
+	// takes back the slot of a dropped detached object
+	void free_detached_( T * object );
+};
+
+template<typename T, typename Allocator>
+Pool<T, Allocator>::Detached::Detached( T * object, Slab slab, std::shared_ptr<Pool *> origin )
+	: object_( object ), slab_( std::move( slab ) ), origin_( std::move( origin ) )
+{
+}
+
+template<typename T, typename Allocator>
+Pool<T, Allocator>::Detached::Detached( Detached&& rhs ) noexcept
+	: object_( rhs.object_ ), slab_( std::move( rhs.slab_ ) ), origin_( std::move( rhs.origin_ ) )
+{
+	rhs.object_ = nullptr;
+}
+
+template<typename T, typename Allocator>
+auto Pool<T, Allocator>::Detached::operator=( Detached&& rhs ) noexcept -> Detached&
+{
+	if ( this != &rhs )
+	{
+		reset_();
+		object_ = rhs.object_;
+		slab_ = std::move( rhs.slab_ );
+		origin_ = std::move( rhs.origin_ );
+		rhs.object_ = nullptr;
+	}
+	return *this;
+}
+
+template<typename T, typename Allocator>
+Pool<T, Allocator>::Detached::~Detached()
+{
+	reset_();
+}
+
+template<typename T, typename Allocator>
+T * Pool<T, Allocator>::Detached::get() const
+{
+	return object_;
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::Detached::reset_()
+{
+	if ( object_ != nullptr )
+	{
+		object_->~T();
+		if ( origin_ != nullptr && *origin_ != nullptr )
+		{
+			( *origin_ )->free_detached_( object_ );
+		}
+		object_ = nullptr;
+	}
+	slab_ = Slab();
+	origin_.reset();
+}
+
+template<typename T, typename Allocator>
+Pool<T, Allocator>::Pool( const Allocator& alloc ) : alloc_( alloc )
+{
+}
+
+template<typename T, typename Allocator>
+Pool<T, Allocator>::Pool( Pool&& rhs ) noexcept
+	: alloc_( std::move( rhs.alloc_ ) ), slabs_( std::move( rhs.slabs_ ) ), free_list_( rhs.free_list_ ),
+	cursor_( rhs.cursor_ ), cursor_end_( rhs.cursor_end_ ), live_( rhs.live_ ), capacity_( rhs.capacity_ ),
+	free_count_( rhs.free_count_ ), last_slab_size_( rhs.last_slab_size_ ), self_( std::move( rhs.self_ ) )
+{
+	if ( self_ != nullptr )
+	{
+		*self_ = this;
+	}
+	rhs.slabs_.clear();
+	rhs.free_list_ = nullptr;
+	rhs.cursor_ = nullptr;
+	rhs.cursor_end_ = nullptr;
+	rhs.live_ = 0;
+	rhs.capacity_ = 0;
+	rhs.free_count_ = 0;
+	rhs.last_slab_size_ = 0;
+}
+
+template<typename T, typename Allocator>
+Pool<T, Allocator>& Pool<T, Allocator>::operator=( Pool&& rhs ) noexcept
+{
+	if ( this != &rhs )
+	{
+		release();
+		if ( self_ != nullptr )
+		{
+			*self_ = nullptr; // the slabs of objects detached from us are gone from here
+		}
+		self_ = std::move( rhs.self_ );
+		if ( self_ != nullptr )
+		{
+			*self_ = this;
+		}
+		// every slab is freed by the allocator it came from, so a pool that keeps its allocator can take them
+		if constexpr ( SlotTraits::propagate_on_container_move_assignment::value )
+		{
+			alloc_ = std::move( rhs.alloc_ );
+		}
+		slabs_ = std::move( rhs.slabs_ );
+		free_list_ = rhs.free_list_;
+		cursor_ = rhs.cursor_;
+		cursor_end_ = rhs.cursor_end_;
+		live_ = rhs.live_;
+		capacity_ = rhs.capacity_;
+		free_count_ = rhs.free_count_;
+		last_slab_size_ = rhs.last_slab_size_;
+
+		rhs.slabs_.clear();
+		rhs.free_list_ = nullptr;
+		rhs.cursor_ = nullptr;
+		rhs.cursor_end_ = nullptr;
+		rhs.live_ = 0;
+		rhs.capacity_ = 0;
+		rhs.free_count_ = 0;
+		rhs.last_slab_size_ = 0;
+	}
+	return *this;
+}
+
+template<typename T, typename Allocator>
+Pool<T, Allocator>::~Pool()
+{
+	if ( self_ != nullptr )
+	{
+		*self_ = nullptr;
+	}
+	release();
+}
+
+template<typename T, typename Allocator>
+template<typename... Args>
+T * Pool<T, Allocator>::create( Args&&... args )
+{
+	auto slot = allocate_slot_();
+	try
+	{
+		auto object = ::new( static_cast<void *>( slot->storage ) ) T( std::forward<Args>( args )... );
+		++live_;
+		return object;
+	}
+	catch ( ... )
+	{
+		slot->next = free_list_;
+		free_list_ = slot;
+		++free_count_;
+		throw;
+	}
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::destroy( T * object )
+{
+	if ( object == nullptr )
+	{
+		return;
+	}
+	object->~T();
+	auto slot = reinterpret_cast<Slot *>( object );
+	slot->next = free_list_;
+	free_list_ = slot;
+	++free_count_;
+	--live_;
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::release()
+{
+	// Objects that are still alive are not destroyed here: the owner must destroy them before.
+	// Slabs shared with other pools stay allocated until they are released there.
+	slabs_.clear();
+	free_list_ = nullptr;
+	cursor_ = nullptr;
+	cursor_end_ = nullptr;
+	live_ = 0;
+	capacity_ = 0;
+	free_count_ = 0;
+	last_slab_size_ = 0;
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::splice( Pool& other )
+{
+	if ( this == &other )
+	{
+		return;
+	}
+	for ( auto& slab : other.slabs_ )
+	{
+		insert_slab_( std::move( slab ) );
+	}
+
+	// never used slots of the other last slab go to the free list, our own cursor stays
+	other.free_cursor_slots_();
+	while ( other.free_list_ != nullptr )
+	{
+		auto slot = other.free_list_;
+		other.free_list_ = slot->next;
+		slot->next = free_list_;
+		free_list_ = slot;
+	}
+	free_count_ += other.free_count_;
+	live_ += other.live_;
+
+	other.slabs_.clear();
+	other.cursor_ = nullptr;
+	other.cursor_end_ = nullptr;
+	other.live_ = 0;
+	other.capacity_ = 0;
+	other.free_count_ = 0;
+	other.last_slab_size_ = 0;
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::share( Pool& other, std::size_t count )
+{
+	if ( this == &other )
+	{
+		return;
+	}
+	for ( auto& slab : other.slabs_ )
+	{
+		insert_slab_( slab );
+	}
+	other.live_ -= count;
+	live_ += count;
+}
+
+template<typename T, typename Allocator>
+auto Pool<T, Allocator>::detach( T * object ) -> Detached
+{
+	// the slot doesn't go to the free list: the object still lives in it
+	auto slab = find_slab_( object );
+	assert( slab != slabs_.end() && "the object was not created by this pool" );
+	if ( self_ == nullptr )
+	{
+		self_ = std::allocate_shared<Pool *>( alloc_, this );
+	}
+	--live_;
+	return Detached( object, *slab, self_ );
+}
+
+template<typename T, typename Allocator>
+T * Pool<T, Allocator>::attach( Detached&& detached )
+{
+	auto object = detached.object_;
+	if ( object == nullptr )
+	{
+		return nullptr;
+	}
+	if ( find_slab_( object ) == slabs_.end() )
+	{
+		insert_slab_( std::move( detached.slab_ ) );
+	}
+	detached.object_ = nullptr;
+	detached.slab_ = Slab();
+	detached.origin_.reset();
+	++live_;
+	return object;
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::reserve( std::size_t n )
+{
+	auto available = free_count_ + static_cast<std::size_t>( cursor_end_ - cursor_ );
+	if ( available >= n )
+	{
+		return;
+	}
+	// the rest of the current slab is kept in the free list, the new slab takes the cursor
+	free_cursor_slots_();
+	add_slab_( n - free_count_ );
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::recycle()
+{
+	if ( live_ != 0 || std::any_of( slabs_.begin(), slabs_.end(),
+		[]( const Slab& slab ) { return slab.slots.use_count() != 1; } ) )
+	{
+		return;
+	}
+	free_list_ = nullptr;
+	cursor_ = nullptr;
+	cursor_end_ = nullptr;
+	for ( auto slab = slabs_.rbegin(); slab != slabs_.rend(); ++slab )
+	{
+		for ( auto slot = slab->slots.get() + slab->count; slot != slab->slots.get(); )
+		{
+			--slot;
+			slot->next = free_list_;
+			free_list_ = slot;
+		}
+	}
+	free_count_ = capacity_;
+}
+
+template<typename T, typename Allocator>
+Allocator Pool<T, Allocator>::get_allocator() const
+{
+	return Allocator( alloc_ );
+}
+
+template<typename T, typename Allocator>
+std::size_t Pool<T, Allocator>::size() const
+{
+	return live_;
+}
+
+template<typename T, typename Allocator>
+std::size_t Pool<T, Allocator>::capacity() const
+{
+	return capacity_;
+}
+
+template<typename T, typename Allocator>
+std::size_t Pool<T, Allocator>::slab_count() const
+{
+	return slabs_.size();
+}
+
+template<typename T, typename Allocator>
+typename Pool<T, Allocator>::Slot * Pool<T, Allocator>::allocate_slot_()
+{
+	if ( free_list_ != nullptr )
+	{
+		auto slot = free_list_;
+		free_list_ = slot->next;
+		--free_count_;
+		return slot;
+	}
+	if ( cursor_ == cursor_end_ )
+	{
+		auto count = ( last_slab_size_ == 0 ) ? first_slab_size_ : last_slab_size_ * 2;
+		add_slab_( ( count > max_slab_size_ ) ? max_slab_size_ : count );
+	}
+	return cursor_++;
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::free_cursor_slots_()
+{
+	for ( ; cursor_ != cursor_end_; ++cursor_ )
+	{
+		cursor_->next = free_list_;
+		free_list_ = cursor_;
+		++free_count_;
+	}
+	cursor_ = nullptr;
+	cursor_end_ = nullptr;
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::add_slab_( std::size_t count )
+{
+	slabs_.reserve( slabs_.size() + 1 );
+	auto slots = SlotTraits::allocate( alloc_, count );
+	// the control block is taken from the same allocator; the slab is freed if that fails
+	std::shared_ptr<Slot> owner( slots, SlabDeleter{ alloc_, count }, alloc_ );
+	insert_slab_( { std::move( owner ), count } );
+	cursor_ = slots;
+	cursor_end_ = slots + count;
+	last_slab_size_ = count;
+}
+
+template<typename T, typename Allocator>
+auto Pool<T, Allocator>::find_slab_( const void * object ) -> typename std::vector<Slab>::iterator
+{
+	// the last slab that starts at or before the object, if the object lies in it
+	auto slot = static_cast<const Slot *>( object );
+	auto iter = std::upper_bound( slabs_.begin(), slabs_.end(), slot,
+		[]( const Slot * s, const Slab& slab ) { return std::less<const Slot *>()( s, slab.slots.get() ); } );
+	if ( iter == slabs_.begin() )
+	{
+		return slabs_.end();
+	}
+	--iter;
+	return std::less<const Slot *>()( slot, iter->slots.get() + iter->count ) ? iter : slabs_.end();
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::insert_slab_( Slab slab )
+{
+	// a slab that is already here (shared with a spliced pool) is kept once
+	if ( find_slab_( slab.slots.get() ) != slabs_.end() )
+	{
+		return;
+	}
+	auto iter = std::upper_bound( slabs_.begin(), slabs_.end(), slab.slots.get(),
+		[]( const Slot * s, const Slab& other ) { return std::less<const Slot *>()( s, other.slots.get() ); } );
+	capacity_ += slab.count;
+	slabs_.insert( iter, std::move( slab ) );
+}
+
+template<typename T, typename Allocator>
+void Pool<T, Allocator>::free_detached_( T * object )
+{
+	// a slab that was released meanwhile is freed by the last one who holds it
+	if ( find_slab_( object ) == slabs_.end() )
+	{
+		return;
+	}
+	auto slot = reinterpret_cast<Slot *>( object );
+	slot->next = free_list_;
+	free_list_ = slot;
+	++free_count_;
+}
+
+} // namespace EK
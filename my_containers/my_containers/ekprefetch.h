@@ -0,0 +1,21 @@
+#pragma once
+
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#include <xmmintrin.h>
+#endif
+
+namespace EK
+{
+
+// Asks the CPU to bring the cache line at 'address' in advance. It is only a hint: the address may be
+// invalid, nothing is read from it.
+inline void prefetch( const void * address )
+{
+#if defined( _MSC_VER ) && !defined( __clang__ )
+	_mm_prefetch( static_cast<const char *>( address ), _MM_HINT_T0 );
+#else
+	__builtin_prefetch( address );
+#endif
+}
+
+} // namespace EK
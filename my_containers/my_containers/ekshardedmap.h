@@ -0,0 +1,576 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ekconcurrentmap.h"
+
+namespace EK
+{
+
+template<typename Key = int, typename T = std::string, typename Compare = std::less<Key>,
+		 typename Allocator = std::allocator<std::pair<const Key, T>>>
+class ShardedMap
+{
+	// Map for many writers: the key space is split into ranges, each range is a shard with a tree
+	// and a lock of its own, so writers of different ranges don't contend.
+	// Operations find the shard of a key by the boundaries of the ranges (the layout) and lock that
+	// shard only. The layout is immutable; rebalancing publishes a new one and frees the old one
+	// after the operations that were routing by it are gone (see ReadIndicator). A shard knows its
+	// own range, so an operation that was routed by an old layout notices it under the shard lock
+	// and routes again.
+	// A shard grows hot when it holds much more than its share of the elements (with ascending keys
+	// every insertion goes to the last shard). Then the upper half of its range moves to a free shard;
+	// if no shard is free, the neighbouring pair of ranges with the least elements is merged first.
+	// The trees of the shards keep subtree sizes, so the median of the hot shard is found by select();
+	// a split cuts the tree there and a merge joins two trees, both in O(log n) and without copies
+	// or allocations of nodes.
+public:
+	using map_type = Map<Key, T, Compare, Allocator>;
+
+	// All elements are in one shard until it grows hot.
+	explicit ShardedMap( std::size_t shard_count = 16, const Compare& compare = Compare() );
+	// Splits 'map' into 'shard_count' shards of equal sizes.
+	ShardedMap( const map_type& map, std::size_t shard_count );
+	ShardedMap( const ShardedMap& ) = delete;
+	ShardedMap& operator=( const ShardedMap& ) = delete;
+	~ShardedMap();
+
+	// Readers copy values out, as the element may be erased right after the shard is unlocked.
+	std::optional<T> find( const Key& key ) const;
+	T at( const Key& key ) const;
+	bool contains( const Key& key ) const;
+	std::size_t size() const;
+	std::size_t shard_count() const;
+	// Sizes of the shards in key order, 0 for free shards at the end.
+	std::vector<std::size_t> shard_sizes() const;
+	// Statistics of the shards in key order (see Map::statistics()), without free shards.
+	std::vector<MapStatistics> shard_statistics() const;
+	// A consistent copy: all shards are locked while it is made.
+	map_type snapshot() const;
+	// Runs f( const Key&, const T& ) on the elements in ascending key order, locking one shard at a time.
+	// It is weakly consistent: the elements that are in the map during the whole call are visited once,
+	// the ones inserted or erased meanwhile may be visited or not. f must not change this map.
+	template<typename F>
+	void for_each( F&& f ) const;
+
+	void insert( const Key& key, const T& value );
+	bool erase( const Key& key );
+	void clear();
+	// Spreads the elements over all shards evenly, which a bulk erasure may call for.
+	void rebalance();
+
+private:
+	using shard_map_type = Map<Key, T, Compare, Allocator, OrderStatistics>;
+
+	struct alignas( 64 ) Shard
+	{
+		mutable std::shared_mutex mutex;
+		shard_map_type map;
+		bool in_use = false; // a free shard has no range
+		std::optional<Key> low; // the range of the shard is [low, high), no value is no bound
+		std::optional<Key> high;
+		std::atomic<std::size_t> size{ 0 }; // size of 'map', read without the lock by the hot shard check
+		std::size_t insertions = 0;
+	};
+
+	struct Layout
+	{
+		std::vector<Key> boundaries; // the least keys of ranges 1, 2, ...
+		std::vector<std::size_t> shards; // the shard of each range
+	};
+
+	using Locks = std::vector<std::unique_lock<std::shared_mutex>>;
+
+	static constexpr std::size_t s_hot_check_period_ = 1024; // insertions into a shard between checks
+	static constexpr std::size_t s_hot_factor_ = 2; // a hot shard holds more than twice its share
+	static constexpr std::size_t s_min_hot_size_ = 4096;
+
+	Compare compare_;
+	std::vector<Shard> shards_;
+	std::atomic<const Layout *> layout_; // changes under rebalance_mutex_ and the locks of all shards
+	mutable std::array<ReadIndicator, 2> route_indicators_;
+	std::atomic<unsigned> version_index_{ 0 }; // the route indicator for new operations
+	std::mutex rebalance_mutex_;
+
+	// nullptr instead of a key stands for the least keys, that is the first range
+	std::size_t route_( const Key * key ) const;
+	bool in_range_( const Shard& shard, const Key * key ) const;
+	template<typename F>
+	auto t_read_( const Key * key, F&& f ) const;
+	template<typename F>
+	auto t_write_( const Key& key, F&& f );
+	bool is_hot_( std::size_t size ) const;
+	Locks lock_all_() const;
+	void split_hot_( std::size_t hot );
+	void even_out_();
+	void publish_( std::vector<std::size_t> ranges, Locks& locks );
+	void wait_for_routes_();
+};
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+ShardedMap<Key, T, Compare, Allocator>::ShardedMap( std::size_t shard_count, const Compare& compare )
+	: compare_( compare ), shards_( std::max<std::size_t>( shard_count, 1 ) ), layout_( new Layout{ {}, { 0 } } )
+{
+	for ( auto& shard : shards_ )
+	{
+		shard.map = shard_map_type( compare_ );
+	}
+	shards_[0].in_use = true;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+ShardedMap<Key, T, Compare, Allocator>::ShardedMap( const map_type& map, std::size_t shard_count )
+	: ShardedMap( shard_count, map.key_comp() )
+{
+	shards_[0].size.store( map.size() );
+	shards_[0].map = shard_map_type( map.begin(), map.end(), compare_, map.get_allocator() );
+	even_out_();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+ShardedMap<Key, T, Compare, Allocator>::~ShardedMap()
+{
+	delete layout_.load();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::optional<T> ShardedMap<Key, T, Compare, Allocator>::find( const Key& key ) const
+{
+	return t_read_( &key, [&key]( const shard_map_type& map ) -> std::optional<T> {
+		auto iter = map.find( key );
+		if ( iter == map.end() )
+		{
+			return std::nullopt;
+		}
+		return iter->second;
+	} );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+T ShardedMap<Key, T, Compare, Allocator>::at( const Key& key ) const
+{
+	return t_read_( &key, [&key]( const shard_map_type& map ) -> T { return map.at( key ); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool ShardedMap<Key, T, Compare, Allocator>::contains( const Key& key ) const
+{
+	return t_read_( &key, [&key]( const shard_map_type& map ) { return map.contains( key ); } );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::size_t ShardedMap<Key, T, Compare, Allocator>::size() const
+{
+	std::size_t result = 0;
+	for ( auto& shard : shards_ )
+	{
+		result += shard.size.load( std::memory_order_relaxed );
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::size_t ShardedMap<Key, T, Compare, Allocator>::shard_count() const
+{
+	return shards_.size();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::vector<std::size_t> ShardedMap<Key, T, Compare, Allocator>::shard_sizes() const
+{
+	auto locks = lock_all_();
+	std::vector<std::size_t> result( shards_.size(), 0 );
+	auto& ranges = layout_.load()->shards;
+	for ( std::size_t i = 0; i < ranges.size(); ++i )
+	{
+		result[i] = shards_[ranges[i]].map.size();
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::vector<MapStatistics> ShardedMap<Key, T, Compare, Allocator>::shard_statistics() const
+{
+	auto locks = lock_all_();
+	std::vector<MapStatistics> result;
+	for ( auto range : layout_.load()->shards )
+	{
+		result.push_back( shards_[range].map.statistics() );
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto ShardedMap<Key, T, Compare, Allocator>::snapshot() const -> map_type
+{
+	// the ranges go in key order, so every element is appended at the end
+	auto locks = lock_all_();
+	map_type result( compare_, shards_[0].map.get_allocator() );
+	for ( auto range : layout_.load()->shards )
+	{
+		for ( auto& element : shards_[range].map )
+		{
+			result.insert( result.end(), element.first, element.second );
+		}
+	}
+	return result;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+template<typename F>
+void ShardedMap<Key, T, Compare, Allocator>::for_each( F&& f ) const
+{
+	// The position is kept as keys, not as a shard index: the next shard is the one with the upper bound
+	// of the previous shard, and the elements that moved there from the visited shards are skipped by key.
+	std::optional<Key> from; // the upper bound of the visited shards
+	std::optional<Key> last; // the last visited key
+	do
+	{
+		from = t_read_( from.has_value() ? &*from : nullptr, [&f, &last]( const shard_map_type& map, const Shard& shard ) {
+			auto iter = last.has_value() ? map.upper_bound( *last ) : map.begin();
+			const Key * visited = nullptr;
+			for ( ; iter != map.end(); ++iter )
+			{
+				f( iter->first, static_cast<const T&>( iter->second ) );
+				visited = &iter->first;
+			}
+			if ( visited != nullptr )
+			{
+				last = *visited;
+			}
+			return shard.high;
+		} );
+	} while ( from.has_value() );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ShardedMap<Key, T, Compare, Allocator>::insert( const Key& key, const T& value )
+{
+	std::size_t hot = shards_.size(); // no shard
+	t_write_( key, [this, &key, &value, &hot]( Shard& shard ) {
+		shard.map.insert( key, value );
+		shard.size.store( shard.map.size(), std::memory_order_relaxed );
+		if ( ++shard.insertions % s_hot_check_period_ == 0 && is_hot_( shard.map.size() ) )
+		{
+			hot = static_cast<std::size_t>( &shard - shards_.data() );
+		}
+	} );
+	if ( hot != shards_.size() )
+	{
+		// an insertion doesn't wait for a rebalancing that is already running
+		std::unique_lock<std::mutex> lock( rebalance_mutex_, std::try_to_lock );
+		if ( lock.owns_lock() )
+		{
+			split_hot_( hot );
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool ShardedMap<Key, T, Compare, Allocator>::erase( const Key& key )
+{
+	return t_write_( key, [&key]( Shard& shard ) {
+		auto size = shard.map.size();
+		shard.map.erase( key );
+		if ( shard.map.size() == size )
+		{
+			return false;
+		}
+		shard.size.store( shard.map.size(), std::memory_order_relaxed );
+		return true;
+	} );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ShardedMap<Key, T, Compare, Allocator>::clear()
+{
+	// the ranges of the shards stay
+	for ( auto& shard : shards_ )
+	{
+		std::unique_lock<std::shared_mutex> lock( shard.mutex );
+		shard.map.clear();
+		shard.size.store( 0, std::memory_order_relaxed );
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ShardedMap<Key, T, Compare, Allocator>::rebalance()
+{
+	std::lock_guard<std::mutex> lock( rebalance_mutex_ );
+	even_out_();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+std::size_t ShardedMap<Key, T, Compare, Allocator>::route_( const Key * key ) const
+{
+	struct Departure
+	{
+		// leaves the route section on exceptions of the comparator too
+		ReadIndicator& indicator;
+		~Departure() { indicator.depart(); }
+	};
+
+	auto& indicator = route_indicators_[version_index_.load()];
+	indicator.arrive();
+	Departure departure{ indicator };
+	auto& layout = *layout_.load();
+	if ( key == nullptr )
+	{
+		return layout.shards[0];
+	}
+	return layout.shards[std::upper_bound( layout.boundaries.begin(), layout.boundaries.end(), *key, compare_ ) - layout.boundaries.begin()];
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool ShardedMap<Key, T, Compare, Allocator>::in_range_( const Shard& shard, const Key * key ) const
+{
+	if ( !shard.in_use )
+	{
+		return false;
+	}
+	if ( key == nullptr )
+	{
+		return !shard.low.has_value();
+	}
+	return ( !shard.low.has_value() || !compare_( *key, *shard.low ) ) && ( !shard.high.has_value() || compare_( *key, *shard.high ) );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+template<typename F>
+auto ShardedMap<Key, T, Compare, Allocator>::t_read_( const Key * key, F&& f ) const
+{
+	// Runs f( const shard_map_type& ) or f( const shard_map_type&, const Shard& ) under the shared lock of the shard of 'key'.
+	for ( ;; )
+	{
+		auto& shard = shards_[route_( key )];
+		std::shared_lock<std::shared_mutex> lock( shard.mutex );
+		if ( in_range_( shard, key ) )
+		{
+			if constexpr ( std::is_invocable_v<F, const shard_map_type&, const Shard&> )
+			{
+				return f( static_cast<const shard_map_type&>( shard.map ), shard );
+			}
+			else
+			{
+				return f( static_cast<const shard_map_type&>( shard.map ) );
+			}
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+template<typename F>
+auto ShardedMap<Key, T, Compare, Allocator>::t_write_( const Key& key, F&& f )
+{
+	// Runs f( Shard& ) under the exclusive lock of the shard of 'key'.
+	for ( ;; )
+	{
+		auto& shard = shards_[route_( &key )];
+		std::unique_lock<std::shared_mutex> lock( shard.mutex );
+		if ( in_range_( shard, &key ) )
+		{
+			return f( shard );
+		}
+	}
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+bool ShardedMap<Key, T, Compare, Allocator>::is_hot_( std::size_t size ) const
+{
+	return size >= s_min_hot_size_ && size * shards_.size() > s_hot_factor_ * this->size();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+auto ShardedMap<Key, T, Compare, Allocator>::lock_all_() const -> Locks
+{
+	// Shards are locked in the order of the vector by everyone, so there is no deadlock.
+	// With all shards locked, the layout doesn't change.
+	Locks locks;
+	locks.reserve( shards_.size() );
+	for ( auto& shard : shards_ )
+	{
+		locks.emplace_back( shard.mutex );
+	}
+	return locks;
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ShardedMap<Key, T, Compare, Allocator>::split_hot_( std::size_t hot )
+{
+	// Called under rebalance_mutex_.
+	auto locks = lock_all_();
+	if ( !shards_[hot].in_use || !is_hot_( shards_[hot].map.size() ) )
+	{
+		return; // rebalanced by someone else meanwhile
+	}
+	auto ranges = layout_.load()->shards;
+	auto free = shards_.size();
+	for ( std::size_t i = 0; i < shards_.size() && free == shards_.size(); ++i )
+	{
+		free = shards_[i].in_use ? free : i;
+	}
+	if ( free == shards_.size() )
+	{
+		// Merges the pair with the least elements, if it holds less than the hot shard.
+		auto best = ranges.size();
+		auto best_size = shards_[hot].map.size();
+		for ( std::size_t i = 0; i + 1 < ranges.size(); ++i )
+		{
+			auto size = shards_[ranges[i]].map.size() + shards_[ranges[i + 1]].map.size();
+			if ( ranges[i] != hot && ranges[i + 1] != hot && size < best_size )
+			{
+				best = i;
+				best_size = size;
+			}
+		}
+		if ( best == ranges.size() )
+		{
+			return;
+		}
+		auto& left = shards_[ranges[best]];
+		auto& right = shards_[ranges[best + 1]];
+		left.map.join( std::move( right.map ) );
+		left.high = right.high;
+		right.in_use = false;
+		right.low.reset();
+		right.high.reset();
+		free = ranges[best + 1];
+		ranges.erase( ranges.begin() + static_cast<std::ptrdiff_t>( best ) + 1 );
+	}
+
+	auto& source = shards_[hot];
+	auto& target = shards_[free];
+	Key boundary = source.map.select( source.map.size() / 2 )->first;
+	target.map = source.map.split( boundary );
+	target.in_use = true;
+	target.low = boundary;
+	target.high = source.high;
+	source.high = std::move( boundary );
+	ranges.insert( std::find( ranges.begin(), ranges.end(), hot ) + 1, free );
+	publish_( std::move( ranges ), locks );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ShardedMap<Key, T, Compare, Allocator>::even_out_()
+{
+	// Called under rebalance_mutex_. With all shards in use in key order (free shards go to the end),
+	// flows[i] elements move over the boundary between ranges i - 1 and i (to the left if it is positive),
+	// so that the shards get equal sizes. A move takes the least or the greatest elements of a shard by
+	// extract() and insert() of nodes, without copies and allocations. Moves are done when their source
+	// shard holds enough elements, which at least one pending move does at any time.
+	auto locks = lock_all_();
+	auto n = shards_.size();
+	std::size_t total = 0;
+	for ( auto& shard : shards_ )
+	{
+		total += shard.map.size();
+	}
+	if ( total < n )
+	{
+		return; // some shards would be empty and would have no least key for the layout
+	}
+	auto ranges = layout_.load()->shards;
+	for ( std::size_t i = 0; i < n; ++i )
+	{
+		if ( !shards_[i].in_use )
+		{
+			ranges.push_back( i );
+		}
+	}
+
+	std::vector<std::ptrdiff_t> flows( n, 0 );
+	std::size_t current = 0;
+	std::size_t target = 0;
+	for ( std::size_t i = 1; i < n; ++i )
+	{
+		current += shards_[ranges[i - 1]].map.size();
+		target += total / n + ( i - 1 < total % n ? 1 : 0 );
+		flows[i] = static_cast<std::ptrdiff_t>( target ) - static_cast<std::ptrdiff_t>( current );
+	}
+	for ( bool pending = true; pending; )
+	{
+		pending = false;
+		for ( std::size_t i = 1; i < n; ++i )
+		{
+			auto& left = shards_[ranges[i - 1]].map;
+			auto& right = shards_[ranges[i]].map;
+			if ( flows[i] > 0 && right.size() >= static_cast<std::size_t>( flows[i] ) )
+			{
+				for ( ; flows[i] != 0; --flows[i] )
+				{
+					left.insert( right.extract( right.begin() ) );
+				}
+			}
+			else if ( flows[i] < 0 && left.size() >= static_cast<std::size_t>( -flows[i] ) )
+			{
+				for ( ; flows[i] != 0; ++flows[i] )
+				{
+					right.insert( left.extract( left.rbegin() ) );
+				}
+			}
+			pending = pending || flows[i] != 0;
+		}
+	}
+
+	for ( std::size_t i = 0; i < n; ++i )
+	{
+		auto& shard = shards_[ranges[i]];
+		shard.in_use = true;
+		shard.low = ( i != 0 ) ? std::optional<Key>( shard.map.begin()->first ) : std::nullopt;
+		shard.high = ( i + 1 != n ) ? std::optional<Key>( shards_[ranges[i + 1]].map.begin()->first ) : std::nullopt;
+	}
+	publish_( std::move( ranges ), locks );
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ShardedMap<Key, T, Compare, Allocator>::publish_( std::vector<std::size_t> ranges, Locks& locks )
+{
+	// Called under rebalance_mutex_ and 'locks' of all shards, with the ranges of the shards already set.
+	std::unique_ptr<Layout> layout( new Layout() );
+	layout->boundaries.reserve( ranges.size() - 1 );
+	for ( std::size_t i = 1; i < ranges.size(); ++i )
+	{
+		layout->boundaries.push_back( *shards_[ranges[i]].low );
+	}
+	layout->shards = std::move( ranges );
+	for ( auto& shard : shards_ )
+	{
+		shard.size.store( shard.map.size(), std::memory_order_relaxed );
+	}
+	std::unique_ptr<const Layout> old( layout_.exchange( layout.release() ) );
+	// Operations that routed by the old layout may wait for the shard locks, so they are released first.
+	locks.clear();
+	wait_for_routes_();
+}
+
+template<typename Key, typename T, typename Compare, typename Allocator>
+void ShardedMap<Key, T, Compare, Allocator>::wait_for_routes_()
+{
+	// As ConcurrentMap::toggle_version_and_wait_(): both indicators get empty in a finite time,
+	// after that no operation uses the old layout.
+	auto previous = version_index_.load();
+	auto next = 1 - previous;
+	while ( !route_indicators_[next].is_empty() )
+	{
+		std::this_thread::yield();
+	}
+	version_index_.store( next );
+	while ( !route_indicators_[previous].is_empty() )
+	{
+		std::this_thread::yield();
+	}
+}
+
+} // namespace EK
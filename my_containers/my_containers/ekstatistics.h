@@ -0,0 +1,215 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace EK
+{
+
+/*
+Instrumentation of EK::Map.
+
+It is compiled out by default. Define EK_MAP_STATISTICS before ekmap.h is included (the CMake option
+MY_CONTAINERS_STATISTICS does it for the whole build) and every map counts:
+	lookups and the comparisons and levels of their descents,
+	rotations, recolorings and node swaps of rebalancing,
+	nodes created by insertions,
+and times every latency_sample_period-th lookup, insertion and erasure into a histogram.
+Map::statistics() returns a snapshot; without EK_MAP_STATISTICS it has the shape of the tree only.
+The counters are relaxed atomics, so parallel set operations may update them; a copy or a moved map
+starts with zero counters.
+*/
+
+struct LatencyHistogram
+{
+	// buckets[i] counts samples that took [2^i, 2^(i+1)) nanoseconds (bucket 0 takes [0, 2)).
+	static constexpr std::size_t bucket_count = 40;
+	std::array<std::uint64_t, bucket_count> buckets{};
+	std::uint64_t samples = 0;
+
+	// Upper bound of the bucket with the p-th quantile (0 <= p <= 1), 0 without samples.
+	std::uint64_t quantile_ns( double p ) const;
+};
+
+struct MapStatistics
+{
+	bool enabled = false; // false without EK_MAP_STATISTICS, then only the shape of the tree is set
+
+	std::size_t size = 0;
+	unsigned height = 0; // levels of the tree
+	double height_bound = 0; // 2 * log2(size + 1), no red-black tree is higher
+	std::size_t slab_count = 0; // memory allocations of the node pool
+	std::size_t pool_capacity = 0;
+
+	std::uint64_t lookups = 0;
+	std::uint64_t lookup_comparisons = 0;
+	std::uint64_t lookup_levels = 0; // nodes visited by the descents
+	std::uint64_t rotations = 0;
+	std::uint64_t recolorings = 0;
+	std::uint64_t swaps = 0;
+	std::uint64_t nodes_created = 0;
+
+	LatencyHistogram lookup_latency;
+	LatencyHistogram insert_latency;
+	LatencyHistogram erase_latency;
+
+	std::string to_json() const;
+};
+
+struct LatencyCounters
+{
+	std::atomic<std::uint64_t> calls{ 0 };
+	std::array<std::atomic<std::uint64_t>, LatencyHistogram::bucket_count> buckets{};
+
+	void record( std::uint64_t nanoseconds );
+	LatencyHistogram snapshot() const;
+};
+
+struct MapCounters
+{
+	static constexpr std::uint64_t latency_sample_period = 64; // a power of 2
+
+	std::atomic<std::uint64_t> lookups{ 0 };
+	std::atomic<std::uint64_t> lookup_comparisons{ 0 };
+	std::atomic<std::uint64_t> lookup_levels{ 0 };
+	std::atomic<std::uint64_t> rotations{ 0 };
+	std::atomic<std::uint64_t> recolorings{ 0 };
+	std::atomic<std::uint64_t> swaps{ 0 };
+	std::atomic<std::uint64_t> nodes_created{ 0 };
+	LatencyCounters lookup_latency;
+	LatencyCounters insert_latency;
+	LatencyCounters erase_latency;
+
+	void fill( MapStatistics& statistics ) const;
+};
+
+class LatencySample
+{
+	// Times its own lifetime if the operation is the sampled one of its period.
+public:
+	explicit LatencySample( LatencyCounters& counters );
+	LatencySample( const LatencySample& ) = delete;
+	LatencySample& operator=( const LatencySample& ) = delete;
+	~LatencySample();
+
+private:
+	using Clock = std::chrono::steady_clock;
+	LatencyCounters * counters_ = nullptr; // nullptr if the operation is not sampled
+	Clock::time_point start_;
+};
+
+#ifdef EK_MAP_STATISTICS
+#define EK_MAP_COUNT( counter, n ) counters_.counter.fetch_add( ( n ), std::memory_order_relaxed )
+#define EK_MAP_TIME( histogram ) ::EK::LatencySample ek_latency_sample_( counters_.histogram )
+#else
+#define EK_MAP_COUNT( counter, n ) static_cast<void>( 0 )
+#define EK_MAP_TIME( histogram ) static_cast<void>( 0 )
+#endif
+
+inline std::uint64_t LatencyHistogram::quantile_ns( double p ) const
+{
+	if ( samples == 0 )
+	{
+		return 0;
+	}
+	auto rank = static_cast<std::uint64_t>( std::ceil( p * double( samples ) ) );
+	std::uint64_t seen = 0;
+	for ( std::size_t i = 0; i < bucket_count; ++i )
+	{
+		seen += buckets[i];
+		if ( seen >= rank && seen != 0 )
+		{
+			return std::uint64_t( 1 ) << ( i + 1 );
+		}
+	}
+	return std::uint64_t( 1 ) << bucket_count;
+}
+
+inline std::string MapStatistics::to_json() const
+{
+	std::ostringstream json;
+	auto histogram = [&json]( const char * name, const LatencyHistogram& h )
+	{
+		json << "\"" << name << "\":{\"samples\":" << h.samples << ",\"p50_ns\":" << h.quantile_ns( 0.5 )
+			<< ",\"p99_ns\":" << h.quantile_ns( 0.99 ) << ",\"buckets\":[";
+		for ( std::size_t i = 0; i < LatencyHistogram::bucket_count; ++i )
+		{
+			json << ( i != 0 ? "," : "" ) << h.buckets[i];
+		}
+		json << "]}";
+	};
+	json << "{\"enabled\":" << ( enabled ? "true" : "false" ) << ",\"size\":" << size << ",\"height\":" << height
+		<< ",\"height_bound\":" << height_bound << ",\"slab_count\":" << slab_count
+		<< ",\"pool_capacity\":" << pool_capacity << ",\"lookups\":" << lookups
+		<< ",\"lookup_comparisons\":" << lookup_comparisons << ",\"lookup_levels\":" << lookup_levels
+		<< ",\"rotations\":" << rotations << ",\"recolorings\":" << recolorings << ",\"swaps\":" << swaps
+		<< ",\"nodes_created\":" << nodes_created << ",";
+	histogram( "lookup_latency", lookup_latency );
+	json << ",";
+	histogram( "insert_latency", insert_latency );
+	json << ",";
+	histogram( "erase_latency", erase_latency );
+	json << "}";
+	return json.str();
+}
+
+inline void LatencyCounters::record( std::uint64_t nanoseconds )
+{
+	std::size_t bucket = 0;
+	for ( ; nanoseconds > 1 && bucket + 1 < LatencyHistogram::bucket_count; nanoseconds >>= 1 )
+	{
+		++bucket;
+	}
+	buckets[bucket].fetch_add( 1, std::memory_order_relaxed );
+}
+
+inline LatencyHistogram LatencyCounters::snapshot() const
+{
+	LatencyHistogram result;
+	for ( std::size_t i = 0; i < LatencyHistogram::bucket_count; ++i )
+	{
+		result.buckets[i] = buckets[i].load( std::memory_order_relaxed );
+		result.samples += result.buckets[i];
+	}
+	return result;
+}
+
+inline void MapCounters::fill( MapStatistics& statistics ) const
+{
+	statistics.enabled = true;
+	statistics.lookups = lookups.load( std::memory_order_relaxed );
+	statistics.lookup_comparisons = lookup_comparisons.load( std::memory_order_relaxed );
+	statistics.lookup_levels = lookup_levels.load( std::memory_order_relaxed );
+	statistics.rotations = rotations.load( std::memory_order_relaxed );
+	statistics.recolorings = recolorings.load( std::memory_order_relaxed );
+	statistics.swaps = swaps.load( std::memory_order_relaxed );
+	statistics.nodes_created = nodes_created.load( std::memory_order_relaxed );
+	statistics.lookup_latency = lookup_latency.snapshot();
+	statistics.insert_latency = insert_latency.snapshot();
+	statistics.erase_latency = erase_latency.snapshot();
+}
+
+inline LatencySample::LatencySample( LatencyCounters& counters )
+{
+	if ( ( counters.calls.fetch_add( 1, std::memory_order_relaxed ) & ( MapCounters::latency_sample_period - 1 ) ) == 0 )
+	{
+		counters_ = &counters;
+		start_ = Clock::now();
+	}
+}
+
+inline LatencySample::~LatencySample()
+{
+	if ( counters_ != nullptr )
+	{
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - start_ ).count();
+		counters_->record( static_cast<std::uint64_t>( elapsed ) );
+	}
+}
+
+} // namespace EK
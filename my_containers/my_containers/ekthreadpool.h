@@ -0,0 +1,210 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace EK
+{
+
+class ThreadPool
+{
+	// Fixed set of worker threads with work stealing: every worker has a deque of tasks of its own.
+	// A task submitted by a worker goes to the back of its deque, and a worker takes its own tasks from
+	// the back, so fork-join recursion runs depth first on the data it has just touched. A worker without
+	// tasks steals from the front of the other deques, where the oldest, biggest parts of a recursion are.
+	// Tasks submitted by other threads are dealt to the deques in turn.
+	// A thread that waits for a task with wait() runs queued tasks meanwhile, so tasks may fork subtasks
+	// and wait for them (fork-join recursion) without blocking all the workers.
+public:
+	explicit ThreadPool( unsigned thread_count = std::thread::hardware_concurrency() );
+	ThreadPool( const ThreadPool& ) = delete;
+	ThreadPool& operator=( const ThreadPool& ) = delete;
+	~ThreadPool();
+
+	template<typename F>
+	auto submit( F&& f ) -> std::future<std::invoke_result_t<std::decay_t<F>>>;
+	template<typename R>
+	R wait( std::future<R>& future );
+
+	unsigned thread_count() const;
+
+private:
+	struct alignas( 64 ) Queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	struct Worker
+	{
+		const ThreadPool * pool = nullptr;
+		std::size_t index = 0;
+	};
+
+	std::vector<Queue> queues_; // one per worker
+	std::atomic<std::size_t> pending_{ 0 }; // tasks in the queues
+	std::atomic<std::size_t> next_queue_{ 0 }; // for tasks of other threads
+	std::mutex mutex_; // for sleeping workers
+	std::condition_variable condition_;
+	std::vector<std::thread> threads_;
+	bool stop_ = false;
+
+	static Worker& s_worker_();
+	std::size_t own_queue_() const; // the queue of the calling worker, queues_.size() for other threads
+	bool take_task_( std::function<void()>& task );
+	bool run_pending_task_();
+	void work_( std::size_t index );
+};
+
+inline ThreadPool::ThreadPool( unsigned thread_count ) : queues_( std::max( thread_count, 1u ) )
+{
+	threads_.reserve( queues_.size() );
+	for ( std::size_t i = 0; i < queues_.size(); ++i )
+	{
+		threads_.emplace_back( [this, i] { work_( i ); } );
+	}
+}
+
+inline ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+	condition_.notify_all();
+	for ( auto& thread : threads_ )
+	{
+		thread.join();
+	}
+}
+
+template<typename F>
+auto ThreadPool::submit( F&& f ) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+{
+	using Result = std::invoke_result_t<std::decay_t<F>>;
+	// std::function must be copyable, packaged_task is not
+	auto task = std::make_shared<std::packaged_task<Result()>>( std::forward<F>( f ) );
+	auto future = task->get_future();
+	auto index = own_queue_();
+	if ( index == queues_.size() )
+	{
+		index = next_queue_.fetch_add( 1, std::memory_order_relaxed ) % queues_.size();
+	}
+	{
+		std::lock_guard<std::mutex> lock( queues_[index].mutex );
+		queues_[index].tasks.emplace_back( [task] { ( *task )(); } );
+		pending_.fetch_add( 1 );
+	}
+	{
+		// a worker going to sleep checks pending_ under mutex_, so it doesn't miss the notification
+		std::lock_guard<std::mutex> lock( mutex_ );
+	}
+	condition_.notify_one();
+	return future;
+}
+
+template<typename R>
+R ThreadPool::wait( std::future<R>& future )
+{
+	while ( future.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+	{
+		if ( !run_pending_task_() )
+		{
+			std::this_thread::yield();
+		}
+	}
+	return future.get();
+}
+
+inline unsigned ThreadPool::thread_count() const
+{
+	return static_cast<unsigned>( threads_.size() );
+}
+
+inline auto ThreadPool::s_worker_() -> Worker&
+{
+	thread_local Worker worker;
+	return worker;
+}
+
+inline std::size_t ThreadPool::own_queue_() const
+{
+	auto& worker = s_worker_();
+	return ( worker.pool == this ) ? worker.index : queues_.size();
+}
+
+inline bool ThreadPool::take_task_( std::function<void()>& task )
+{
+	auto own = own_queue_();
+	if ( own != queues_.size() )
+	{
+		auto& queue = queues_[own];
+		std::lock_guard<std::mutex> lock( queue.mutex );
+		if ( !queue.tasks.empty() )
+		{
+			task = std::move( queue.tasks.back() );
+			queue.tasks.pop_back();
+			pending_.fetch_sub( 1 );
+			return true;
+		}
+	}
+	for ( std::size_t i = 1; i <= queues_.size(); ++i )
+	{
+		auto& queue = queues_[( own + i ) % queues_.size()];
+		std::lock_guard<std::mutex> lock( queue.mutex );
+		if ( !queue.tasks.empty() )
+		{
+			task = std::move( queue.tasks.front() );
+			queue.tasks.pop_front();
+			pending_.fetch_sub( 1 );
+			return true;
+		}
+	}
+	return false;
+}
+
+inline bool ThreadPool::run_pending_task_()
+{
+	if ( pending_.load() == 0 )
+	{
+		return false;
+	}
+	std::function<void()> task;
+	if ( !take_task_( task ) )
+	{
+		return false;
+	}
+	task();
+	return true;
+}
+
+inline void ThreadPool::work_( std::size_t index )
+{
+	s_worker_() = Worker{ this, index };
+	for ( ;; )
+	{
+		if ( run_pending_task_() )
+		{
+			continue;
+		}
+		std::unique_lock<std::mutex> lock( mutex_ );
+		condition_.wait( lock, [this] { return stop_ || pending_.load() != 0; } );
+		if ( stop_ && pending_.load() == 0 )
+		{
+			return; // stopped and nothing left to do
+		}
+	}
+}
+
+} // namespace EK
@@ -0,0 +1,75 @@
+#include "bench_util.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment( lib, "psapi.lib" )
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+std::atomic<std::size_t> s_allocation_counter{ 0 };
+
+} // nameless namespace
+
+void * operator new( std::size_t size )
+{
+	s_allocation_counter.fetch_add( 1, std::memory_order_relaxed );
+	if ( auto p = std::malloc( size == 0 ? 1 : size ) )
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete( void * p ) noexcept
+{
+	std::free( p );
+}
+
+void operator delete( void * p, std::size_t ) noexcept
+{
+	std::free( p );
+}
+
+namespace bench
+{
+
+std::size_t allocation_count()
+{
+	return s_allocation_counter.load( std::memory_order_relaxed );
+}
+
+std::size_t resident_set_size()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if ( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+	{
+		return counters.WorkingSetSize;
+	}
+	return 0;
+#else
+	long pages = 0;
+	long resident = 0;
+	auto file = std::fopen( "/proc/self/statm", "r" );
+	if ( file == nullptr )
+	{
+		return 0;
+	}
+	if ( std::fscanf( file, "%ld %ld", &pages, &resident ) != 2 )
+	{
+		resident = 0;
+	}
+	std::fclose( file );
+	return static_cast<std::size_t>( resident ) * static_cast<std::size_t>( sysconf( _SC_PAGESIZE ) );
+#endif
+}
+
+} // namespace bench
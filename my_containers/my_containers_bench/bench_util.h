@@ -0,0 +1,102 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+// Number of calls of global operator new since the program start.
+// Counting replacements of operator new/delete are defined in bench_util.cpp.
+std::size_t allocation_count();
+
+// Current resident set size of the process in bytes (0 if it is unknown on the platform).
+std::size_t resident_set_size();
+
+inline std::vector<int> random_keys( std::size_t n, unsigned seed = 0 )
+{
+	// returns n numbers in interval [0..n) without repetitions in random order
+	std::vector<int> keys( n );
+	for ( std::size_t i = 0; i < n; ++i )
+	{
+		keys[i] = static_cast<int>( i );
+	}
+	std::mt19937 gen( seed );
+	std::shuffle( keys.begin(), keys.end(), gen );
+	return keys;
+}
+
+// Order of keys of a workload, benchmarks take it as a range argument.
+enum class KeyOrder
+{
+	sequential,
+	random,
+	zipf // a few hot keys take most of the accesses
+};
+
+inline const char * key_order_name( KeyOrder order )
+{
+	switch ( order )
+	{
+	case KeyOrder::sequential:
+		return "sequential";
+	case KeyOrder::random:
+		return "random";
+	default:
+		return "zipf";
+	}
+}
+
+inline std::vector<int> keys_in_order( KeyOrder order, std::size_t count, std::size_t n, unsigned seed = 0 )
+{
+	// returns count numbers in interval [0..n):
+	// sequential - 0, 1, 2..., random - a random permutation repeated, zipf - Zipf distribution with s = 1
+	// over ranks, the rank of a key is random, so hot keys are spread over the whole interval
+	std::vector<int> keys( count );
+	if ( n == 0 )
+	{
+		return {};
+	}
+	if ( order == KeyOrder::sequential )
+	{
+		for ( std::size_t i = 0; i < count; ++i )
+		{
+			keys[i] = static_cast<int>( i % n );
+		}
+		return keys;
+	}
+	auto permutation = random_keys( n, seed );
+	if ( order == KeyOrder::random )
+	{
+		for ( std::size_t i = 0; i < count; ++i )
+		{
+			keys[i] = permutation[i % n];
+		}
+		return keys;
+	}
+	std::vector<double> cumulative( n );
+	double sum = 0;
+	for ( std::size_t rank = 0; rank < n; ++rank )
+	{
+		sum += 1.0 / double( rank + 1 );
+		cumulative[rank] = sum;
+	}
+	std::mt19937 gen( seed + 1 );
+	std::uniform_real_distribution<double> distribution( 0, sum );
+	for ( std::size_t i = 0; i < count; ++i )
+	{
+		auto rank = std::lower_bound( cumulative.begin(), cumulative.end(), distribution( gen ) ) - cumulative.begin();
+		keys[i] = permutation[std::min<std::size_t>( static_cast<std::size_t>( rank ), n - 1 )];
+	}
+	return keys;
+}
+
+inline std::string value_for( int key )
+{
+	return std::to_string( key );
+}
+
+} // namespace bench
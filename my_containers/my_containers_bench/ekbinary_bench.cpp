@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "bench_util.h"
+#include "../my_containers/ekbinary.h"
+#include "../my_containers/ekmap.h"
+
+namespace
+{
+
+using EKMap = EK::IntStringMap;
+
+EKMap s_get_map( std::size_t n )
+{
+	std::vector<std::pair<int, std::string>> pairs;
+	pairs.reserve( n );
+	for ( std::size_t i = 0; i < n; ++i )
+	{
+		auto key = static_cast<int>( i );
+		pairs.emplace_back( key, bench::value_for( key ) );
+	}
+	return EKMap( pairs.begin(), pairs.end() );
+}
+
+std::string s_get_path( const char * name, std::size_t n )
+{
+	auto file_name = std::string( "ekbinary_bench_" ) + name + "_" + std::to_string( n );
+	return ( std::filesystem::temp_directory_path() / file_name ).string();
+}
+
+} // namespace
+
+void BM_save_text( benchmark::State& state )
+{
+	// The old way of persistence: one text line per entry.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto m = s_get_map( n );
+	auto path = s_get_path( "text", n );
+	for ( auto _ : state )
+	{
+		std::ofstream out( path );
+		for ( auto& pair : m )
+		{
+			out << pair.first << ' ' << pair.second << '\n';
+		}
+	}
+	std::remove( path.c_str() );
+	state.SetItemsProcessed( state.iterations() * n );
+}
+
+void BM_save_binary( benchmark::State& state )
+{
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto m = s_get_map( n );
+	auto path = s_get_path( "binary", n );
+	for ( auto _ : state )
+	{
+		EK::write_binary( path, m );
+	}
+	std::remove( path.c_str() );
+	state.SetItemsProcessed( state.iterations() * n );
+}
+
+void BM_startup_text_insert( benchmark::State& state )
+{
+	// Startup from a text file with one insert() per line.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto path = s_get_path( "text", n );
+	{
+		auto m = s_get_map( n );
+		std::ofstream out( path );
+		for ( auto& pair : m )
+		{
+			out << pair.first << ' ' << pair.second << '\n';
+		}
+	}
+	for ( auto _ : state )
+	{
+		EKMap m;
+		std::ifstream in( path );
+		int key;
+		std::string value;
+		while ( in >> key >> value )
+		{
+			m.insert( key, std::move( value ) );
+		}
+		benchmark::DoNotOptimize( m );
+	}
+	std::remove( path.c_str() );
+	state.SetItemsProcessed( state.iterations() * n );
+}
+
+void BM_startup_binary_build( benchmark::State& state )
+{
+	// Startup from a binary file: the tree is built from the mapped keys and values in O(n).
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto path = s_get_path( "binary", n );
+	EK::write_binary( path, s_get_map( n ) );
+	for ( auto _ : state )
+	{
+		auto m = EK::load_binary<EKMap>( path );
+		benchmark::DoNotOptimize( m );
+	}
+	std::remove( path.c_str() );
+	state.SetItemsProcessed( state.iterations() * n );
+}
+
+void BM_startup_mapped_lookups( benchmark::State& state )
+{
+	// Startup without a tree: the file is mapped and the first 1000 random lookups are served from it.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto path = s_get_path( "binary", n );
+	EK::write_binary( path, s_get_map( n ) );
+	auto keys = bench::random_keys( n );
+	keys.resize( std::min<std::size_t>( n, 1000 ) );
+	for ( auto _ : state )
+	{
+		EK::MappedMap<int, std::string> m( path );
+		std::size_t sum = 0;
+		for ( auto key : keys )
+		{
+			sum += m.at( key ).size();
+		}
+		benchmark::DoNotOptimize( sum );
+	}
+	std::remove( path.c_str() );
+	state.SetItemsProcessed( state.iterations() * keys.size() );
+}
+
+BENCHMARK( BM_save_text )->RangeMultiplier( 10 )->Range( 1000, 10000000 )->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_save_binary )->RangeMultiplier( 10 )->Range( 1000, 10000000 )->Unit( benchmark::kMillisecond );
+// The biggest size is a 50M entries map, as in production; it needs about 5 GB of memory.
+BENCHMARK( BM_startup_text_insert )->RangeMultiplier( 10 )->Range( 1000, 10000000 )->Arg( 50000000 )
+	->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_startup_binary_build )->RangeMultiplier( 10 )->Range( 1000, 10000000 )->Arg( 50000000 )
+	->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_startup_mapped_lookups )->RangeMultiplier( 10 )->Range( 1000, 10000000 )->Arg( 50000000 )
+	->Unit( benchmark::kMillisecond );
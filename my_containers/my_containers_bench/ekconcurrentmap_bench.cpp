@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <benchmark/benchmark.h>
+
+#include "bench_util.h"
+#include "../my_containers/ekconcurrentmap.h"
+
+namespace
+{
+
+// A read-mostly load: a map of 100K keys shared by all threads, every 100th operation is a write.
+constexpr int s_key_count = 100000;
+constexpr int s_write_period = 100;
+
+class MutexMap
+{
+	// what the service does today: one mutex around the map
+public:
+	bool contains( int key )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		return map_.contains( key );
+	}
+	void insert( int key, int value )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		map_.insert( key, value );
+	}
+private:
+	std::mutex mutex_;
+	EK::Map<int, int> map_;
+};
+
+using ConcurrentMap = EK::ConcurrentMap<int, int>;
+
+template<typename MapType>
+std::unique_ptr<MapType> s_shared_map;
+
+template<typename MapType>
+void BM_read_mostly( benchmark::State& state )
+{
+	if ( state.thread_index() == 0 )
+	{
+		s_shared_map<MapType> = std::make_unique<MapType>();
+		for ( auto key : bench::random_keys( s_key_count ) )
+		{
+			s_shared_map<MapType>->insert( key, key );
+		}
+	}
+	auto keys = bench::random_keys( s_key_count, state.thread_index() + 1 );
+	std::size_t i = 0;
+	std::size_t found = 0;
+	for ( auto _ : state )
+	{
+		auto key = keys[i % keys.size()];
+		if ( i % s_write_period == 0 )
+		{
+			s_shared_map<MapType>->insert( key, key );
+		}
+		else
+		{
+			found += s_shared_map<MapType>->contains( key ) ? 1 : 0;
+		}
+		++i;
+	}
+	benchmark::DoNotOptimize( found );
+	state.SetItemsProcessed( state.iterations() );
+	if ( state.thread_index() == 0 )
+	{
+		s_shared_map<MapType>.reset();
+	}
+}
+
+int s_max_threads()
+{
+	return static_cast<int>( std::max( 2u, std::thread::hardware_concurrency() ) );
+}
+
+} // nameless namespace
+
+// items_per_second is the total over the threads, so it shows the scaling.
+BENCHMARK_TEMPLATE( BM_read_mostly, MutexMap )->ThreadRange( 1, s_max_threads() )->UseRealTime();
+BENCHMARK_TEMPLATE( BM_read_mostly, ConcurrentMap )->ThreadRange( 1, s_max_threads() )->UseRealTime();
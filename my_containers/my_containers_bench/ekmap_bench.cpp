@@ -0,0 +1,823 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "bench_util.h"
+#include "../my_containers/ekmap.h"
+
+namespace
+{
+
+using EKMap = EK::IntStringMap;
+using EKHandleMap = EK::Map<std::uint64_t, std::uint64_t>;
+using EKThreadedMap = EK::ThreadedMap<int, std::string>;
+using StdMap = std::map<int, std::string>;
+
+void s_insert( EKMap& m, int key, std::string&& value ) { m.insert( key, std::move( value ) ); }
+void s_insert( EKThreadedMap& m, int key, std::string&& value ) { m.insert( key, std::move( value ) ); }
+void s_insert( StdMap& m, int key, std::string&& value ) { m.insert_or_assign( key, std::move( value ) ); }
+void s_erase( EKMap& m, int key ) { m.erase( key ); }
+void s_erase( StdMap& m, int key ) { m.erase( key ); }
+
+template<typename MapType>
+void BM_insert_erase_churn( benchmark::State& state )
+{
+	// A map of fixed size where every iteration erases one key and inserts it back.
+	// Values are short, so std::string does not allocate and allocs/op counts nodes only.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto keys = bench::random_keys( n );
+	MapType m;
+	for ( auto key : keys )
+	{
+		s_insert( m, key, bench::value_for( key ) );
+	}
+
+	std::size_t i = 0;
+	auto allocations_before = bench::allocation_count();
+	for ( auto _ : state )
+	{
+		auto key = keys[i];
+		s_erase( m, key );
+		s_insert( m, key, bench::value_for( key ) );
+		i = ( i + 1 < n ) ? i + 1 : 0;
+	}
+	auto allocations = bench::allocation_count() - allocations_before;
+
+	state.SetItemsProcessed( state.iterations() * 2 );
+	state.counters["allocs/op"] = static_cast<double>( allocations ) / ( state.iterations() * 2.0 );
+	state.counters["rss_MB"] = bench::resident_set_size() / ( 1024.0 * 1024.0 );
+}
+
+template<typename MapType>
+void BM_fill_and_destroy( benchmark::State& state )
+{
+	// Builds and destroys a map on every iteration; rss_growth_MB shows memory which is not given back.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto keys = bench::random_keys( n );
+
+	auto rss_before = bench::resident_set_size();
+	auto allocations_before = bench::allocation_count();
+	for ( auto _ : state )
+	{
+		MapType m;
+		for ( auto key : keys )
+		{
+			s_insert( m, key, bench::value_for( key ) );
+		}
+		benchmark::DoNotOptimize( m );
+	}
+	auto allocations = bench::allocation_count() - allocations_before;
+	auto rss_after = bench::resident_set_size();
+
+	state.SetItemsProcessed( state.iterations() * n );
+	state.counters["allocs/op"] = static_cast<double>( allocations ) / ( state.iterations() * double( n ) );
+	state.counters["rss_growth_MB"] = ( double( rss_after ) - double( rss_before ) ) / ( 1024.0 * 1024.0 );
+}
+
+template<typename MapType>
+void BM_copy( benchmark::State& state )
+{
+	// Copies a map; range(1) is 0 for the copy constructor and 1 for an assignment to a map of the same size.
+	// Values are short, so allocs/op counts node allocations per copied entry.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto assign = state.range( 1 ) == 1;
+	MapType source;
+	for ( auto key : bench::random_keys( n ) )
+	{
+		s_insert( source, key, bench::value_for( key ) );
+	}
+	MapType target = source;
+
+	auto allocations_before = bench::allocation_count();
+	for ( auto _ : state )
+	{
+		if ( assign )
+		{
+			target = source;
+			benchmark::DoNotOptimize( target );
+		}
+		else
+		{
+			MapType copy( source );
+			benchmark::DoNotOptimize( copy );
+		}
+	}
+	auto allocations = bench::allocation_count() - allocations_before;
+
+	state.SetItemsProcessed( state.iterations() * n );
+	state.counters["allocs/op"] = static_cast<double>( allocations ) / ( state.iterations() * double( n ) );
+}
+
+void BM_copy_parallel( benchmark::State& state )
+{
+	// The copy constructor with subtrees copied on range(1) threads.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	EKMap source;
+	for ( auto key : bench::random_keys( n ) )
+	{
+		source.insert( key, bench::value_for( key ) );
+	}
+	EK::ThreadPool pool( static_cast<unsigned>( state.range( 1 ) ) );
+	for ( auto _ : state )
+	{
+		EKMap copy( source, &pool );
+		benchmark::DoNotOptimize( copy );
+	}
+	state.SetItemsProcessed( state.iterations() * n );
+}
+
+template<typename MapType>
+void BM_insert_keys( benchmark::State& state )
+{
+	// Fills an empty map with n keys in the order range(1) (bench::KeyOrder); destruction is included.
+	// Zipf keys repeat, so most of the inserts find the key.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto order = static_cast<bench::KeyOrder>( state.range( 1 ) );
+	auto keys = bench::keys_in_order( order, n, n );
+	for ( auto _ : state )
+	{
+		MapType m;
+		for ( auto key : keys )
+		{
+			s_insert( m, key, bench::value_for( key ) );
+		}
+		benchmark::DoNotOptimize( m );
+	}
+	state.SetItemsProcessed( state.iterations() * n );
+	state.SetLabel( bench::key_order_name( order ) );
+}
+
+template<typename MapType>
+void BM_find_keys( benchmark::State& state )
+{
+	// Lookups of present keys in the order range(1) in a map of n keys.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto order = static_cast<bench::KeyOrder>( state.range( 1 ) );
+	MapType m;
+	for ( auto key : bench::random_keys( n ) )
+	{
+		s_insert( m, key, bench::value_for( key ) );
+	}
+	auto keys = bench::keys_in_order( order, 65536, n );
+
+	std::size_t i = 0;
+	for ( auto _ : state )
+	{
+		benchmark::DoNotOptimize( m.find( keys[i] ) );
+		i = ( i + 1 ) & 65535;
+	}
+	state.SetItemsProcessed( state.iterations() );
+	state.SetLabel( bench::key_order_name( order ) );
+}
+
+template<typename MapType>
+void BM_erase_keys( benchmark::State& state )
+{
+	// Erases n keys in the order range(1) from a map of n keys, which is built with paused timing.
+	// Zipf keys repeat, so most of the erasures miss.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto order = static_cast<bench::KeyOrder>( state.range( 1 ) );
+	auto keys = bench::keys_in_order( order, n, n );
+	auto fill_keys = bench::random_keys( n, 1 );
+	for ( auto _ : state )
+	{
+		state.PauseTiming();
+		MapType m;
+		for ( auto key : fill_keys )
+		{
+			s_insert( m, key, bench::value_for( key ) );
+		}
+		state.ResumeTiming();
+		for ( auto key : keys )
+		{
+			s_erase( m, key );
+		}
+		benchmark::DoNotOptimize( m );
+		state.PauseTiming();
+		m = MapType();
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed( state.iterations() * n );
+	state.SetLabel( bench::key_order_name( order ) );
+}
+
+template<typename MapType>
+void BM_mixed( benchmark::State& state )
+{
+	// 80% lookups, 10% inserts and 10% erasures of keys in [0..2n) in the order range(1);
+	// the map starts with the n even keys.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto order = static_cast<bench::KeyOrder>( state.range( 1 ) );
+	MapType m;
+	for ( auto key : bench::random_keys( n ) )
+	{
+		s_insert( m, 2 * key, bench::value_for( key ) );
+	}
+	auto keys = bench::keys_in_order( order, 65536, 2 * n );
+	std::vector<unsigned char> operations( 65536 );
+	std::mt19937 gen( 7 );
+	for ( auto& operation : operations )
+	{
+		operation = static_cast<unsigned char>( gen() % 10 );
+	}
+
+	std::size_t i = 0;
+	for ( auto _ : state )
+	{
+		auto key = keys[i];
+		switch ( operations[i] )
+		{
+		case 0:
+			s_insert( m, key, bench::value_for( key ) );
+			break;
+		case 1:
+			s_erase( m, key );
+			break;
+		default:
+			benchmark::DoNotOptimize( m.find( key ) );
+			break;
+		}
+		i = ( i + 1 ) & 65535;
+	}
+	state.SetItemsProcessed( state.iterations() );
+	state.SetLabel( bench::key_order_name( order ) );
+}
+
+template<typename MapType>
+void BM_find( benchmark::State& state )
+{
+	// Lookups of present keys in random order.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto keys = bench::random_keys( n );
+	MapType m;
+	for ( auto key : keys )
+	{
+		m.insert( key, typename MapType::mapped_type() );
+	}
+
+	std::size_t i = 0;
+	for ( auto _ : state )
+	{
+		benchmark::DoNotOptimize( m.find( keys[i] ) );
+		i = ( i + 1 < n ) ? i + 1 : 0;
+	}
+	state.SetItemsProcessed( state.iterations() );
+}
+
+void BM_find_frozen( benchmark::State& state )
+{
+	// BM_find on the frozen copy of the map.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto keys = bench::random_keys( n );
+	EKHandleMap m;
+	for ( auto key : keys )
+	{
+		m.insert( key, EKHandleMap::mapped_type() );
+	}
+	auto frozen = m.freeze();
+	m.clear();
+
+	std::size_t i = 0;
+	for ( auto _ : state )
+	{
+		benchmark::DoNotOptimize( frozen.find( keys[i] ) );
+		i = ( i + 1 < n ) ? i + 1 : 0;
+	}
+	state.SetItemsProcessed( state.iterations() );
+}
+
+void BM_find_batch( benchmark::State& state )
+{
+	// Batches of range(1) random present keys; range(2) == 0 finds them one by one, 1 with find_batch().
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto batch_size = static_cast<std::size_t>( state.range( 1 ) );
+	auto is_batched = state.range( 2 ) != 0;
+	auto keys = bench::random_keys( n );
+	EKHandleMap m;
+	for ( auto key : keys )
+	{
+		m.insert( key, EKHandleMap::mapped_type() );
+	}
+	std::vector<EKHandleMap::key_type> batch_keys( keys.begin(), keys.end() );
+	std::vector<EKHandleMap::Iterator> found( batch_size, m.end() );
+
+	std::size_t i = 0;
+	for ( auto _ : state )
+	{
+		auto first = batch_keys.begin() + i;
+		if ( is_batched )
+		{
+			m.find_batch( first, first + batch_size, found.begin() );
+		}
+		else
+		{
+			for ( std::size_t j = 0; j < batch_size; ++j )
+			{
+				found[j] = m.find( first[j] );
+			}
+		}
+		benchmark::DoNotOptimize( found.data() );
+		i = ( i + 2 * batch_size <= n ) ? i + batch_size : 0;
+	}
+	state.SetItemsProcessed( state.iterations() * batch_size );
+}
+
+void BM_append_monotonic( benchmark::State& state )
+{
+	// Appends of range(0) increasing keys, like timestamps. range(1): 0 - insert( key, value ),
+	// 1 - insert( end(), key, value ), 2 - with the iterator returned by the previous append as the hint.
+	// The map is emptied by erasures, so its pool has the nodes and allocation is not measured.
+	auto n = static_cast<std::uint64_t>( state.range( 0 ) );
+	auto mode = state.range( 1 );
+	EKHandleMap m;
+	std::uint64_t next = 0;
+	for ( ; next < n; ++next )
+	{
+		m.insert( next, next );
+	}
+	for ( auto _ : state )
+	{
+		state.PauseTiming();
+		for ( auto key = next - n; key < next; ++key )
+		{
+			m.erase( key );
+		}
+		state.ResumeTiming();
+		EKHandleMap::CIterator hint = m.end();
+		for ( std::uint64_t i = 0; i < n; ++i, ++next )
+		{
+			switch ( mode )
+			{
+			case 0:
+				m.insert( next, i );
+				break;
+			case 1:
+				m.insert( m.end(), next, i );
+				break;
+			default:
+				hint = m.insert( hint, next, i );
+				break;
+			}
+		}
+	}
+	state.SetItemsProcessed( state.iterations() * n );
+}
+
+template<typename MapType>
+void BM_iterate_arrow( benchmark::State& state )
+{
+	// Full scan which reads both key and value through operator->.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	MapType m;
+	for ( auto key : bench::random_keys( n ) )
+	{
+		s_insert( m, key, bench::value_for( key ) );
+	}
+
+	auto allocations_before = bench::allocation_count();
+	for ( auto _ : state )
+	{
+		std::size_t sum = 0;
+		for ( auto iter = m.begin(); iter != m.end(); ++iter )
+		{
+			sum += iter->first + iter->second.size();
+		}
+		benchmark::DoNotOptimize( sum );
+	}
+	auto allocations = bench::allocation_count() - allocations_before;
+
+	state.SetItemsProcessed( state.iterations() * n );
+	state.counters["allocs/op"] = static_cast<double>( allocations ) / ( state.iterations() * double( n ) );
+}
+
+void BM_at_long_values( benchmark::State& state )
+{
+	// Reads through at() of values which do not fit into the small string buffer.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto keys = bench::random_keys( n );
+	EKMap m;
+	for ( auto key : keys )
+	{
+		m.insert( key, std::string( 40, 'x' ) + bench::value_for( key ) );
+	}
+
+	std::size_t i = 0;
+	auto allocations_before = bench::allocation_count();
+	for ( auto _ : state )
+	{
+		benchmark::DoNotOptimize( m.at( keys[i] ).size() );
+		i = ( i + 1 < n ) ? i + 1 : 0;
+	}
+	auto allocations = bench::allocation_count() - allocations_before;
+
+	state.SetItemsProcessed( state.iterations() );
+	state.counters["allocs/op"] = static_cast<double>( allocations ) / state.iterations();
+}
+
+std::vector<std::pair<int, std::string>> s_get_sorted_pairs( std::size_t n )
+{
+	std::vector<std::pair<int, std::string>> pairs;
+	pairs.reserve( n );
+	for ( std::size_t i = 0; i < n; ++i )
+	{
+		auto key = static_cast<int>( i );
+		pairs.emplace_back( key, bench::value_for( key ) );
+	}
+	return pairs;
+}
+
+void BM_startup_repeated_insert( benchmark::State& state )
+{
+	auto pairs = s_get_sorted_pairs( static_cast<std::size_t>( state.range( 0 ) ) );
+	for ( auto _ : state )
+	{
+		EKMap m;
+		for ( auto& pair : pairs )
+		{
+			m.insert( pair );
+		}
+		benchmark::DoNotOptimize( m );
+	}
+	state.SetItemsProcessed( state.iterations() * pairs.size() );
+}
+
+void BM_startup_sorted_bulk_build( benchmark::State& state )
+{
+	auto pairs = s_get_sorted_pairs( static_cast<std::size_t>( state.range( 0 ) ) );
+	for ( auto _ : state )
+	{
+		EKMap m( pairs.begin(), pairs.end() );
+		benchmark::DoNotOptimize( m );
+	}
+	state.SetItemsProcessed( state.iterations() * pairs.size() );
+}
+
+void BM_startup_unsorted_bulk_build( benchmark::State& state )
+{
+	auto pairs = s_get_sorted_pairs( static_cast<std::size_t>( state.range( 0 ) ) );
+	std::shuffle( pairs.begin(), pairs.end(), std::mt19937( 0 ) );
+	for ( auto _ : state )
+	{
+		EKMap m( pairs.begin(), pairs.end() );
+		benchmark::DoNotOptimize( m );
+	}
+	state.SetItemsProcessed( state.iterations() * pairs.size() );
+}
+
+void BM_startup_parallel_bulk_build( benchmark::State& state )
+{
+	// BM_startup_unsorted_bulk_build with the sort and the construction on range(1) threads (0 is no pool).
+	auto pairs = s_get_sorted_pairs( static_cast<std::size_t>( state.range( 0 ) ) );
+	std::shuffle( pairs.begin(), pairs.end(), std::mt19937( 0 ) );
+	auto threads = static_cast<unsigned>( state.range( 1 ) );
+	std::unique_ptr<EK::ThreadPool> pool( ( threads != 0 ) ? new EK::ThreadPool( threads ) : nullptr );
+	for ( auto _ : state )
+	{
+		EKMap m;
+		m.assign_sorted( pairs.begin(), pairs.end(), pool.get() );
+		benchmark::DoNotOptimize( m );
+	}
+	state.SetItemsProcessed( state.iterations() * pairs.size() );
+}
+
+void BM_full_scan( benchmark::State& state )
+{
+	// Touches every value, by iterators or by parallel_for_each() on range(1) threads (0 is no pool).
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto pairs = s_get_sorted_pairs( n );
+	EKMap m;
+	m.assign_sorted( pairs.begin(), pairs.end() );
+	auto threads = static_cast<unsigned>( state.range( 1 ) );
+	std::unique_ptr<EK::ThreadPool> pool( ( threads != 0 ) ? new EK::ThreadPool( threads ) : nullptr );
+	for ( auto _ : state )
+	{
+		if ( pool == nullptr )
+		{
+			for ( auto& pair : m )
+			{
+				benchmark::DoNotOptimize( pair.second.size() );
+			}
+		}
+		else
+		{
+			m.parallel_for_each( []( const EKMap::value_type& pair ) { benchmark::DoNotOptimize( pair.second.size() ); },
+				pool.get() );
+		}
+	}
+	state.SetItemsProcessed( state.iterations() * n );
+}
+
+EKHandleMap s_get_handle_map( std::size_t n, std::uint64_t step, unsigned seed )
+{
+	// n random keys, multiples of step
+	EKHandleMap m;
+	for ( auto key : bench::random_keys( n, seed ) )
+	{
+		m.insert( static_cast<std::uint64_t>( key ) * step, seed );
+	}
+	return m;
+}
+
+void BM_reconcile_insert_each( benchmark::State& state )
+{
+	// The old way to merge maps: a big map of 1M keys gets range(0) keys of another map one by one.
+	auto big = s_get_handle_map( 1000000, 2, 1 );
+	auto other = s_get_handle_map( static_cast<std::size_t>( state.range( 0 ) ), 3, 2 );
+	for ( auto _ : state )
+	{
+		state.PauseTiming();
+		auto m = big;
+		state.ResumeTiming();
+		for ( auto& pair : other )
+		{
+			m.insert( pair.first, pair.second );
+		}
+		benchmark::DoNotOptimize( m );
+		state.PauseTiming();
+		m.clear();
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed( state.iterations() * other.size() );
+}
+
+void BM_reconcile_set_union( benchmark::State& state )
+{
+	// The same with set_union(); range(1) is the number of threads (0 - no thread pool).
+	auto big = s_get_handle_map( 1000000, 2, 1 );
+	auto other = s_get_handle_map( static_cast<std::size_t>( state.range( 0 ) ), 3, 2 );
+	auto thread_count = static_cast<unsigned>( state.range( 1 ) );
+	std::unique_ptr<EK::ThreadPool> pool;
+	if ( thread_count > 0 )
+	{
+		pool = std::make_unique<EK::ThreadPool>( thread_count );
+	}
+	for ( auto _ : state )
+	{
+		state.PauseTiming();
+		auto m = big;
+		auto o = other;
+		state.ResumeTiming();
+		m.set_union( std::move( o ), pool.get() );
+		benchmark::DoNotOptimize( m );
+		state.PauseTiming();
+		m.clear();
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed( state.iterations() * other.size() );
+}
+
+void BM_update_batch( benchmark::State& state )
+{
+	// A map of 1M even keys gets a sorted batch of range(0) random odd keys and then loses them again.
+	// range(1) == 0 inserts and erases them one by one, 1 with insert_batch() and erase_batch().
+	constexpr std::size_t n = 1000000;
+	constexpr std::size_t batch_count = 64;
+	auto batch_size = static_cast<std::size_t>( state.range( 0 ) );
+	auto is_batched = state.range( 1 ) != 0;
+	auto m = s_get_handle_map( n, 2, 0 );
+	std::mt19937_64 gen( 7 );
+	std::vector<std::vector<std::pair<std::uint64_t, std::uint64_t>>> batches( batch_count );
+	std::vector<std::vector<std::uint64_t>> batch_keys( batch_count );
+	for ( std::size_t b = 0; b < batch_count; ++b )
+	{
+		auto& batch = batches[b];
+		for ( std::size_t i = 0; i < batch_size; ++i )
+		{
+			batch.emplace_back( ( gen() % n ) * 2 + 1, i );
+		}
+		std::sort( batch.begin(), batch.end() );
+		batch.erase( std::unique( batch.begin(), batch.end(),
+			[]( auto& left, auto& right ) { return left.first == right.first; } ), batch.end() );
+		for ( auto& pair : batch )
+		{
+			batch_keys[b].push_back( pair.first );
+		}
+	}
+
+	std::size_t b = 0;
+	std::size_t items = 0;
+	for ( auto _ : state )
+	{
+		auto& batch = batches[b];
+		if ( is_batched )
+		{
+			m.insert_batch( batch.begin(), batch.end() );
+			m.erase_batch( batch_keys[b].begin(), batch_keys[b].end() );
+		}
+		else
+		{
+			for ( auto& pair : batch )
+			{
+				m.insert( pair.first, pair.second );
+			}
+			for ( auto& pair : batch )
+			{
+				m.erase( pair.first );
+			}
+		}
+		items += 2 * batch.size();
+		b = ( b + 1 ) % batch_count;
+	}
+	state.SetItemsProcessed( static_cast<std::int64_t>( items ) );
+}
+
+void BM_erase_range( benchmark::State& state )
+{
+	// Erases range(0) consecutive keys from the middle of a map of 1M keys; range(1): 0 - key by key,
+	// 1 - with erase( first, last ). The keys are inserted back with the clock stopped.
+	constexpr std::uint64_t n = 1000000;
+	auto k = static_cast<std::uint64_t>( state.range( 0 ) );
+	auto is_range = state.range( 1 ) != 0;
+	auto m = s_get_handle_map( n, 1, 0 );
+	std::uint64_t lo = n / 3;
+	for ( auto _ : state )
+	{
+		if ( is_range )
+		{
+			m.erase( m.lower_bound( lo ), m.lower_bound( lo + k ) );
+		}
+		else
+		{
+			for ( auto key = lo; key < lo + k; ++key )
+			{
+				m.erase( key );
+			}
+		}
+		state.PauseTiming();
+		for ( auto key = lo; key < lo + k; ++key )
+		{
+			m.insert( key, key );
+		}
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed( state.iterations() * k );
+}
+
+void BM_move_entries( benchmark::State& state )
+{
+	// Moves range(0) entries with long values between two maps of 100K keys, there and back in turns, as
+	// a rebalancing of partitions does; range(1): 0 - at(), erase() and insert(), 1 - extract() and insert(),
+	// 2 - merge() of a map with the moved entries.
+	constexpr int n = 100000;
+	auto k = static_cast<int>( state.range( 0 ) );
+	auto mode = state.range( 1 );
+	EKMap a;
+	EKMap b;
+	for ( int key = 0; key < n; ++key )
+	{
+		a.insert( 2 * key, bench::value_for( 2 * key ) );
+		b.insert( 2 * key + 1, bench::value_for( 2 * key + 1 ) );
+	}
+	for ( int key = 0; key < k; ++key )
+	{
+		a.insert( 2 * n + key, std::string( 40, 'x' ) + bench::value_for( key ) );
+	}
+
+	auto allocations_before = bench::allocation_count();
+	for ( auto _ : state )
+	{
+		if ( mode == 0 )
+		{
+			for ( int key = 2 * n; key < 2 * n + k; ++key )
+			{
+				b.insert( key, a.at( key ) );
+				a.erase( key );
+			}
+		}
+		else if ( mode == 1 )
+		{
+			for ( int key = 2 * n; key < 2 * n + k; ++key )
+			{
+				b.insert( a.extract( key ) );
+			}
+		}
+		else
+		{
+			EKMap moved;
+			for ( int key = 2 * n; key < 2 * n + k; ++key )
+			{
+				moved.insert( a.extract( key ) );
+			}
+			b.merge( moved );
+		}
+		std::swap( a, b );
+	}
+	auto allocations = bench::allocation_count() - allocations_before;
+
+	state.SetItemsProcessed( state.iterations() * k );
+	state.counters["allocs/op"] = static_cast<double>( allocations ) / ( state.iterations() * double( k ) );
+}
+
+void BM_lookup_latency( benchmark::State& state )
+{
+	// Keys form one random cycle: the value of a key is the next key to look up. Lookups depend on each other
+	// and don't overlap, so the time is the latency of one descent, mostly cache misses on big maps.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	EKHandleMap m;
+	{
+		auto keys = bench::random_keys( n );
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> pairs( n );
+		for ( std::size_t i = 0; i < n; ++i )
+		{
+			auto key = static_cast<std::size_t>( keys[i] );
+			pairs[key] = { key, static_cast<std::uint64_t>( keys[( i + 1 ) % n] ) };
+		}
+		m.assign_sorted( pairs.begin(), pairs.end() );
+	}
+	std::uint64_t key = 0;
+	for ( auto _ : state )
+	{
+		key = m.find( key )->second;
+	}
+	benchmark::DoNotOptimize( key );
+	state.counters["rss_MB"] = bench::resident_set_size() / ( 1024.0 * 1024.0 );
+}
+
+void BM_validate( benchmark::State& state )
+{
+	// A canary checks the map after every 1000 insertions and erasures. Mode 0 checks the whole tree,
+	// mode 1 only the paths and subtrees of every 64th changed key.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	bool incremental = state.range( 1 ) != 0;
+	auto keys = bench::random_keys( n );
+	EKMap m;
+	for ( auto key : keys )
+	{
+		s_insert( m, key, bench::value_for( key ) );
+	}
+	if ( incremental )
+	{
+		m.track_changes( 64 );
+	}
+
+	std::size_t i = 0;
+	std::size_t nodes_checked = 0;
+	for ( auto _ : state )
+	{
+		state.PauseTiming();
+		for ( int j = 0; j < 500; ++j )
+		{
+			auto key = keys[i];
+			s_erase( m, key );
+			s_insert( m, key, bench::value_for( key ) );
+			i = ( i + 1 < n ) ? i + 1 : 0;
+		}
+		state.ResumeTiming();
+		auto report = incremental ? m.validate_changes() : m.validate();
+		nodes_checked += report.nodes_checked;
+		benchmark::DoNotOptimize( report );
+	}
+	state.counters["nodes/check"] = static_cast<double>( nodes_checked ) / double( state.iterations() );
+}
+
+} // nameless namespace
+
+BENCHMARK_TEMPLATE( BM_insert_erase_churn, EKMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_insert_erase_churn, StdMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_fill_and_destroy, EKMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_fill_and_destroy, StdMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_copy, EKMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1 } } );
+BENCHMARK_TEMPLATE( BM_copy, StdMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1 } } );
+BENCHMARK( BM_copy_parallel )->ArgsProduct( { { 100000, 1000000 }, { 2, 4 } } );
+// range(1) is the order of keys: 0 - sequential, 1 - random, 2 - Zipf
+BENCHMARK_TEMPLATE( BM_insert_keys, EKMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK_TEMPLATE( BM_insert_keys, StdMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK_TEMPLATE( BM_find_keys, EKMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK_TEMPLATE( BM_find_keys, StdMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK_TEMPLATE( BM_erase_keys, EKMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK_TEMPLATE( BM_erase_keys, StdMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK_TEMPLATE( BM_mixed, EKMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK_TEMPLATE( BM_mixed, StdMap )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK_TEMPLATE( BM_find, EKMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_find, EKHandleMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK( BM_find_frozen )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK( BM_update_batch )->ArgsProduct( { { 16, 256, 4096, 65536 }, { 0, 1 } } );
+BENCHMARK( BM_append_monotonic )->ArgsProduct( { { 1000, 1000000 }, { 0, 1, 2 } } );
+BENCHMARK( BM_move_entries )->ArgsProduct( { { 16, 1024, 65536 }, { 0, 1, 2 } } );
+BENCHMARK( BM_erase_range )->ArgsProduct( { { 1, 10, 1000, 100000 }, { 0, 1 } } );
+BENCHMARK( BM_find_batch )->ArgsProduct( { { 10000, 1000000 }, { 64, 1024 }, { 0, 1 } } );
+BENCHMARK( BM_validate )->ArgsProduct( { { 1000, 100000, 1000000 }, { 0, 1 } } );
+
+BENCHMARK_TEMPLATE( BM_iterate_arrow, EKMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_iterate_arrow, EKThreadedMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_iterate_arrow, StdMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK( BM_at_long_values )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK( BM_startup_repeated_insert )->RangeMultiplier( 10 )->Range( 1000, 10000000 )->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_startup_sorted_bulk_build )->RangeMultiplier( 10 )->Range( 1000, 10000000 )->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_startup_unsorted_bulk_build )->RangeMultiplier( 10 )->Range( 1000, 10000000 )->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_startup_parallel_bulk_build )->ArgsProduct( { { 1000000, 10000000 }, { 0, 2, 4, 8 } } )->UseRealTime()
+	->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_full_scan )->ArgsProduct( { { 1000000, 10000000 }, { 0, 2, 4, 8 } } )->UseRealTime()->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_lookup_latency )->Arg( 1000000 )->Arg( 10000000 )->Arg( 100000000 );
+// Every iteration copies the big map with paused timing, so the iteration count is fixed.
+BENCHMARK( BM_reconcile_insert_each )->RangeMultiplier( 10 )->Range( 1000, 1000000 )->Iterations( 10 )
+	->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_reconcile_set_union )->ArgsProduct( { { 1000, 10000, 100000, 1000000 }, { 0, 4 } } )->Iterations( 10 )
+	->Unit( benchmark::kMillisecond );
+
+BENCHMARK_MAIN();
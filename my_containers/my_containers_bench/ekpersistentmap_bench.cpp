@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <benchmark/benchmark.h>
+
+#include "bench_util.h"
+#include "../my_containers/ekmap.h"
+#include "../my_containers/ekpersistentmap.h"
+
+namespace
+{
+
+using EKMap = EK::Map<std::uint64_t, std::uint64_t>;
+using PersistentMap = EK::PersistentMap<std::uint64_t, std::uint64_t>;
+
+template<typename MapType>
+MapType s_get_map( std::size_t n )
+{
+	MapType m;
+	for ( auto key : bench::random_keys( n ) )
+	{
+		m.insert( key, key );
+	}
+	return m;
+}
+
+template<typename MapType>
+void BM_snapshot_per_report( benchmark::State& state )
+{
+	// A report takes a snapshot of the map, then the map gets 10 updates before the next report.
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto m = s_get_map<MapType>( n );
+	std::uint64_t key = 0;
+	for ( auto _ : state )
+	{
+		MapType snapshot( m );
+		benchmark::DoNotOptimize( snapshot );
+		for ( int i = 0; i < 10; ++i )
+		{
+			key = ( key + 7919 ) % n;
+			m.insert( key, key + 1 );
+		}
+	}
+	state.SetItemsProcessed( state.iterations() );
+}
+
+template<typename MapType>
+void BM_insert_random( benchmark::State& state )
+{
+	// the price of path copying for plain updates
+	auto n = static_cast<std::size_t>( state.range( 0 ) );
+	auto keys = bench::random_keys( n );
+	for ( auto _ : state )
+	{
+		MapType m;
+		for ( auto key : keys )
+		{
+			m.insert( key, key );
+		}
+		benchmark::DoNotOptimize( m );
+	}
+	state.SetItemsProcessed( state.iterations() * n );
+}
+
+} // nameless namespace
+
+BENCHMARK_TEMPLATE( BM_snapshot_per_report, EKMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_snapshot_per_report, PersistentMap )->RangeMultiplier( 10 )->Range( 1000, 1000000 );
+BENCHMARK_TEMPLATE( BM_insert_random, EKMap )->Arg( 100000 )->Unit( benchmark::kMillisecond );
+BENCHMARK_TEMPLATE( BM_insert_random, PersistentMap )->Arg( 100000 )->Unit( benchmark::kMillisecond );
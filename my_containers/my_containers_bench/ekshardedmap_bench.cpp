@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <benchmark/benchmark.h>
+
+#include "bench_util.h"
+#include "../my_containers/ekshardedmap.h"
+
+namespace
+{
+
+// A write-heavy load: a map of about 100K keys shared by all threads, 9 of 10 operations are
+// insertions and erasures of random keys.
+constexpr int s_key_count = 100000;
+constexpr int s_read_period = 10;
+
+class MutexMap
+{
+	// one mutex around the map, as in ekconcurrentmap_bench.cpp
+public:
+	bool contains( int key )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		return map_.contains( key );
+	}
+	void insert( int key, int value )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		map_.insert( key, value );
+	}
+	void erase( int key )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		map_.erase( key );
+	}
+private:
+	std::mutex mutex_;
+	EK::Map<int, int> map_;
+};
+
+using ShardedMap = EK::ShardedMap<int, int>;
+
+template<typename MapType>
+std::unique_ptr<MapType> s_shared_map;
+
+template<typename MapType>
+void BM_write_heavy( benchmark::State& state )
+{
+	if ( state.thread_index() == 0 )
+	{
+		s_shared_map<MapType> = std::make_unique<MapType>();
+		for ( auto key : bench::random_keys( s_key_count ) )
+		{
+			s_shared_map<MapType>->insert( key, key );
+		}
+	}
+	// Threads erase and insert keys of the same range by turns, so the size stays about the same.
+	auto keys = bench::random_keys( s_key_count, state.thread_index() + 1 );
+	std::size_t i = 0;
+	std::size_t found = 0;
+	for ( auto _ : state )
+	{
+		auto key = keys[i % keys.size()];
+		if ( i % s_read_period == 0 )
+		{
+			found += s_shared_map<MapType>->contains( key ) ? 1 : 0;
+		}
+		else if ( i % 2 == 0 )
+		{
+			s_shared_map<MapType>->erase( key );
+		}
+		else
+		{
+			s_shared_map<MapType>->insert( key, key );
+		}
+		++i;
+	}
+	benchmark::DoNotOptimize( found );
+	state.SetItemsProcessed( state.iterations() );
+	if ( state.thread_index() == 0 )
+	{
+		s_shared_map<MapType>.reset();
+	}
+}
+
+template<typename MapType>
+void BM_append_heavy( benchmark::State& state )
+{
+	// Every thread appends ascending keys of its own, so all the insertions go to the top of the key space
+	// and the sharded map has to rebalance as it grows.
+	if ( state.thread_index() == 0 )
+	{
+		s_shared_map<MapType> = std::make_unique<MapType>();
+	}
+	int key = state.thread_index();
+	auto step = state.threads();
+	for ( auto _ : state )
+	{
+		s_shared_map<MapType>->insert( key, key );
+		key += step;
+	}
+	state.SetItemsProcessed( state.iterations() );
+	if ( state.thread_index() == 0 )
+	{
+		s_shared_map<MapType>.reset();
+	}
+}
+
+int s_max_threads()
+{
+	return static_cast<int>( std::max( 2u, std::thread::hardware_concurrency() ) );
+}
+
+} // nameless namespace
+
+// items_per_second is the total over the threads, so it shows the scaling.
+BENCHMARK_TEMPLATE( BM_write_heavy, MutexMap )->ThreadRange( 1, s_max_threads() )->UseRealTime();
+BENCHMARK_TEMPLATE( BM_write_heavy, ShardedMap )->ThreadRange( 1, s_max_threads() )->UseRealTime();
+BENCHMARK_TEMPLATE( BM_append_heavy, MutexMap )->ThreadRange( 1, s_max_threads() )->UseRealTime();
+BENCHMARK_TEMPLATE( BM_append_heavy, ShardedMap )->ThreadRange( 1, s_max_threads() )->UseRealTime();
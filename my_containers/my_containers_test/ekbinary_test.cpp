@@ -0,0 +1,121 @@
+#include "pch.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include "../my_containers/ekbinary.h"
+#include "../my_containers/ekmap.h"
+
+namespace
+{
+
+std::string s_get_temp_path( const std::string& name )
+{
+	return ::testing::TempDir() + name;
+}
+
+} // namespace
+
+TEST( ekbinary, write_and_map )
+{
+	auto path = s_get_temp_path( "ekbinary_write_and_map.bin" );
+	EK::Map<int, std::string> m;
+	for ( int i = 0; i < 1000; ++i )
+	{
+		m.insert( 3 * i, std::string( static_cast<std::size_t>( i % 50 ), 'x' ) + std::to_string( i ) );
+	}
+	EK::write_binary( path, m );
+
+	{
+		EK::MappedMap<int, std::string> mapped( path );
+		EXPECT_EQ( mapped.size(), 1000 );
+		EXPECT_FALSE( mapped.empty() );
+		EXPECT_EQ( mapped.at( 30 ), m.at( 30 ) );
+		EXPECT_EQ( mapped.at( 0 ), "0" );
+		EXPECT_TRUE( mapped.contains( 2997 ) );
+		EXPECT_FALSE( mapped.contains( 31 ) );
+		EXPECT_EQ( mapped.count( -3 ), 0 );
+		EXPECT_THROW( mapped.at( 1 ), std::out_of_range );
+		EXPECT_TRUE( mapped.find( 4 ) == mapped.end() );
+		EXPECT_EQ( ( *mapped.find( 300 ) ).second.get(), m.at( 300 ) );
+
+		auto iter = m.begin();
+		for ( auto entry : mapped )
+		{
+			ASSERT_EQ( entry.first, iter->first );
+			std::string value = entry.second;
+			ASSERT_EQ( value, iter->second );
+			++iter;
+		}
+	}
+
+	auto loaded = EK::load_binary<EK::Map<int, std::string>>( path );
+	EXPECT_TRUE( loaded.check_red_black_tree_properties().empty() );
+	EXPECT_TRUE( std::equal( loaded.begin(), loaded.end(), m.begin(), m.end() ) );
+	auto loaded_std = EK::load_binary<std::map<int, std::string>>( path );
+	EXPECT_TRUE( std::equal( loaded_std.begin(), loaded_std.end(), m.begin(), m.end() ) );
+	std::remove( path.c_str() );
+}
+
+TEST( ekbinary, insert_batch_from_mapped_map )
+{
+	// The iterators of MappedMap give entries by value, a big map looks their keys up by lanes.
+	auto path = s_get_temp_path( "ekbinary_insert_batch.bin" );
+	EK::Map<int, int> m;
+	for ( int i = 0; i < 200000; ++i )
+	{
+		m.insert( i, 2 * i );
+	}
+	EK::write_binary( path, m );
+	{
+		EK::MappedMap<int, int> mapped( path );
+		EK::Map<int, int> target;
+		for ( int i = 0; i < 200000; i += 2 )
+		{
+			target.insert( i, -1 );
+		}
+		target.insert_batch( mapped.begin(), mapped.end() );
+		EXPECT_TRUE( std::equal( target.begin(), target.end(), m.begin(), m.end() ) );
+	}
+	std::remove( path.c_str() );
+}
+
+TEST( ekbinary, trivial_values_and_empty_maps )
+{
+	auto path = s_get_temp_path( "ekbinary_trivial_values.bin" );
+	std::map<std::uint64_t, double> m = { { 1, 0.5 }, { 10, -2.0 }, { 1ull << 40, 1e100 } };
+	EK::write_binary( path, m );
+	EK::MappedMap<std::uint64_t, double> mapped( path );
+	EXPECT_EQ( mapped.at( 1ull << 40 ), 1e100 );
+	EXPECT_EQ( mapped.at( 10 ), -2.0 );
+
+	EK::write_binary( path + "2", EK::Map<int, std::string>() );
+	EK::MappedMap<int, std::string> empty( path + "2" );
+	EXPECT_TRUE( empty.empty() );
+	EXPECT_TRUE( empty.begin() == empty.end() );
+	EXPECT_EQ( ( EK::load_binary<EK::Map<int, std::string>>( path + "2" ).size() ), 0 );
+	std::remove( path.c_str() );
+	std::remove( ( path + "2" ).c_str() );
+}
+
+TEST( ekbinary, wrong_files )
+{
+	auto path = s_get_temp_path( "ekbinary_wrong_files.bin" );
+	EXPECT_THROW( ( EK::MappedMap<int, int>( path + "absent" ) ), std::runtime_error );
+
+	std::ofstream( path ) << "key value\n";
+	EXPECT_THROW( ( EK::MappedMap<int, int>( path ) ), std::runtime_error );
+
+	EK::write_binary( path, EK::Map<int, int>( { { 1, 1 } } ) );
+	EXPECT_THROW( ( EK::MappedMap<std::uint64_t, int>( path ) ), std::runtime_error ); // another key type
+
+	EK::write_binary( path, EK::Map<int, std::string>( { { 1, "Aharon" } } ) );
+	std::ifstream in( path, std::ios::binary );
+	std::string content( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+	in.close();
+	std::ofstream( path, std::ios::binary ) << content.substr( 0, content.size() - 2 ); // a cut value
+	EXPECT_THROW( ( EK::MappedMap<int, std::string>( path ) ), std::runtime_error );
+	std::remove( path.c_str() );
+}
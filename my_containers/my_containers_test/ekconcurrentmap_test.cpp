@@ -0,0 +1,83 @@
+#include "pch.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../my_containers/ekconcurrentmap.h"
+
+TEST( ekconcurrentmap, single_thread )
+{
+	EK::ConcurrentMap<int, std::string> m( { { 1, "Aharon" }, { 2, "Baruch" } } );
+	EXPECT_EQ( m.size(), 2 );
+	m.insert( 3, "Sarah" );
+	EXPECT_EQ( m.at( 3 ), "Sarah" );
+	EXPECT_EQ( m.find( 1 ), std::optional<std::string>( "Aharon" ) );
+	EXPECT_FALSE( m.find( 4 ).has_value() );
+	EXPECT_THROW( m.at( 4 ), std::out_of_range );
+	EXPECT_TRUE( m.erase( 2 ) );
+	EXPECT_FALSE( m.erase( 2 ) );
+	EXPECT_FALSE( m.contains( 2 ) );
+
+	auto snapshot = m.snapshot();
+	m.clear();
+	EXPECT_EQ( m.size(), 0 );
+	EXPECT_EQ( snapshot.size(), 2 );
+}
+
+TEST( ekconcurrentmap, readers_and_writer )
+{
+	// A writer inserts and erases keys with value 2 * key while readers check what they see.
+	EK::ConcurrentMap<int, int> m;
+	std::atomic<bool> done{ false };
+	std::atomic<int> errors{ 0 };
+
+	std::vector<std::thread> readers;
+	for ( int r = 0; r < 4; ++r )
+	{
+		readers.emplace_back( [&, r] {
+			int key = r;
+			while ( !done.load() )
+			{
+				key = ( key + 7 ) % 1000;
+				auto value = m.find( key );
+				if ( value.has_value() && *value != 2 * key )
+				{
+					++errors;
+				}
+				auto sorted = m.read( []( const EK::Map<int, int>& map ) {
+					int previous = -1;
+					for ( auto& pair : map )
+					{
+						if ( pair.first <= previous || pair.second != 2 * pair.first )
+						{
+							return false;
+						}
+						previous = pair.first;
+					}
+					return true;
+				} );
+				if ( !sorted )
+				{
+					++errors;
+				}
+			}
+		} );
+	}
+
+	for ( int i = 0; i < 1000; ++i )
+	{
+		m.insert( i % 1000, 2 * ( i % 1000 ) );
+		if ( i % 3 == 0 )
+		{
+			m.erase( ( i * 31 ) % 1000 );
+		}
+	}
+	done = true;
+	for ( auto& reader : readers )
+	{
+		reader.join();
+	}
+	EXPECT_EQ( errors, 0 );
+	EXPECT_TRUE( m.read( []( const EK::Map<int, int>& map ) { return map.check_red_black_tree_properties(); } ).empty() );
+}
@@ -0,0 +1,82 @@
+#include "pch.h"
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+
+#include "../my_containers/ekmap.h"
+
+TEST( ekfrozenmap, freeze )
+{
+	EK::Map<int, std::string> m = { { 2, "Baruch" }, { 1, "Aharon" }, { 3, "Sarah" } };
+	auto frozen = m.freeze();
+	m.erase( 2 );
+	m.insert( 4, "Mendel" );
+
+	EXPECT_EQ( frozen.size(), 3 );
+	EXPECT_EQ( frozen.at( 2 ), "Baruch" );
+	EXPECT_EQ( frozen.count( 4 ), 0 );
+	EXPECT_TRUE( frozen.find( 4 ) == frozen.end() );
+	EXPECT_EQ( frozen.find( 3 )->second, "Sarah" );
+	EXPECT_THROW( frozen.at( 0 ), std::out_of_range );
+
+	EK::Map<int, std::string> empty;
+	auto frozen_empty = empty.freeze();
+	EXPECT_TRUE( frozen_empty.empty() );
+	EXPECT_TRUE( frozen_empty.begin() == frozen_empty.end() );
+	EXPECT_FALSE( frozen_empty.contains( 1 ) );
+}
+
+TEST( ekfrozenmap, all_sizes )
+{
+	// every size up to 300 gives a different shape of the last level of the implicit tree
+	std::mt19937 gen( 5 );
+	EK::Map<int, int> m;
+	std::map<int, int> reference;
+	for ( int size = 1; size <= 300; ++size )
+	{
+		int key = 0;
+		do
+		{
+			key = static_cast<int>( gen() % 2000 ) * 2; // odd keys are absent
+		} while ( reference.count( key ) != 0 );
+		m.insert( key, size );
+		reference[key] = size;
+
+		auto frozen = m.freeze();
+		ASSERT_EQ( frozen.size(), reference.size() );
+		auto iter = frozen.begin();
+		for ( auto& pair : reference )
+		{
+			ASSERT_TRUE( iter != frozen.end() );
+			EXPECT_EQ( iter->first, pair.first );
+			EXPECT_EQ( iter->second, pair.second );
+			EXPECT_EQ( frozen.at( pair.first ), pair.second );
+			EXPECT_FALSE( frozen.contains( pair.first + 1 ) );
+			EXPECT_FALSE( frozen.contains( pair.first - 1 ) );
+			++iter;
+		}
+		EXPECT_TRUE( iter == frozen.end() );
+	}
+}
+
+TEST( ekfrozenmap, reverse_order )
+{
+	EK::Map<int, int, std::greater<int>> m;
+	for ( int i = 0; i < 50; ++i )
+	{
+		m.insert( i, i * i );
+	}
+	auto frozen = m.freeze();
+	int expected = 49;
+	for ( auto& pair : frozen )
+	{
+		EXPECT_EQ( pair.first, expected );
+		EXPECT_EQ( pair.second, expected * expected );
+		--expected;
+	}
+	EXPECT_EQ( expected, -1 );
+	EXPECT_EQ( frozen.at( 7 ), 49 );
+	EXPECT_FALSE( frozen.contains( 50 ) );
+	EXPECT_FALSE( frozen.contains( -1 ) );
+}
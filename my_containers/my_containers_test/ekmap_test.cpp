@@ -1,9 +1,18 @@
 #include "pch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
 #include <random>
+#include <set>
+#include <string>
+#include <string_view>
 
 #include "../my_containers/ekmap.h"
-#include "../my_containers/ekmap.cpp"
 
 namespace
 {
@@ -13,7 +22,7 @@ std::vector<int> s_get_random_order( unsigned n )
 	// returns n numbers in interval [0..n) without repetitions
 	// example for n ==5: -> { 3, 0, 2, 4, 1 }
 	std::vector<int> order( n );
-	for ( int i = 0; i < order.size(); ++i )
+	for ( int i = 0; i < static_cast<int>( order.size() ); ++i )
 	{
 		order[i] = i;
 	}
@@ -36,6 +45,46 @@ void s_erase_elt_from_list( std::list<std::pair<int, std::string>>& list, int ke
 	assert( false );
 }
 
+template<typename T>
+struct TaggedAllocator
+{
+	// Stateful allocator: maps with allocators of different tags can't share nodes.
+	using value_type = T;
+	int tag = 0;
+
+	TaggedAllocator() = default;
+	explicit TaggedAllocator( int tag ) : tag( tag ) {}
+	template<typename U>
+	TaggedAllocator( const TaggedAllocator<U>& other ) : tag( other.tag ) {}
+	T * allocate( std::size_t n ) { return std::allocator<T>().allocate( n ); }
+	void deallocate( T * p, std::size_t n ) { std::allocator<T>().deallocate( p, n ); }
+	template<typename U>
+	bool operator==( const TaggedAllocator<U>& other ) const { return tag == other.tag; }
+	template<typename U>
+	bool operator!=( const TaggedAllocator<U>& other ) const { return tag != other.tag; }
+};
+
+template<typename Value>
+class ByValueIterator
+{
+	// Forward iterator that gives copies of the elements of a vector, as proxy and transform iterators do.
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = Value;
+	using difference_type = std::ptrdiff_t;
+	using pointer = void;
+	using reference = Value;
+
+	explicit ByValueIterator( typename std::vector<Value>::const_iterator iter ) : iter_( iter ) {}
+	Value operator*() const { return *iter_; }
+	ByValueIterator& operator++() { ++iter_; return *this; }
+	ByValueIterator operator++( int ) { auto old = *this; ++iter_; return old; }
+	bool operator==( const ByValueIterator& other ) const { return iter_ == other.iter_; }
+	bool operator!=( const ByValueIterator& other ) const { return iter_ != other.iter_; }
+private:
+	typename std::vector<Value>::const_iterator iter_;
+};
+
 } // nameless namespace
 
 TEST(ekmap, insertion )
@@ -146,7 +195,7 @@ TEST( ekmap, multi_erase )
 	std::list<std::pair<int, std::string>> control_list;
 	auto m = EK::Map();
 	size_t n = 100;
-	for ( int i = 0; i < n; ++i )
+	for ( int i = 0; i < static_cast<int>( n ); ++i )
 	{
 		auto pair = std::make_pair( i, std::to_string( i * 100 ) );
 		control_list.push_back( pair );
@@ -155,7 +204,7 @@ TEST( ekmap, multi_erase )
 
 	auto r_order = s_get_random_order( n );
 
-	for ( int i = 0; i < n; ++i )
+	for ( int i = 0; i < static_cast<int>( n ); ++i )
 	{
 		EXPECT_EQ( m.size(), n - i );
 		int key = r_order[i];
@@ -272,4 +321,1289 @@ TEST( ekmap, move_pair_insertion )
 	EXPECT_EQ( m.size(), 1 );
 	EXPECT_EQ( m.at(7), "Solomon" );
 	EXPECT_EQ( pair.second, "" );
-}
\ No newline at end of file
+}
+
+TEST( ekmap, clear )
+{
+	auto m = EK::Map( { { 3, "Aharon" }, { 6, "Baruch" }, { 10, "Sarah" } } );
+	m.clear();
+	EXPECT_EQ( m.size(), 0 );
+	EXPECT_EQ( m.begin(), m.end() );
+	m.insert( 4, "Sarah" );
+	EXPECT_EQ( m.size(), 1 );
+	EXPECT_EQ( m.at( 4 ), "Sarah" );
+}
+
+TEST( ekmap, self_assignment )
+{
+	const std::vector<std::pair<int, std::string>> control =
+		{ { 3, "Aharon" }, { 6, "Baruch" }, { 10, "Sarah" } }; // must be ordered by key
+	EK::Map m( control );
+	auto& same = m;
+	m = same;
+
+	auto control_iter = control.begin();
+	for ( auto& pair : m )
+	{
+		EXPECT_EQ( pair.first, control_iter->first );
+		EXPECT_EQ( pair.second, control_iter->second );
+		++control_iter;
+	}
+	EXPECT_EQ( control_iter, control.end() );
+}
+
+TEST( ekmap, count )
+{
+	const EK::Map m = { { 10, "Aharon" }, { 6, "Baruch" }, { 3, "Sarah" } };
+	EXPECT_EQ( m.count( 6 ), 1 );
+	EXPECT_EQ( m.count( 7 ), 0 );
+}
+
+TEST( ekmap, generic_key_and_value )
+{
+	EK::Map<std::string, std::uint64_t> m;
+	m.insert( "Sarah", 3 );
+	m.insert( "Aharon", 1 );
+	m.insert( "Baruch", 2 );
+	EXPECT_EQ( m.at( "Baruch" ), 2 );
+	EXPECT_EQ( m.begin()->first, "Aharon" );
+	EXPECT_EQ( m.rbegin()->first, "Sarah" );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekmap, custom_comparator )
+{
+	EK::Map<int, std::string, std::greater<int>> m = { { 3, "Aharon" }, { 6, "Baruch" }, { 10, "Sarah" } };
+	std::vector<int> right_order = { 10, 6, 3 };
+	size_t counter = 0;
+	for ( auto iter = m.begin(); iter != m.end(); ++iter )
+	{
+		EXPECT_EQ( iter->first, right_order[counter] );
+		counter++;
+	}
+	EXPECT_EQ( counter, 3 );
+
+	m.erase( 6 );
+	EXPECT_EQ( m.count( 6 ), 0 );
+	EXPECT_EQ( m.at( 10 ), "Sarah" );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekmap, sorted_bulk_build )
+{
+	for ( int n = 0; n < 300; ++n )
+	{
+		std::vector<std::pair<int, std::string>> pairs;
+		for ( int i = 0; i < n; ++i )
+		{
+			pairs.push_back( { i * 2, std::to_string( i ) } );
+		}
+		EK::Map m( pairs.begin(), pairs.end() );
+		EXPECT_EQ( m.size(), n );
+		EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+
+		auto pairs_iter = pairs.begin();
+		for ( auto&& pair : m )
+		{
+			EXPECT_EQ( pair.first, pairs_iter->first );
+			EXPECT_EQ( pair.second, pairs_iter->second );
+			++pairs_iter;
+		}
+		EXPECT_EQ( pairs_iter, pairs.end() );
+
+		// the tree must stay valid for usual updates
+		m.insert( 1, "one" );
+		m.erase( 0 );
+		EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+	}
+}
+
+TEST( ekmap, unsorted_bulk_build )
+{
+	const std::list<std::pair<int, std::string>> pairs =
+		{ { 10, "Aharon" }, { 6, "Baruch" }, { 3, "Sarah" }, { 5, "Mendel" }, { 6, "Ichak" } };
+	std::vector<std::pair<int, std::string>> right_order =
+		{ { 3, "Sarah" }, { 5, "Mendel" }, { 6, "Ichak" }, { 10, "Aharon" } };
+
+	EK::Map m( pairs.begin(), pairs.end() );
+	EXPECT_EQ( m.size(), 4 );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+	size_t counter = 0;
+	for ( auto&& pair : m )
+	{
+		EXPECT_EQ( pair.first, right_order[counter].first );
+		EXPECT_EQ( pair.second, right_order[counter].second );
+		counter++;
+	}
+	EXPECT_EQ( counter, 4 );
+}
+
+TEST( ekmap, assign_sorted )
+{
+	EK::Map m = { { 1, "Aharon" }, { 2, "Baruch" } };
+	const std::map<int, std::string> source = { { 3, "Sarah" }, { 5, "Mendel" }, { 6, "Ichak" } };
+	m.assign_sorted( source.begin(), source.end() );
+	EXPECT_EQ( m.size(), 3 );
+	EXPECT_EQ( m.count( 1 ), 0 );
+	EXPECT_EQ( m.at( 5 ), "Mendel" );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekmap, iterator_references )
+{
+	EK::Map m = { { 3, "Aharon" }, { 6, "Baruch" }, { 10, "Sarah" } };
+	auto iter = m.find( 6 );
+	iter->second = "Mendel";
+	( *m.begin() ).second += "!";
+	EXPECT_EQ( m.at( 6 ), "Mendel" );
+	EXPECT_EQ( m.at( 3 ), "Aharon!" );
+	EXPECT_EQ( &iter->second, &( *iter ).second ); // no temporaries behind the iterator
+
+	EK::Map<>::CIterator citer = iter;
+	EXPECT_EQ( citer->first, 6 );
+	EXPECT_EQ( std::distance( m.begin(), m.end() ), 3 );
+	auto found = std::find_if( m.begin(), m.end(), []( const auto& pair ) { return pair.second == "Sarah"; } );
+	EXPECT_EQ( found->first, 10 );
+}
+
+TEST( ekmap, at_returns_reference )
+{
+	EK::Map m = { { 3, "Aharon" }, { 6, "Baruch" } };
+	m.at( 6 ) += " ben Neriah";
+	EXPECT_EQ( m.at( 6 ), "Baruch ben Neriah" );
+	const auto& cm = m;
+	EXPECT_EQ( &cm.at( 3 ), &m.at( 3 ) );
+	ASSERT_THROW( m.at( 1 ), std::out_of_range );
+}
+
+TEST( ekmap, subscript_operator )
+{
+	EK::Map m;
+	m[3] = "Aharon";
+	m[3] += "!";
+	EXPECT_EQ( m[6], "" ); // default constructed
+	EXPECT_EQ( m.size(), 2 );
+	EXPECT_EQ( m.at( 3 ), "Aharon!" );
+}
+
+TEST( ekmap, try_emplace_and_insert_or_assign )
+{
+	EK::Map m;
+	auto result = m.try_emplace( 3, 5, 'a' );
+	EXPECT_TRUE( result.second );
+	EXPECT_EQ( result.first->second, "aaaaa" );
+
+	std::string value = "Sarah";
+	result = m.try_emplace( 3, std::move( value ) );
+	EXPECT_FALSE( result.second );
+	EXPECT_EQ( result.first->second, "aaaaa" );
+	EXPECT_EQ( value, "Sarah" ); // must not be moved from if the key exists
+
+	result = m.insert_or_assign( 3, "Baruch" );
+	EXPECT_FALSE( result.second );
+	EXPECT_EQ( m.at( 3 ), "Baruch" );
+	result = m.insert_or_assign( 4, "Mendel" );
+	EXPECT_TRUE( result.second );
+	EXPECT_EQ( m.size(), 2 );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekmap, emplace_hint )
+{
+	EK::Map m;
+	for ( int i = 0; i < 100; ++i )
+	{
+		auto iter = m.emplace_hint( m.end(), i, std::to_string( i ) );
+		EXPECT_EQ( iter->first, i );
+	}
+	auto iter = m.emplace_hint( m.begin(), 50, "fifty" );
+	EXPECT_EQ( iter->second, "50" ); // existing element is not replaced
+	EXPECT_EQ( m.size(), 100 );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekmap, transparent_lookup )
+{
+	EK::Map<std::string, int, std::less<>> m = { { "Aharon", 1 }, { "Baruch", 2 }, { "Sarah", 3 } };
+	std::string_view name = "Baruch";
+	EXPECT_EQ( m.find( name )->second, 2 );
+	EXPECT_EQ( m.count( "Sarah" ), 1 );
+	EXPECT_TRUE( m.contains( name ) );
+	EXPECT_FALSE( m.contains( "Mendel" ) );
+	m.at( name ) = 20;
+	EXPECT_EQ( m.at( "Baruch" ), 20 );
+	m.erase( name );
+	EXPECT_EQ( m.size(), 2 );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekmap, order_statistics )
+{
+	EK::OrderStatisticMap<int, int> m;
+	std::map<int, int> reference;
+	std::mt19937 gen( 5 );
+	std::uniform_int_distribution<int> key_distribution( 0, 999 );
+	for ( int i = 0; i < 3000; ++i )
+	{
+		auto key = key_distribution( gen );
+		if ( gen() % 3 == 0 )
+		{
+			m.erase( key );
+			reference.erase( key );
+		}
+		else
+		{
+			m.insert( key, i );
+			reference[key] = i;
+		}
+	}
+	ASSERT_EQ( m.size(), reference.size() );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+
+	std::size_t k = 0;
+	for ( auto& [key, value] : reference )
+	{
+		EXPECT_EQ( m.rank( key ), k );
+		EXPECT_EQ( m.select( k )->first, key );
+		++k;
+	}
+	EXPECT_EQ( m.select( m.size() ), m.end() );
+	EXPECT_EQ( m.rank( 1000 ), m.size() );
+
+	auto expected = std::distance( reference.lower_bound( 100 ), reference.lower_bound( 300 ) );
+	EXPECT_EQ( m.count_range( 100, 300 ), static_cast<std::size_t>( expected ) );
+	EXPECT_EQ( m.count_range( 300, 100 ), 0 );
+
+	auto copy = m;
+	EXPECT_TRUE( copy.check_red_black_tree_properties().empty() );
+	EXPECT_EQ( copy.select( 10 )->first, m.select( 10 )->first );
+
+	EK::OrderStatisticMap<int, int> built = { { 1, 1 }, { 2, 2 }, { 3, 3 }, { 4, 4 }, { 5, 5 } };
+	EXPECT_TRUE( built.check_red_black_tree_properties().empty() );
+	EXPECT_EQ( built.select( 3 )->first, 4 );
+	EXPECT_EQ( built.rank( 3 ), 2 );
+}
+
+TEST( ekmap, range_reductions )
+{
+	EK::AugmentedMap<int, long long, EK::SubtreeSum<long long>> sums;
+	EK::AugmentedMap<int, int, EK::SubtreeMin<int>> minimums;
+	EK::AugmentedMap<int, int, EK::SubtreeMax<int>> maximums;
+	std::map<int, int> reference;
+	std::mt19937 gen( 7 );
+	for ( int i = 0; i < 2000; ++i )
+	{
+		int key = gen() % 500;
+		int value = static_cast<int>( gen() % 10000 ) - 5000;
+		if ( gen() % 4 == 0 )
+		{
+			sums.erase( key );
+			minimums.erase( key );
+			maximums.erase( key );
+			reference.erase( key );
+		}
+		else
+		{
+			sums.insert( key, value );
+			minimums.insert( key, value );
+			maximums.insert( key, value );
+			reference[key] = value;
+		}
+	}
+	EXPECT_TRUE( sums.check_red_black_tree_properties().empty() );
+	EXPECT_TRUE( minimums.check_red_black_tree_properties().empty() );
+	EXPECT_TRUE( maximums.check_red_black_tree_properties().empty() );
+
+	for ( int lo = -10; lo < 510; lo += 37 )
+	{
+		for ( int hi = lo; hi < 520; hi += 53 )
+		{
+			long long sum = 0;
+			std::optional<int> min;
+			std::optional<int> max;
+			for ( auto iter = reference.lower_bound( lo ); iter != reference.lower_bound( hi ); ++iter )
+			{
+				sum += iter->second;
+				min = min ? std::min( *min, iter->second ) : iter->second;
+				max = max ? std::max( *max, iter->second ) : iter->second;
+			}
+			EXPECT_EQ( sums.reduce( lo, hi ).value_or( 0 ), sum );
+			EXPECT_EQ( minimums.reduce( lo, hi ), min );
+			EXPECT_EQ( maximums.reduce( lo, hi ), max );
+		}
+	}
+
+	auto key = reference.begin()->first;
+	sums.at( key ) += 1000;
+	sums.refresh( sums.find( key ) );
+	EXPECT_TRUE( sums.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekmap, interval_overlap )
+{
+	using Interval = std::pair<int, int>;
+	EK::AugmentedMap<Interval, int, EK::IntervalMaxEnd<int>> intervals;
+	std::vector<Interval> reference;
+	std::mt19937 gen( 11 );
+	for ( int i = 0; i < 1000; ++i )
+	{
+		int start = gen() % 10000;
+		Interval interval( start, start + 1 + gen() % 200 );
+		if ( i % 5 == 4 )
+		{
+			// erase one of the intervals
+			auto erased = reference[gen() % reference.size()];
+			intervals.erase( erased );
+			reference.erase( std::find( reference.begin(), reference.end(), erased ) );
+		}
+		else if ( !intervals.contains( interval ) )
+		{
+			intervals.insert( interval, i );
+			reference.push_back( interval );
+		}
+	}
+	std::sort( reference.begin(), reference.end() );
+	EXPECT_TRUE( intervals.check_red_black_tree_properties().empty() );
+
+	for ( int start = 0; start < 10300; start += 97 )
+	{
+		Interval query( start, start + 50 );
+		std::vector<Interval> expected;
+		for ( auto& interval : reference )
+		{
+			if ( interval.first < query.second && query.first < interval.second )
+			{
+				expected.push_back( interval );
+			}
+		}
+		std::vector<Interval> found;
+		for ( auto iter : intervals.overlapping( query ) )
+		{
+			found.push_back( iter->first );
+		}
+		EXPECT_EQ( found, expected );
+	}
+	EXPECT_TRUE( intervals.overlapping( Interval( 20000, 20001 ) ).empty() );
+}
+
+TEST( ekmap, copy_keeps_allocator )
+{
+	using TaggedMap = EK::Map<int, int, std::less<int>, TaggedAllocator<std::pair<const int, int>>>;
+	TaggedMap m( std::less<int>(), TaggedAllocator<std::pair<const int, int>>( 7 ) );
+	for ( int i = 0; i < 100; ++i )
+	{
+		m.insert( i, i );
+	}
+	EK::ThreadPool threads( 2 );
+	TaggedMap copy( m );
+	TaggedMap parallel_copy( m, &threads );
+	EXPECT_EQ( copy.get_allocator().tag, 7 );
+	EXPECT_EQ( parallel_copy.get_allocator().tag, 7 );
+	EXPECT_EQ( copy.size(), 100 );
+
+	// equal allocators: the nodes of 'copy' go over as they are
+	m.split( 50 );
+	m.join( copy.split( 50 ) );
+	EXPECT_EQ( m.size(), 100 );
+	EXPECT_TRUE( m.validate().valid() );
+}
+
+TEST( ekmap, move_assignment_keeps_allocator )
+{
+	// TaggedAllocator doesn't propagate on move assignment: with another tag the elements move one by one
+	// into nodes of our allocator, with the same tag the nodes are taken as they are.
+	using TaggedMap = EK::Map<int, std::unique_ptr<int>, std::less<int>, TaggedAllocator<std::pair<const int, std::unique_ptr<int>>>>;
+	using Tagged = TaggedAllocator<std::pair<const int, std::unique_ptr<int>>>;
+	TaggedMap source( std::less<int>(), Tagged( 7 ) );
+	for ( int i = 0; i < 100; ++i )
+	{
+		source.insert( i, std::make_unique<int>( i ) );
+	}
+	auto pointee = source.at( 50 ).get();
+	TaggedMap target( std::less<int>(), Tagged( 8 ) );
+	target.insert( 1000, std::make_unique<int>( 1000 ) );
+	target = std::move( source );
+	EXPECT_EQ( target.get_allocator().tag, 8 );
+	EXPECT_EQ( source.get_allocator().tag, 7 );
+	EXPECT_EQ( target.size(), 100 );
+	EXPECT_EQ( source.size(), 0 );
+	EXPECT_EQ( target.at( 50 ).get(), pointee ); // the value is moved
+	EXPECT_FALSE( target.contains( 1000 ) );
+	EXPECT_TRUE( target.validate().valid() );
+
+	TaggedMap same( std::less<int>(), Tagged( 8 ) );
+	auto node = &target.at( 50 );
+	same = std::move( target );
+	EXPECT_EQ( &same.at( 50 ), node );
+	EXPECT_EQ( same.get_allocator().tag, 8 );
+	EXPECT_FALSE( ( std::is_nothrow_move_assignable_v<TaggedMap> ) );
+	EXPECT_TRUE( ( std::is_nothrow_move_assignable_v<EK::Map<int, int>> ) );
+}
+
+TEST( ekmap, join_and_split )
+{
+	EK::OrderStatisticMap<int, int> left;
+	EK::OrderStatisticMap<int, int> right;
+	for ( int i = 0; i < 1000; ++i )
+	{
+		left.insert( i, i );
+	}
+	for ( int i = 1000; i < 1010; ++i )
+	{
+		right.insert( i, i );
+	}
+	left.join( std::move( right ) );
+	EXPECT_EQ( left.size(), 1010 );
+	EXPECT_EQ( right.size(), 0 );
+	EXPECT_TRUE( left.check_red_black_tree_properties().empty() );
+	EXPECT_EQ( left.select( 1005 )->first, 1005 );
+
+	EK::OrderStatisticMap<int, int> overlapping = { { 500, 0 } };
+	EXPECT_THROW( left.join( std::move( overlapping ) ), std::invalid_argument );
+
+	auto greater = left.split( 300 );
+	EXPECT_EQ( left.size(), 300 );
+	EXPECT_EQ( greater.size(), 710 );
+	EXPECT_TRUE( left.check_red_black_tree_properties().empty() );
+	EXPECT_TRUE( greater.check_red_black_tree_properties().empty() );
+	EXPECT_EQ( left.rbegin()->first, 299 );
+	EXPECT_EQ( greater.begin()->first, 300 );
+
+	EXPECT_THROW( greater.join( std::move( left ) ), std::invalid_argument ); // keys of 'left' are less
+	EXPECT_EQ( greater.size(), 710 );
+	left.join( std::move( greater ) );
+	EXPECT_EQ( left.size(), 1010 );
+	EXPECT_TRUE( left.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekmap, split_without_copies )
+{
+	// The nodes go to the new map as they are: move-only values do, and references stay valid.
+	// Without OrderStatistics the smaller part is counted, which is the right one or the left one.
+	for ( int boundary : { 100, 900 } )
+	{
+		EK::Map<int, std::unique_ptr<int>> m;
+		for ( int i = 0; i < 1000; ++i )
+		{
+			m.insert( i, std::make_unique<int>( i ) );
+		}
+		auto value = &m.at( 950 );
+		auto pointee = m.at( 950 ).get();
+		auto right = m.split( boundary );
+		EXPECT_EQ( m.size(), static_cast<std::size_t>( boundary ) );
+		EXPECT_EQ( right.size(), static_cast<std::size_t>( 1000 - boundary ) );
+		EXPECT_EQ( &right.at( 950 ), value );
+		EXPECT_EQ( right.at( 950 ).get(), pointee );
+		EXPECT_TRUE( m.validate().valid() );
+		EXPECT_TRUE( right.validate().valid() );
+
+		// both maps take nodes from the shared slabs and give them back
+		right.erase( 950 );
+		right.insert( 2000, std::make_unique<int>( 2000 ) );
+		m.erase( 0 );
+		m.insert( -1, std::make_unique<int>( -1 ) );
+		EXPECT_EQ( *right.at( 2000 ), 2000 );
+		EXPECT_EQ( *m.at( -1 ), -1 );
+		EXPECT_TRUE( m.validate().valid() );
+		EXPECT_TRUE( right.validate().valid() );
+	}
+
+	EK::ThreadedMap<int, int> threaded;
+	for ( int i = 0; i < 100; ++i )
+	{
+		threaded.insert( i, i );
+	}
+	auto right = threaded.split( 30 );
+	EXPECT_EQ( right.size(), 70 );
+	EXPECT_EQ( std::distance( right.begin(), right.end() ), 70 );
+	EXPECT_EQ( std::distance( threaded.begin(), threaded.end() ), 30 );
+	EXPECT_TRUE( threaded.validate().valid() );
+	EXPECT_TRUE( right.validate().valid() );
+	EXPECT_EQ( threaded.split( 100 ).size(), 0 );
+}
+
+TEST( ekmap, set_operations )
+{
+	EK::ThreadPool threads( 4 );
+	std::mt19937 gen( 3 );
+	for ( std::size_t n : { 0, 1, 100, 100000 } )
+	{
+		for ( std::size_t m : { 0, 3, 1000, 100000 } )
+		{
+			std::map<int, int> a_reference;
+			std::map<int, int> b_reference;
+			for ( std::size_t i = 0; i < n; ++i )
+			{
+				a_reference[gen() % ( 2 * n + 1 )] = 1;
+			}
+			for ( std::size_t i = 0; i < m; ++i )
+			{
+				b_reference[gen() % ( 2 * n + 1 )] = 2;
+			}
+			EK::Map<int, int> a( a_reference.begin(), a_reference.end() );
+			EK::Map<int, int> b( b_reference.begin(), b_reference.end() );
+
+			for ( auto pool : { static_cast<EK::ThreadPool *>( nullptr ), &threads } )
+			{
+				auto union_reference = a_reference;
+				std::map<int, int> intersection_reference;
+				auto difference_reference = a_reference;
+				for ( auto& [key, value] : b_reference )
+				{
+					union_reference[key] = value;
+					if ( a_reference.count( key ) )
+					{
+						intersection_reference[key] = 1;
+					}
+					difference_reference.erase( key );
+				}
+
+				auto united = a;
+				united.set_union( b, pool );
+				auto intersected = a;
+				intersected.set_intersection( b, pool );
+				auto subtracted = a;
+				subtracted.set_difference( b, pool );
+				for ( auto result : { &united, &intersected, &subtracted } )
+				{
+					EXPECT_TRUE( result->check_red_black_tree_properties().empty() );
+				}
+				EXPECT_TRUE( std::equal( united.begin(), united.end(), union_reference.begin(), union_reference.end() ) );
+				EXPECT_TRUE( std::equal( intersected.begin(), intersected.end(),
+					intersection_reference.begin(), intersection_reference.end() ) );
+				EXPECT_TRUE( std::equal( subtracted.begin(), subtracted.end(),
+					difference_reference.begin(), difference_reference.end() ) );
+				EXPECT_EQ( united.size(), union_reference.size() );
+				EXPECT_EQ( intersected.size(), intersection_reference.size() );
+				EXPECT_EQ( subtracted.size(), difference_reference.size() );
+			}
+		}
+	}
+}
+
+TEST( ekmap, find_batch )
+{
+	// small maps are searched key by key, big ones by lanes; batches longer and shorter than
+	// the number of lanes, with present and absent keys
+	std::mt19937 gen( 11 );
+	for ( int map_size : { 1000, 100000 } )
+	{
+		EK::Map<int, int> m;
+		for ( int i = 0; i < map_size; ++i )
+		{
+			m.insert( static_cast<int>( gen() % ( 3 * map_size ) ), i );
+		}
+		const auto& cm = m;
+		for ( std::size_t batch_size : { 0, 1, 15, 16, 17, 100 } )
+		{
+			std::vector<int> keys( batch_size );
+			for ( auto& key : keys )
+			{
+				key = static_cast<int>( gen() % ( 3 * map_size ) );
+			}
+			std::vector<EK::Map<int, int>::Iterator> found;
+			std::vector<EK::Map<int, int>::CIterator> c_found( batch_size, cm.end() );
+			m.find_batch( keys.begin(), keys.end(), std::back_inserter( found ) );
+			auto c_found_end = cm.find_batch( keys.begin(), keys.end(), c_found.begin() );
+			EXPECT_TRUE( c_found_end == c_found.end() );
+			ASSERT_EQ( found.size(), batch_size );
+			std::size_t present = 0;
+			for ( std::size_t i = 0; i < batch_size; ++i )
+			{
+				EXPECT_TRUE( found[i] == m.find( keys[i] ) );
+				EXPECT_TRUE( c_found[i] == cm.find( keys[i] ) );
+				present += m.count( keys[i] );
+			}
+			EXPECT_EQ( cm.count_batch( keys.begin(), keys.end() ), present );
+		}
+	}
+
+	EK::Map<int, int> empty;
+	std::vector<int> keys = { 1, 2, 3 };
+	EXPECT_EQ( empty.count_batch( keys.begin(), keys.end() ), 0 );
+}
+
+TEST( ekmap, find_batch_of_keys_by_value )
+{
+	// The keys live only until the iterator moves on, so the lanes have to keep copies of them.
+	// Long strings are on the heap, where a dangling key would be caught by the sanitizers.
+	EK::Map<std::string, int> m;
+	std::vector<std::string> keys;
+	for ( int i = 0; i < 100000; ++i )
+	{
+		auto key = "a key long enough for the heap " + std::to_string( i );
+		if ( i % 2 == 0 )
+		{
+			m.insert( key, i );
+		}
+		keys.push_back( key );
+	}
+	std::shuffle( keys.begin(), keys.end(), std::mt19937( 5 ) );
+	ByValueIterator<std::string> first( keys.begin() ), last( keys.end() );
+	EXPECT_EQ( m.count_batch( first, last ), 50000 );
+
+	std::vector<EK::Map<std::string, int>::Iterator> found;
+	m.find_batch( first, last, std::back_inserter( found ) );
+	ASSERT_EQ( found.size(), keys.size() );
+	for ( std::size_t i = 0; i < keys.size(); ++i )
+	{
+		EXPECT_TRUE( found[i] == m.find( keys[i] ) );
+	}
+}
+
+TEST( ekmap, insert_and_erase_batches )
+{
+	// Sorted batches, and unsorted ones with duplicates that fall back to searches from the root.
+	// A big map takes the path with lookups by lanes.
+	std::mt19937 gen( 23 );
+	for ( int key_range : { 2000, 200000 } )
+	{
+		EK::OrderStatisticMap<int, int> m;
+		std::map<int, int> reference;
+		for ( int i = 0; i < key_range / 2; ++i )
+		{
+			auto key = static_cast<int>( gen() % key_range );
+			m.insert( key, -1 );
+			reference[key] = -1;
+		}
+		for ( int round = 0; round < 200; ++round )
+		{
+			std::vector<std::pair<int, int>> pairs( gen() % 64 );
+			for ( auto& pair : pairs )
+			{
+				pair = { static_cast<int>( gen() % key_range ), round };
+			}
+			auto is_sorted = ( round % 2 == 0 );
+			if ( is_sorted )
+			{
+				std::sort( pairs.begin(), pairs.end() );
+			}
+			m.insert_batch( pairs.begin(), pairs.end() );
+			for ( auto& pair : pairs )
+			{
+				reference[pair.first] = pair.second;
+			}
+
+			std::vector<int> keys( gen() % 48 );
+			for ( auto& key : keys )
+			{
+				key = static_cast<int>( gen() % key_range );
+			}
+			keys.insert( keys.end(), keys.begin(), keys.begin() + keys.size() / 4 ); // duplicates
+			if ( is_sorted )
+			{
+				std::sort( keys.begin(), keys.end() );
+			}
+			std::size_t erased = 0;
+			for ( auto key : keys )
+			{
+				erased += reference.erase( key );
+			}
+			EXPECT_EQ( m.erase_batch( keys.begin(), keys.end() ), erased );
+			ASSERT_EQ( m.size(), reference.size() );
+		}
+		EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+		EXPECT_TRUE( std::equal( m.begin(), m.end(), reference.begin(), reference.end() ) );
+	}
+}
+
+TEST( ekmap, insert_and_erase_batches_by_value )
+{
+	// Pairs and keys given by value are temporaries, a big map looks their keys up by lanes.
+	EK::Map<std::string, int> m;
+	std::vector<std::pair<std::string, int>> pairs;
+	std::vector<std::string> keys;
+	for ( int i = 0; i < 100000; ++i )
+	{
+		auto key = "a key long enough for the heap " + std::to_string( i );
+		m.insert( key, -1 );
+		pairs.emplace_back( key, i );
+		keys.push_back( key );
+	}
+	std::shuffle( pairs.begin(), pairs.end(), std::mt19937( 7 ) );
+	m.insert_batch( ByValueIterator<std::pair<std::string, int>>( pairs.begin() ),
+		ByValueIterator<std::pair<std::string, int>>( pairs.end() ) );
+	EXPECT_EQ( m.size(), 100000 );
+	EXPECT_TRUE( std::all_of( pairs.begin(), pairs.end(), [&m]( auto& pair ) { return m.at( pair.first ) == pair.second; } ) );
+
+	keys.resize( keys.size() / 2 );
+	EXPECT_EQ( m.erase_batch( ByValueIterator<std::string>( keys.begin() ), ByValueIterator<std::string>( keys.end() ) ), 50000 );
+	EXPECT_EQ( m.size(), 50000 );
+	EXPECT_TRUE( m.validate().valid() );
+}
+
+TEST( ekmap, hinted_insert_and_finger_search )
+{
+	EK::Map<int, int> m;
+	auto it = m.insert( m.end(), 10, 1 );
+	for ( int key = 11; key < 1000; ++key )
+	{
+		it = m.insert( it, key, key ); // append after the previous element
+	}
+	for ( int key = 1000; key < 2000; ++key )
+	{
+		m.insert( m.end(), key, key );
+	}
+	m.emplace_hint( m.begin(), 5, 5 );
+	EXPECT_EQ( m.insert( m.end(), 500, -1 )->second, -1 ); // a wrong hint still works
+	EXPECT_EQ( m.size(), 1991 );
+	EXPECT_EQ( m.begin()->first, 5 );
+	EXPECT_EQ( m.rbegin()->first, 1999 );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+
+	// random hints and keys against std::map
+	std::mt19937 gen( 31 );
+	EK::Map<int, int> r;
+	std::map<int, int> reference;
+	std::vector<EK::Map<int, int>::CIterator> hints;
+	for ( int i = 0; i < 3000; ++i )
+	{
+		auto key = static_cast<int>( gen() % 5000 );
+		auto hint = hints.empty() ? r.end() : hints[gen() % hints.size()];
+		if ( gen() % 4 == 0 && !reference.empty() )
+		{
+			// erasure invalidates only the iterators to the erased element
+			auto erased = r.lower_bound_from( hint, key );
+			if ( erased != r.end() )
+			{
+				auto erased_key = erased->first;
+				hints.erase( std::remove( hints.begin(), hints.end(), EK::Map<int, int>::CIterator( erased ) ), hints.end() );
+				r.erase( erased_key );
+				reference.erase( erased_key );
+			}
+		}
+		else
+		{
+			hints.push_back( r.insert( hint, key, i ) );
+			reference[key] = i;
+		}
+
+		auto from = hints.empty() ? r.end() : hints[gen() % hints.size()];
+		auto probe = static_cast<int>( gen() % 5200 );
+		auto expected = reference.lower_bound( probe );
+		auto found = static_cast<const EK::Map<int, int>&>( r ).lower_bound_from( from, probe );
+		if ( expected == reference.end() )
+		{
+			EXPECT_TRUE( found == r.end() );
+		}
+		else
+		{
+			ASSERT_TRUE( found != r.end() );
+			EXPECT_EQ( found->first, expected->first );
+		}
+	}
+	EXPECT_TRUE( r.check_red_black_tree_properties().empty() );
+	EXPECT_TRUE( std::equal( r.begin(), r.end(), reference.begin(), reference.end() ) );
+}
+
+TEST( ekmap, ordered_queries )
+{
+	EK::Map<int, int> m;
+	for ( int key = 0; key < 100; key += 10 )
+	{
+		m.insert( key, key / 10 );
+	}
+	const auto& cm = m;
+	EXPECT_EQ( m.lower_bound( 20 )->first, 20 );
+	EXPECT_EQ( m.lower_bound( 21 )->first, 30 );
+	EXPECT_EQ( cm.upper_bound( 20 )->first, 30 );
+	EXPECT_EQ( cm.upper_bound( -5 )->first, 0 );
+	EXPECT_TRUE( m.lower_bound( 91 ) == m.end() );
+	EXPECT_TRUE( cm.upper_bound( 90 ) == cm.end() );
+
+	auto equal = m.equal_range( 40 );
+	EXPECT_EQ( std::distance( equal.first, equal.second ), 1 );
+	EXPECT_EQ( equal.first->second, 4 );
+	auto absent = cm.equal_range( 45 );
+	EXPECT_TRUE( absent.first == absent.second );
+	EXPECT_EQ( absent.first->first, 50 );
+
+	std::vector<int> keys;
+	for ( auto& pair : m.range( 15, 60 ) )
+	{
+		keys.push_back( pair.first );
+	}
+	EXPECT_EQ( keys, std::vector<int>( { 20, 30, 40, 50 } ) );
+	EXPECT_TRUE( cm.range( 60, 15 ).empty() );
+	EXPECT_TRUE( cm.range( 41, 49 ).empty() );
+	EXPECT_EQ( std::distance( cm.range( -100, 1000 ).begin(), cm.range( -100, 1000 ).end() ), 10 );
+	for ( auto& pair : m.range( 0, 30 ) )
+	{
+		pair.second = -1;
+	}
+	EXPECT_EQ( m.at( 20 ), -1 );
+	EXPECT_EQ( m.at( 30 ), 3 );
+}
+
+TEST( ekmap, erase_range )
+{
+	std::mt19937 gen( 41 );
+	for ( int round = 0; round < 100; ++round )
+	{
+		EK::OrderStatisticMap<int, int> m;
+		std::map<int, int> reference;
+		auto n = static_cast<int>( gen() % 300 );
+		for ( int i = 0; i < n; ++i )
+		{
+			auto key = static_cast<int>( gen() % 1000 );
+			m.insert( key, i );
+			reference[key] = i;
+		}
+		auto lo = static_cast<int>( gen() % 1100 ) - 50;
+		auto hi = lo + static_cast<int>( gen() % 400 );
+		auto result = m.erase( m.lower_bound( lo ), m.lower_bound( hi ) );
+		reference.erase( reference.lower_bound( lo ), reference.lower_bound( hi ) );
+
+		EXPECT_TRUE( result == m.lower_bound( hi ) );
+		ASSERT_TRUE( m.check_red_black_tree_properties().empty() );
+		ASSERT_EQ( m.size(), reference.size() );
+		EXPECT_TRUE( std::equal( m.begin(), m.end(), reference.begin(), reference.end() ) );
+	}
+
+	EK::Map<int, int> m = { { 1, 1 }, { 2, 2 }, { 3, 3 } };
+	EXPECT_TRUE( m.erase( m.begin(), m.end() ) == m.end() );
+	EXPECT_EQ( m.size(), 0 );
+	m.insert( 4, 4 );
+	EXPECT_TRUE( m.erase( m.begin(), m.begin() ) == m.begin() );
+	EXPECT_EQ( m.size(), 1 );
+}
+
+TEST( ekmap, threaded_iteration )
+{
+	using Threaded = EK::ThreadedMap<int, int>;
+	std::mt19937 gen( 43 );
+	Threaded m;
+	std::map<int, int> reference;
+	auto check = [&]( const Threaded& map, const std::map<int, int>& expected )
+	{
+		ASSERT_TRUE( map.check_red_black_tree_properties().empty() );
+		ASSERT_EQ( map.size(), expected.size() );
+		EXPECT_TRUE( std::equal( map.begin(), map.end(), expected.begin(), expected.end() ) );
+		if ( map.size() != 0 )
+		{
+			auto iter = map.rbegin();
+			for ( auto r = expected.rbegin(); r != expected.rend(); ++r, --iter )
+			{
+				ASSERT_EQ( iter->first, r->first );
+			}
+			EXPECT_TRUE( iter == map.end() );
+		}
+	};
+
+	for ( int round = 0; round < 20; ++round )
+	{
+		for ( int i = 0; i < 200; ++i )
+		{
+			auto key = static_cast<int>( gen() % 2000 );
+			if ( gen() % 3 == 0 )
+			{
+				m.erase( key );
+				reference.erase( key );
+			}
+			else
+			{
+				m.insert( key, i );
+				reference[key] = i;
+			}
+		}
+		std::vector<std::pair<int, int>> batch;
+		for ( int i = 0; i < 50; ++i )
+		{
+			batch.emplace_back( static_cast<int>( gen() % 2000 ), i );
+			reference[batch.back().first] = i;
+		}
+		m.insert_batch( batch.begin(), batch.end() );
+		check( m, reference );
+
+		auto lo = static_cast<int>( gen() % 2000 );
+		auto hi = lo + static_cast<int>( gen() % ( round % 2 == 0 ? 20 : 600 ) );
+		m.erase( m.lower_bound( lo ), m.lower_bound( hi ) );
+		reference.erase( reference.lower_bound( lo ), reference.lower_bound( hi ) );
+		check( m, reference );
+	}
+
+	auto copy = m;
+	check( copy, reference );
+	auto right = copy.split( 1000 );
+	std::map<int, int> reference_right( reference.lower_bound( 1000 ), reference.end() );
+	std::map<int, int> reference_left( reference.begin(), reference.lower_bound( 1000 ) );
+	check( copy, reference_left );
+	check( right, reference_right );
+	copy.join( std::move( right ) );
+	check( copy, reference );
+
+	Threaded other;
+	std::map<int, int> reference_other;
+	for ( int i = 0; i < 500; ++i )
+	{
+		auto key = static_cast<int>( gen() % 3000 );
+		other.insert( key, -i );
+		reference_other[key] = -i;
+	}
+	copy.set_difference( other );
+	for ( auto& pair : reference_other )
+	{
+		reference.erase( pair.first );
+	}
+	check( copy, reference );
+	copy.set_union( std::move( other ) );
+	for ( auto& pair : reference_other )
+	{
+		reference[pair.first] = pair.second;
+	}
+	check( copy, reference );
+
+	std::vector<std::pair<int, int>> sorted( reference.begin(), reference.end() );
+	Threaded built( sorted.begin(), sorted.end() );
+	check( built, reference );
+}
+
+TEST( ekmap, extract_and_drop )
+{
+	// A dropped node handle gives its slot back, as std::map::node_type frees its node.
+	EK::Map<int, std::string> m;
+	for ( int i = 0; i < 1000; ++i )
+	{
+		m.insert( i, std::to_string( i ) );
+	}
+	auto capacity = m.statistics().pool_capacity;
+	for ( int round = 0; round < 100000; ++round )
+	{
+		auto key = round % 1000;
+		EXPECT_FALSE( m.extract( key ).empty() );
+		m.insert( key, std::to_string( round ) );
+	}
+	EXPECT_EQ( m.statistics().pool_capacity, capacity );
+	EXPECT_EQ( m.size(), 1000 );
+
+	// a handle that outlives its map frees the node with the slab
+	auto node = m.extract( 0 );
+	m = EK::Map<int, std::string>();
+	EXPECT_EQ( node.mapped(), "99000" );
+}
+
+TEST( ekmap, extract_insert_and_merge )
+{
+	EK::OrderStatisticMap<int, std::string> target;
+	{
+		EK::OrderStatisticMap<int, std::string> source = { { 1, "Aharon" }, { 2, "Baruch" }, { 3, "Sarah" } };
+		const auto * address = &source.at( 2 );
+		auto node = source.extract( 2 );
+		ASSERT_FALSE( node.empty() );
+		EXPECT_EQ( node.key(), 2 );
+		EXPECT_EQ( node.mapped(), "Baruch" );
+		EXPECT_EQ( source.size(), 2 );
+		EXPECT_FALSE( source.contains( 2 ) );
+
+		auto result = target.insert( std::move( node ) );
+		EXPECT_TRUE( result.inserted );
+		EXPECT_TRUE( result.node.empty() );
+		EXPECT_EQ( &result.position->second, address ); // the node is moved, not copied
+		EXPECT_TRUE( source.extract( 2 ).empty() );
+		EXPECT_TRUE( source.extract( source.end() ).empty() );
+
+		target.insert( 3, "Yaakov" );
+		result = target.insert( source.extract( 3 ) );
+		EXPECT_FALSE( result.inserted );
+		ASSERT_FALSE( result.node.empty() );
+		EXPECT_EQ( result.node.mapped(), "Sarah" );
+		EXPECT_EQ( result.position->second, "Yaakov" );
+		// 'source' is destroyed here, the moved node lives on in 'target'
+	}
+	EXPECT_EQ( target.at( 2 ), "Baruch" );
+	EXPECT_TRUE( target.check_red_black_tree_properties().empty() );
+	EXPECT_EQ( target.rank( 3 ), 1 );
+
+	std::mt19937 gen( 47 );
+	for ( int round = 0; round < 20; ++round )
+	{
+		EK::ThreadedMap<int, int> a;
+		EK::ThreadedMap<int, int> b;
+		std::map<int, int> reference_a;
+		std::map<int, int> reference_b;
+		for ( int i = 0; i < 300; ++i )
+		{
+			auto key = static_cast<int>( gen() % 1000 );
+			a.insert( key, i );
+			reference_a[key] = i;
+			key = static_cast<int>( gen() % 1000 );
+			b.insert( key, -i );
+			reference_b[key] = -i;
+		}
+		for ( int i = 0; i < 20; ++i )
+		{
+			auto key = static_cast<int>( gen() % 1000 );
+			auto moved = reference_a.count( key ) == 1 && reference_b.count( key ) == 0;
+			EXPECT_EQ( b.insert( a.extract( key ) ).inserted, moved );
+			if ( moved )
+			{
+				reference_b[key] = reference_a[key];
+			}
+			reference_a.erase( key );
+		}
+		a.merge( b );
+		for ( auto iter = reference_b.begin(); iter != reference_b.end(); )
+		{
+			if ( reference_a.insert( *iter ).second )
+			{
+				iter = reference_b.erase( iter );
+			}
+			else
+			{
+				++iter;
+			}
+		}
+		ASSERT_TRUE( a.check_red_black_tree_properties().empty() );
+		ASSERT_TRUE( b.check_red_black_tree_properties().empty() );
+		EXPECT_EQ( a.size(), reference_a.size() );
+		EXPECT_TRUE( std::equal( a.begin(), a.end(), reference_a.begin(), reference_a.end() ) );
+		EXPECT_TRUE( std::equal( b.begin(), b.end(), reference_b.begin(), reference_b.end() ) );
+	}
+}
+
+TEST( ekmap, copy_of_big_trees )
+{
+	EK::ThreadPool threads( 4 );
+	std::mt19937 gen( 53 );
+	EK::OrderStatisticMap<int, std::string> source;
+	std::map<int, std::string> reference;
+	for ( int i = 0; i < 200000; ++i )
+	{
+		auto key = static_cast<int>( gen() % 1000000 );
+		source.insert( key, std::to_string( i ) );
+		reference[key] = std::to_string( i );
+	}
+
+	EK::OrderStatisticMap<int, std::string> serial( source );
+	EK::OrderStatisticMap<int, std::string> parallel( source, &threads );
+	for ( auto copy : { &serial, &parallel } )
+	{
+		ASSERT_TRUE( copy->check_red_black_tree_properties().empty() );
+		EXPECT_EQ( copy->size(), reference.size() );
+		EXPECT_TRUE( std::equal( copy->begin(), copy->end(), reference.begin(), reference.end() ) );
+		EXPECT_EQ( copy->select( 1000 )->first, source.select( 1000 )->first );
+	}
+
+	// Assignment reuses the nodes of the target: every copied value lives in a slot of an old one.
+	std::set<const std::string *> old_values;
+	for ( auto& [key, value] : serial )
+	{
+		old_values.insert( &value );
+	}
+	EK::OrderStatisticMap<int, std::string> smaller = { { 1, "Aharon" }, { 2, "Baruch" }, { 3, "Sarah" } };
+	serial = smaller;
+	ASSERT_TRUE( serial.check_red_black_tree_properties().empty() );
+	EXPECT_TRUE( std::equal( serial.begin(), serial.end(), smaller.begin(), smaller.end() ) );
+	for ( auto& [key, value] : serial )
+	{
+		EXPECT_EQ( old_values.count( &value ), 1 );
+	}
+	serial.assign( source, &threads );
+	EXPECT_TRUE( std::equal( serial.begin(), serial.end(), reference.begin(), reference.end() ) );
+	parallel.assign( EK::OrderStatisticMap<int, std::string>(), &threads );
+	EXPECT_EQ( parallel.size(), 0 );
+	EXPECT_EQ( parallel.begin(), parallel.end() );
+
+	EK::ThreadedMap<int, int> threaded;
+	for ( int i = 0; i < 100000; ++i )
+	{
+		threaded.insert( static_cast<int>( gen() % 1000000 ), i );
+	}
+	EK::ThreadedMap<int, int> threaded_copy( threaded, &threads );
+	ASSERT_TRUE( threaded_copy.check_red_black_tree_properties().empty() );
+	EXPECT_TRUE( std::equal( threaded_copy.begin(), threaded_copy.end(), threaded.begin(), threaded.end() ) );
+	auto expected = threaded.rbegin();
+	for ( auto iter = threaded_copy.rbegin(); iter != threaded_copy.rend(); --iter, --expected )
+	{
+		ASSERT_EQ( iter->first, expected->first );
+	}
+	EXPECT_EQ( expected, threaded.rend() );
+}
+
+TEST( ekmap, statistics )
+{
+	// the counters are compiled in with EK_MAP_STATISTICS only (see ekstatistics_test.cpp),
+	// the shape of the tree is always reported
+	EK::Map<int, int> m;
+	EXPECT_EQ( m.statistics().height, 0 );
+	for ( int i = 0; i < 1023; ++i )
+	{
+		m.insert( i, i );
+	}
+	auto statistics = m.statistics();
+	EXPECT_EQ( statistics.size, 1023 );
+	EXPECT_GE( statistics.height, 10 );
+	EXPECT_LE( statistics.height, statistics.height_bound );
+	EXPECT_GE( statistics.pool_capacity, 1023 );
+#ifdef EK_MAP_STATISTICS
+	EXPECT_TRUE( statistics.enabled );
+#else
+	EXPECT_FALSE( statistics.enabled );
+	EXPECT_EQ( statistics.rotations, 0 );
+#endif
+}
+
+TEST( ekmap, validate )
+{
+	EK::OrderStatisticMap<int, int> m;
+	EXPECT_TRUE( m.validate().valid() );
+	std::mt19937 gen( 67 );
+	for ( int i = 0; i < 5000; ++i )
+	{
+		m.insert( static_cast<int>( gen() % 10000 ), i );
+	}
+	auto report = m.validate();
+	EXPECT_TRUE( report.valid() );
+	EXPECT_EQ( report.nodes_checked, m.size() );
+	EXPECT_EQ( report.black_height, m.get_black_height() );
+	EXPECT_EQ( report.max_depth, m.statistics().height );
+
+	// a comparator turned upside down breaks the key order of the whole tree
+	bool reversed = false;
+	auto compare = [&reversed]( int a, int b ) { return reversed ? b < a : a < b; };
+	EK::Map<int, int, decltype( compare )> flipped( compare );
+	for ( int i = 0; i < 100; ++i )
+	{
+		flipped.insert( i, i );
+	}
+	EXPECT_TRUE( flipped.validate().valid() );
+	reversed = true;
+	auto flipped_report = flipped.validate();
+	ASSERT_FALSE( flipped_report.valid() );
+	EXPECT_EQ( flipped_report.violations.front().kind, EK::ViolationKind::order );
+	EXPECT_FALSE( flipped.check_red_black_tree_properties().empty() );
+
+	// a value changed through a reference leaves a stale aggregate
+	EK::AugmentedMap<int, int, EK::SubtreeSum<int>> sums = { { 1, 1 }, { 2, 2 }, { 3, 3 } };
+	sums.at( 2 ) = 20;
+	auto sums_report = sums.validate();
+	ASSERT_EQ( sums_report.violations.size(), 1 );
+	EXPECT_EQ( sums_report.violations[0].kind, EK::ViolationKind::aggregate );
+	EXPECT_EQ( sums_report.violations[0].position->first, 2 );
+	sums.refresh( sums.find( 2 ) );
+	EXPECT_TRUE( sums.validate().valid() );
+}
+
+TEST( ekmap, validate_changes )
+{
+	EK::AugmentedMap<int, int, EK::SubtreeSum<int>> m;
+	for ( int i = 0; i < 100000; ++i )
+	{
+		m.insert( i, 1 );
+	}
+	m.track_changes( 10 );
+	std::mt19937 gen( 71 );
+	for ( int i = 0; i < 100; ++i )
+	{
+		auto key = static_cast<int>( gen() % 200000 );
+		if ( i % 2 == 0 )
+		{
+			m.insert( key, 1 );
+		}
+		else
+		{
+			m.erase( key );
+		}
+	}
+	auto report = m.validate_changes();
+	EXPECT_TRUE( report.valid() );
+	EXPECT_GT( report.nodes_checked, 0 );
+	EXPECT_LT( report.nodes_checked, m.size() / 10 ); // only the paths and subtrees of 10 sampled keys
+	EXPECT_EQ( report.black_height, m.get_black_height() );
+	EXPECT_EQ( m.validate_changes().nodes_checked, 0 ); // the keys are forgotten
+
+	m.track_changes( 1 );
+	m.insert( 300000, 1 );
+	m.at( 300000 ) = 5; // not seen by the aggregates
+	report = m.validate_changes();
+	ASSERT_EQ( report.violations.size(), 1 );
+	EXPECT_EQ( report.violations[0].kind, EK::ViolationKind::aggregate );
+	m.refresh( m.find( 300000 ) );
+
+	// bulk operations make the next check a full one
+	EK::AugmentedMap<int, int, EK::SubtreeSum<int>> tail = { { 400000, 1 } };
+	m.join( std::move( tail ) );
+	report = m.validate_changes();
+	EXPECT_TRUE( report.valid() );
+	EXPECT_EQ( report.nodes_checked, m.size() );
+}
+
+TEST( ekmap, parallel_build )
+{
+	EK::ThreadPool threads( 4 );
+	std::mt19937 gen( 73 );
+	std::vector<std::pair<int, std::string>> pairs;
+	std::map<int, std::string> reference;
+	for ( int i = 0; i < 200000; ++i )
+	{
+		auto key = static_cast<int>( gen() % 100000 ); // many duplicates, the last one wins
+		pairs.emplace_back( key, std::to_string( i ) );
+		reference[key] = std::to_string( i );
+	}
+
+	EK::OrderStatisticMap<int, std::string> m;
+	m.assign_sorted( pairs.begin(), pairs.end(), &threads );
+	ASSERT_TRUE( m.validate().valid() );
+	EXPECT_EQ( m.size(), reference.size() );
+	EXPECT_TRUE( std::equal( m.begin(), m.end(), reference.begin(), reference.end() ) );
+	EXPECT_EQ( m.select( 1000 )->first, std::next( reference.begin(), 1000 )->first );
+
+	// sorted input is built without sorting
+	std::vector<std::pair<int, std::string>> sorted( reference.begin(), reference.end() );
+	EK::ThreadedMap<int, std::string> threaded;
+	threaded.assign_sorted( sorted.begin(), sorted.end(), &threads );
+	ASSERT_TRUE( threaded.validate().valid() );
+	EXPECT_TRUE( std::equal( threaded.begin(), threaded.end(), reference.begin(), reference.end() ) );
+
+	EK::AugmentedMap<int, long long, EK::SubtreeSum<long long>> sums;
+	std::vector<std::pair<int, long long>> numbers;
+	for ( int i = 0; i < 100000; ++i )
+	{
+		numbers.emplace_back( static_cast<int>( gen() % 1000000 ), i );
+	}
+	sums.assign_sorted( numbers.begin(), numbers.end(), &threads );
+	ASSERT_TRUE( sums.validate().valid() );
+	std::set<int> keys;
+	for ( auto& pair : numbers )
+	{
+		keys.insert( pair.first );
+	}
+	EXPECT_EQ( sums.size(), keys.size() );
+}
+
+TEST( ekmap, parallel_for_each )
+{
+	EK::ThreadPool threads( 4 );
+	EK::Map<int, int> m;
+	std::vector<std::pair<int, int>> pairs;
+	for ( int i = 0; i < 100000; ++i )
+	{
+		pairs.emplace_back( i, 2 * i );
+	}
+	m.assign_sorted( pairs.begin(), pairs.end(), &threads );
+
+	for ( auto pool : { static_cast<EK::ThreadPool *>( nullptr ), &threads } )
+	{
+		std::atomic<long long> sum{ 0 };
+		std::atomic<int> count{ 0 };
+		m.parallel_for_each( [&sum, &count]( const std::pair<const int, int>& pair ) {
+			sum += pair.second;
+			++count;
+		}, pool );
+		EXPECT_EQ( count, 100000 );
+		EXPECT_EQ( sum, 100000LL * 99999 );
+	}
+
+	std::atomic<int> count{ 0 };
+	EXPECT_THROW( m.parallel_for_each( [&count]( const std::pair<const int, int>& pair ) {
+		++count;
+		if ( pair.first == 77777 )
+		{
+			throw std::runtime_error( "failed" );
+		}
+	}, &threads ), std::runtime_error );
+	EXPECT_GT( count, 0 );
+
+	EK::Map<int, int> empty;
+	empty.parallel_for_each( []( const std::pair<const int, int>& ) { FAIL(); }, &threads );
+}
@@ -0,0 +1,63 @@
+#include "pch.h"
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../my_containers/ekpersistentmap.h"
+
+TEST( ekpersistentmap, snapshot_is_unaffected )
+{
+	EK::PersistentMap<int, std::string> m = { { 1, "Aharon" }, { 2, "Baruch" } };
+	auto snapshot = m.snapshot();
+	m.insert( 3, "Sarah" );
+	m.insert( 1, "Mendel" );
+	m.erase( 2 );
+
+	EXPECT_EQ( m.size(), 2 );
+	EXPECT_EQ( m.at( 1 ), "Mendel" );
+	EXPECT_FALSE( m.contains( 2 ) );
+	EXPECT_EQ( snapshot.size(), 2 );
+	EXPECT_EQ( snapshot.at( 1 ), "Aharon" );
+	EXPECT_EQ( snapshot.at( 2 ), "Baruch" );
+	EXPECT_EQ( snapshot.count( 3 ), 0 );
+	EXPECT_THROW( snapshot.at( 3 ), std::out_of_range );
+}
+
+TEST( ekpersistentmap, random_versions )
+{
+	// keeps a snapshot after every 100 operations and compares all of them with std::map copies at the end
+	EK::PersistentMap<int, int> m;
+	std::map<int, int> reference;
+	std::vector<std::pair<EK::PersistentMap<int, int>, std::map<int, int>>> versions;
+	std::mt19937 gen( 17 );
+	for ( int i = 0; i < 5000; ++i )
+	{
+		int key = gen() % 700;
+		if ( gen() % 3 == 0 )
+		{
+			m.erase( key );
+			reference.erase( key );
+		}
+		else
+		{
+			m.insert( key, i );
+			reference[key] = i;
+		}
+		if ( i % 100 == 0 )
+		{
+			versions.emplace_back( m.snapshot(), reference );
+		}
+	}
+	versions.emplace_back( m, reference );
+
+	for ( auto& [version, expected] : versions )
+	{
+		EXPECT_TRUE( version.check_red_black_tree_properties().empty() );
+		EXPECT_EQ( version.size(), expected.size() );
+		EXPECT_TRUE( std::equal( version.begin(), version.end(), expected.begin(), expected.end() ) );
+	}
+	auto iter = m.find( reference.begin()->first );
+	EXPECT_TRUE( std::equal( iter, m.end(), reference.begin(), reference.end() ) );
+	EXPECT_EQ( m.find( 1000 ), m.end() );
+}
@@ -0,0 +1,199 @@
+#include "pch.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../my_containers/ekpool.h"
+
+TEST( ekpool, reuse_of_destroyed_objects )
+{
+	EK::Pool<std::string> pool;
+	auto a = pool.create( "Aharon" );
+	auto b = pool.create( "Baruch" );
+	EXPECT_EQ( *a, "Aharon" );
+	EXPECT_EQ( *b, "Baruch" );
+	EXPECT_EQ( pool.size(), 2 );
+
+	pool.destroy( a );
+	EXPECT_EQ( pool.size(), 1 );
+	auto c = pool.create( "Sarah" );
+	EXPECT_EQ( c, a ); // the last destroyed slot is reused first
+	EXPECT_EQ( pool.slab_count(), 1 );
+
+	pool.destroy( b );
+	pool.destroy( c );
+}
+
+TEST( ekpool, slabs_and_release )
+{
+	EK::Pool<int> pool;
+	for ( int i = 0; i < 1000; ++i )
+	{
+		pool.create( i );
+	}
+	EXPECT_EQ( pool.size(), 1000 );
+	EXPECT_GE( pool.capacity(), 1000 );
+	EXPECT_LT( pool.slab_count(), 10 ); // slabs grow geometrically
+
+	pool.release();
+	EXPECT_EQ( pool.size(), 0 );
+	EXPECT_EQ( pool.capacity(), 0 );
+	EXPECT_EQ( pool.slab_count(), 0 );
+}
+
+TEST( ekpool, reserve )
+{
+	EK::Pool<int> pool;
+	pool.reserve( 1000 );
+	EXPECT_EQ( pool.slab_count(), 1 );
+	EXPECT_GE( pool.capacity(), 1000 );
+	std::vector<int *> objects;
+	for ( int i = 0; i < 1000; ++i )
+	{
+		objects.push_back( pool.create( i ) );
+	}
+	EXPECT_EQ( pool.slab_count(), 1 ); // the whole batch fits into the reserved slab
+
+	for ( int i = 0; i < 500; ++i )
+	{
+		pool.destroy( objects[i] );
+	}
+	pool.reserve( 500 ); // the free slots are enough
+	EXPECT_EQ( pool.slab_count(), 1 );
+	pool.reserve( 600 );
+	EXPECT_EQ( pool.slab_count(), 2 );
+	for ( int i = 0; i < 600; ++i )
+	{
+		objects.push_back( pool.create( i ) );
+	}
+	EXPECT_EQ( pool.slab_count(), 2 );
+	EXPECT_EQ( pool.size(), 1100 );
+
+	for ( std::size_t i = 500; i < objects.size(); ++i )
+	{
+		pool.destroy( objects[i] );
+	}
+	pool.recycle();
+	auto first = pool.create( 0 );
+	auto second = pool.create( 1 );
+	EXPECT_LT( first, second ); // the slabs are filled in order again
+	auto detached = pool.detach( second );
+	pool.destroy( first );
+	pool.recycle(); // no effect, a slab is shared with 'detached'
+	EXPECT_EQ( pool.create( 2 ), first );
+	pool.release();
+}
+
+TEST( ekpool, move )
+{
+	EK::Pool<std::string> pool;
+	auto a = pool.create( "Aharon" );
+	EK::Pool<std::string> other( std::move( pool ) );
+	EXPECT_EQ( pool.size(), 0 );
+	EXPECT_EQ( other.size(), 1 );
+	EXPECT_EQ( *a, "Aharon" );
+	other.destroy( a );
+}
+
+TEST( ekpool, splice )
+{
+	EK::Pool<int> a;
+	EK::Pool<int> b;
+	auto x = a.create( 1 );
+	auto y = b.create( 2 );
+	auto z = b.create( 3 );
+	b.destroy( z );
+	a.splice( b );
+	EXPECT_EQ( a.size(), 2 );
+	EXPECT_EQ( a.slab_count(), 2 );
+	EXPECT_EQ( b.size(), 0 );
+	EXPECT_EQ( b.slab_count(), 0 );
+	EXPECT_EQ( *y, 2 );
+	a.destroy( x );
+	a.destroy( y );
+	for ( int i = 0; i < 32; ++i )
+	{
+		a.create( i ); // free slots of both slabs are reused before a new slab is taken
+	}
+	EXPECT_EQ( a.slab_count(), 2 );
+}
+
+TEST( ekpool, detach_and_attach )
+{
+	auto a = std::make_unique<EK::Pool<std::string>>();
+	EK::Pool<std::string> b;
+	auto x = a->create( "Aharon" );
+	auto y = a->create( "Baruch" );
+
+	auto detached = a->detach( x );
+	EXPECT_EQ( detached.get(), x );
+	EXPECT_EQ( a->size(), 1 );
+	EXPECT_EQ( b.attach( std::move( detached ) ), x ); // the object keeps its address
+	EXPECT_EQ( detached.get(), nullptr );
+	EXPECT_EQ( b.size(), 1 );
+	EXPECT_EQ( b.slab_count(), 1 ); // the slab is shared
+
+	a->destroy( y );
+	a.reset(); // the slab stays allocated for b
+	EXPECT_EQ( *x, "Aharon" );
+	b.destroy( x );
+	EXPECT_EQ( b.create( "Sarah" ), x ); // the slot is reused by b
+
+	auto dropped = b.detach( x );
+	EXPECT_EQ( b.size(), 0 );
+	// 'dropped' destroys the object
+}
+
+TEST( ekpool, drop_of_detached )
+{
+	auto pool = std::make_unique<EK::Pool<std::string>>();
+	auto x = pool->create( "Aharon" );
+	pool->detach( x ); // dropped: the object is destroyed and its slot goes back to the pool
+	EXPECT_EQ( pool->size(), 0 );
+	EXPECT_EQ( pool->create( "Baruch" ), x );
+
+	// the pool moves, the slot follows it
+	auto detached = pool->detach( x );
+	EK::Pool<std::string> moved( std::move( *pool ) );
+	detached = decltype( detached )();
+	EXPECT_EQ( moved.create( "Sarah" ), x );
+
+	// the pool is gone, the slab is freed with the object
+	detached = moved.detach( x );
+	moved.release();
+	pool.reset();
+	EXPECT_EQ( *detached.get(), "Sarah" );
+}
+
+TEST( ekpool, splice_of_shared_slabs )
+{
+	EK::Pool<int> a;
+	EK::Pool<int> b;
+	auto x = a.create( 1 );
+	auto y = a.create( 2 );
+	b.attach( a.detach( y ) );
+	a.splice( b );
+	EXPECT_EQ( a.slab_count(), 1 );
+	EXPECT_EQ( a.size(), 2 );
+	a.destroy( x );
+	a.destroy( y );
+}
+
+TEST( ekpool, share )
+{
+	auto a = std::make_unique<EK::Pool<std::string>>();
+	EK::Pool<std::string> b;
+	auto x = a->create( "Aharon" );
+	auto y = a->create( "Baruch" );
+	b.share( *a, 1 ); // y goes to b
+	EXPECT_EQ( a->size(), 1 );
+	EXPECT_EQ( b.size(), 1 );
+	EXPECT_EQ( b.slab_count(), 1 );
+
+	a->destroy( x );
+	a.reset(); // the slab stays allocated for b
+	EXPECT_EQ( *y, "Baruch" );
+	b.destroy( y );
+	EXPECT_EQ( b.create( "Sarah" ), y ); // the slot is reused by b
+	b.destroy( y );
+}
@@ -0,0 +1,190 @@
+#include "pch.h"
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../my_containers/ekshardedmap.h"
+
+TEST( ekshardedmap, single_thread )
+{
+	EK::ShardedMap<int, std::string> m( 4 );
+	EXPECT_EQ( m.shard_count(), 4 );
+	m.insert( 1, "Aharon" );
+	m.insert( 2, "Baruch" );
+	m.insert( 3, "Sarah" );
+	EXPECT_EQ( m.size(), 3 );
+	EXPECT_EQ( m.at( 3 ), "Sarah" );
+	EXPECT_EQ( m.find( 1 ), std::optional<std::string>( "Aharon" ) );
+	EXPECT_FALSE( m.find( 4 ).has_value() );
+	EXPECT_THROW( m.at( 4 ), std::out_of_range );
+	EXPECT_TRUE( m.erase( 2 ) );
+	EXPECT_FALSE( m.erase( 2 ) );
+	EXPECT_FALSE( m.contains( 2 ) );
+	m.insert( 0, "Rachel" );
+
+	m.rebalance(); // 3 elements for 4 shards: nothing to do
+	std::vector<int> keys;
+	m.for_each( [&keys]( int key, const std::string& ) { keys.push_back( key ); } );
+	EXPECT_EQ( keys, ( std::vector<int>{ 0, 1, 3 } ) );
+
+	auto snapshot = m.snapshot();
+	m.clear();
+	EXPECT_EQ( m.size(), 0 );
+	EXPECT_EQ( snapshot.size(), 3 );
+	EXPECT_TRUE( snapshot.check_red_black_tree_properties().empty() );
+}
+
+TEST( ekshardedmap, rebalancing )
+{
+	// A map split into shards of equal sizes.
+	EK::Map<int, int> map;
+	for ( int i = 0; i < 1003; ++i )
+	{
+		map.insert( i, 2 * i );
+	}
+	EK::ShardedMap<int, int> split( map, 4 );
+	EXPECT_EQ( split.shard_sizes(), ( std::vector<std::size_t>{ 251, 251, 251, 250 } ) );
+	EXPECT_EQ( split.at( 502 ), 1004 );
+
+	// Ascending keys go to the last shard, which grows hot again and again.
+	EK::ShardedMap<int, int> m( 8 );
+	for ( int i = 0; i < 100000; ++i )
+	{
+		m.insert( i, 2 * i );
+	}
+	EXPECT_EQ( m.size(), 100000 );
+	auto sizes = m.shard_sizes();
+	EXPECT_GT( *std::min_element( sizes.begin(), sizes.end() ), 0 );
+	EXPECT_LE( *std::max_element( sizes.begin(), sizes.end() ) * sizes.size(), 2 * m.size() + 1024 * sizes.size() );
+	for ( int i = 0; i < 100000; i += 997 )
+	{
+		EXPECT_EQ( m.find( i ), std::optional<int>( 2 * i ) );
+	}
+
+	// A shard emptied by erasures gets elements back.
+	for ( int i = 0; i < 50000; ++i )
+	{
+		EXPECT_TRUE( m.erase( i ) );
+	}
+	m.rebalance();
+	sizes = m.shard_sizes();
+	EXPECT_EQ( *std::min_element( sizes.begin(), sizes.end() ), 50000 / 8 );
+	EXPECT_EQ( *std::max_element( sizes.begin(), sizes.end() ), 50000 / 8 );
+	int expected = 50000;
+	bool ordered = true;
+	m.for_each( [&expected, &ordered]( int key, int value ) {
+		ordered = ordered && key == expected && value == 2 * key;
+		++expected;
+	} );
+	EXPECT_TRUE( ordered );
+	EXPECT_EQ( expected, 100000 );
+	EXPECT_TRUE( m.snapshot().validate().valid() );
+}
+
+TEST( ekshardedmap, churn )
+{
+	// Erasures give the nodes back to the pools of the shards, so insertions and erasures by turns
+	// take no new memory.
+	EK::ShardedMap<int, int> m( 4 );
+	for ( int i = 0; i < 20000; ++i )
+	{
+		m.insert( i, i );
+	}
+	auto capacity = [&m] {
+		std::size_t result = 0;
+		for ( auto& statistics : m.shard_statistics() )
+		{
+			result += statistics.pool_capacity;
+		}
+		return result;
+	};
+	auto capacity_before = capacity();
+	for ( int round = 0; round < 200000; ++round )
+	{
+		auto key = round * 7 % 20000;
+		EXPECT_TRUE( m.erase( key ) );
+		m.insert( key, round );
+	}
+	EXPECT_FALSE( m.erase( 20000 ) );
+	EXPECT_EQ( m.size(), 20000 );
+	EXPECT_EQ( capacity(), capacity_before );
+}
+
+TEST( ekshardedmap, writers_and_readers )
+{
+	// Writers insert and erase keys of their own with value 2 * key, with rebalancings in between,
+	// while readers iterate and check what they see.
+	EK::ShardedMap<int, int> m( 8 );
+	std::atomic<bool> done{ false };
+	std::atomic<int> errors{ 0 };
+	constexpr int writer_count = 4;
+	constexpr int key_count = 40000;
+
+	std::vector<std::thread> readers;
+	for ( int r = 0; r < 2; ++r )
+	{
+		readers.emplace_back( [&] {
+			while ( !done.load() )
+			{
+				int previous = -1;
+				m.for_each( [&]( int key, int value ) {
+					if ( key <= previous || value != 2 * key )
+					{
+						++errors;
+					}
+					previous = key;
+				} );
+				auto value = m.find( previous / 2 );
+				if ( value.has_value() && *value != previous / 2 * 2 )
+				{
+					++errors;
+				}
+			}
+		} );
+	}
+
+	std::vector<std::thread> writers;
+	for ( int w = 0; w < writer_count; ++w )
+	{
+		writers.emplace_back( [&, w] {
+			for ( int key = w; key < key_count; key += writer_count )
+			{
+				m.insert( key, 2 * key );
+				if ( key % 3 == 0 )
+				{
+					m.erase( key / 2 - key / 2 % writer_count + w );
+				}
+			}
+		} );
+	}
+	for ( auto& writer : writers )
+	{
+		writer.join();
+	}
+	done = true;
+	for ( auto& reader : readers )
+	{
+		reader.join();
+	}
+	EXPECT_EQ( errors, 0 );
+
+	EK::Map<int, int> expected;
+	for ( int w = 0; w < writer_count; ++w )
+	{
+		for ( int key = w; key < key_count; key += writer_count )
+		{
+			expected.insert( key, 2 * key );
+			if ( key % 3 == 0 )
+			{
+				expected.erase( key / 2 - key / 2 % writer_count + w );
+			}
+		}
+	}
+	auto snapshot = m.snapshot();
+	EXPECT_EQ( m.size(), expected.size() );
+	EXPECT_TRUE( std::equal( snapshot.begin(), snapshot.end(), expected.begin(), expected.end(),
+		[]( auto& lhs, auto& rhs ) { return lhs.first == rhs.first && lhs.second == rhs.second; } ) );
+	EXPECT_TRUE( snapshot.validate().valid() );
+}
@@ -0,0 +1,98 @@
+#ifndef EK_MAP_STATISTICS
+#define EK_MAP_STATISTICS
+#endif
+#include "pch.h"
+#include <random>
+#include <string>
+
+#include "../my_containers/ekmap.h"
+
+namespace
+{
+
+// Maps of this file are instantiated with a key type of their own, so the instrumented Map doesn't meet
+// the plain one of other test files with the same template arguments.
+struct Id
+{
+	int value = 0;
+	bool operator<( const Id& rhs ) const { return value < rhs.value; }
+};
+
+} // nameless namespace
+
+TEST( ekstatistics, counters )
+{
+	EK::Map<Id, int> m;
+	std::mt19937 gen( 61 );
+	for ( int i = 0; i < 1000; ++i )
+	{
+		m.insert( Id{ i }, i );
+	}
+	auto statistics = m.statistics();
+	EXPECT_TRUE( statistics.enabled );
+	EXPECT_EQ( statistics.size, 1000 );
+	EXPECT_EQ( statistics.nodes_created, 1000 );
+	EXPECT_GT( statistics.rotations, 0 ); // ascending keys rotate on almost every insertion
+	EXPECT_GT( statistics.recolorings, 0 );
+	EXPECT_GE( statistics.height, 10 );
+	EXPECT_LE( statistics.height, statistics.height_bound );
+	EXPECT_EQ( statistics.insert_latency.samples, 1000 / EK::MapCounters::latency_sample_period + 1 );
+
+	for ( int i = 0; i < 100; ++i )
+	{
+		EXPECT_TRUE( m.contains( Id{ static_cast<int>( gen() % 1000 ) } ) );
+	}
+	EXPECT_FALSE( m.contains( Id{ 1000 } ) );
+	statistics = m.statistics();
+	EXPECT_EQ( statistics.lookups, 101 );
+	EXPECT_GE( statistics.lookup_comparisons, statistics.lookup_levels );
+	EXPECT_LE( statistics.lookup_comparisons, 2 * statistics.lookup_levels );
+	EXPECT_LE( statistics.lookup_levels, 101 * statistics.height );
+	EXPECT_EQ( statistics.lookup_latency.samples, 2 );
+	EXPECT_GT( statistics.lookup_latency.quantile_ns( 1 ), 0 );
+
+	for ( int i = 0; i < 1000; i += 2 )
+	{
+		m.erase( Id{ i } );
+	}
+	statistics = m.statistics();
+	EXPECT_EQ( statistics.size, 500 );
+	EXPECT_GT( statistics.swaps, 0 ); // inner nodes are swapped with their successors
+	EXPECT_EQ( statistics.erase_latency.samples, 500 / EK::MapCounters::latency_sample_period + 1 );
+	EXPECT_TRUE( m.check_red_black_tree_properties().empty() );
+
+	auto copy = m;
+	EXPECT_EQ( copy.statistics().lookups, 0 );
+	EXPECT_EQ( copy.statistics().height, statistics.height );
+
+	// hinted emplacements count their nodes too, a duplicate key creates none
+	auto hint = m.emplace_hint( m.end(), Id{ 2000 }, 0 );
+	m.emplace_hint( hint, Id{ 1999 }, 0 );
+	m.emplace_hint( hint, Id{ 2000 }, 1 );
+	EXPECT_EQ( m.statistics().nodes_created, 1002 );
+}
+
+TEST( ekstatistics, json )
+{
+	EK::Map<Id, int> m;
+	auto json = m.statistics().to_json();
+	EXPECT_EQ( json.front(), '{' );
+	EXPECT_EQ( json.back(), '}' );
+	EXPECT_NE( json.find( "\"enabled\":true" ), std::string::npos );
+	EXPECT_NE( json.find( "\"height\":0" ), std::string::npos );
+
+	m.insert( Id{ 1 }, 1 );
+	m.find( Id{ 1 } );
+	json = m.statistics().to_json();
+	EXPECT_NE( json.find( "\"lookups\":1," ), std::string::npos );
+	EXPECT_NE( json.find( "\"lookup_latency\":{\"samples\":1," ), std::string::npos );
+
+	EK::LatencyHistogram histogram;
+	EXPECT_EQ( histogram.quantile_ns( 0.5 ), 0 );
+	histogram.buckets[3] = 9; // [8, 16) ns
+	histogram.buckets[10] = 1; // [1024, 2048) ns
+	histogram.samples = 10;
+	EXPECT_EQ( histogram.quantile_ns( 0.5 ), 16 );
+	EXPECT_EQ( histogram.quantile_ns( 0.9 ), 16 );
+	EXPECT_EQ( histogram.quantile_ns( 0.99 ), 2048 );
+}
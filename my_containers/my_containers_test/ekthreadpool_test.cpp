@@ -0,0 +1,74 @@
+#include "pch.h"
+#include <atomic>
+#include <future>
+#include <vector>
+
+#include "../my_containers/ekthreadpool.h"
+
+namespace
+{
+
+long long s_sum( EK::ThreadPool& pool, long long lo, long long hi )
+{
+	// sum of [lo, hi) by fork-join recursion
+	if ( hi - lo < 1000 )
+	{
+		long long sum = 0;
+		for ( auto i = lo; i < hi; ++i )
+		{
+			sum += i;
+		}
+		return sum;
+	}
+	auto middle = lo + ( hi - lo ) / 2;
+	auto future = pool.submit( [&pool, middle, hi] { return s_sum( pool, middle, hi ); } );
+	auto left = s_sum( pool, lo, middle );
+	return left + pool.wait( future );
+}
+
+} // nameless namespace
+
+TEST( ekthreadpool, submit_and_wait )
+{
+	EK::ThreadPool pool( 2 );
+	EXPECT_EQ( pool.thread_count(), 2 );
+	std::atomic<int> counter{ 0 };
+	std::vector<std::future<void>> futures;
+	for ( int i = 0; i < 100; ++i )
+	{
+		futures.push_back( pool.submit( [&counter] { ++counter; } ) );
+	}
+	for ( auto& future : futures )
+	{
+		pool.wait( future );
+	}
+	EXPECT_EQ( counter, 100 );
+}
+
+TEST( ekthreadpool, nested_tasks )
+{
+	// more waiting tasks than threads must not dead-lock
+	EK::ThreadPool pool( 2 );
+	EXPECT_EQ( s_sum( pool, 0, 1000000 ), 1000000LL * 999999 / 2 );
+}
+
+TEST( ekthreadpool, work_stealing )
+{
+	// All tasks are forked by one task into the deque of its worker, the other workers have to steal them.
+	EK::ThreadPool pool( 4 );
+	std::atomic<int> counter{ 0 };
+	auto root = pool.submit( [&pool, &counter] {
+		std::vector<std::future<void>> futures;
+		for ( int i = 0; i < 1000; ++i )
+		{
+			futures.push_back( pool.submit( [&counter] { ++counter; } ) );
+		}
+		for ( auto& future : futures )
+		{
+			pool.wait( future );
+		}
+		return s_sum( pool, 0, 100000 );
+	} );
+	EXPECT_EQ( pool.wait( root ), 100000LL * 99999 / 2 );
+	EXPECT_EQ( counter, 1000 );
+}